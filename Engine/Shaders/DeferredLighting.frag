@@ -0,0 +1,264 @@
+#version 330 core
+out vec4 FragColor;
+
+in VS_OUT
+{
+	vec2 TexCoords;
+} fs_in;
+
+struct DirectionalLight
+{
+	vec3 direction;
+	vec3 ambient;
+	vec3 diffuse;
+	vec3 specular;
+};
+
+struct SpotLight
+{
+	vec3 position;
+	float innerCutOff;
+	vec3 direction;
+	float outerCutOff;
+
+	vec3 ambient;
+	float constant;
+	vec3 diffuse;
+	float linear;
+	vec3 specular;
+	float quadratic;
+};
+
+struct PointLight
+{
+	vec3 position;
+	float constant;
+	vec3 ambient;
+	float linear;
+	vec3 diffuse;
+	float quadratic;
+	vec3 specular;
+};
+
+layout (std140) uniform FrameData
+{
+	mat4 projection;
+	mat4 view;
+	vec3 viewPos;
+	float time;
+};
+
+layout (std140) uniform DeferredData
+{
+	mat4 inverseViewProjection;
+};
+
+layout (std140) uniform LightData
+{
+	DirectionalLight dirLight;
+	int numPointLights;
+	int numSpotLights;
+	vec4 clusterGrid;
+	vec4 clusterDepth;
+	vec4 clusterTileScale;
+	mat4 cascadeMatrices[4];
+	vec4 cascadeSplits;     // view depth where each cascade ends
+	vec4 cascadeParams;     // cascade count, cascade tint on/off
+};
+
+// Written by the GBUFFER variant of FragmentShader.frag
+uniform sampler2D gAlbedo;
+uniform sampler2D gNormalShininess;
+uniform sampler2D gSpecular;
+uniform sampler2D gDepth;
+uniform samplerCube skybox;
+// One layer per cascade, see ShadowCascades.h
+uniform sampler2DArray shadowMap;
+
+// Packed by LightManager, see LightManager.h for the texel layout
+uniform samplerBuffer pointLightBuffer;
+uniform samplerBuffer spotLightBuffer;
+
+struct Surface
+{
+	vec3 position;
+	vec3 normal;
+	vec3 albedo;
+	vec3 specular;
+	float shininess;
+};
+
+vec3 OctahedralDecode(vec2 encoded);
+PointLight FetchPointLight(int index);
+SpotLight FetchSpotLight(int index);
+int SelectCascade(vec3 position);
+float ShadowCalculation(Surface surface, vec3 lightDirection);
+vec3 CalculateDirectionalLight(DirectionalLight light, Surface surface, vec3 viewDirection);
+vec3 CalculatePointLight(PointLight light, Surface surface, vec3 viewDirection);
+vec3 CalculateSpotLight(SpotLight light, Surface surface, vec3 viewDirection);
+
+void main()
+{
+	// World position from the depth buffer
+	float depth = texture(gDepth, fs_in.TexCoords).r;
+	vec4 clip = vec4(vec3(fs_in.TexCoords, depth) * 2.0 - 1.0, 1.0);
+	vec4 world = inverseViewProjection * clip;
+	vec3 position = world.xyz / world.w;
+
+	// Nothing was drawn here, show the skybox like the forward path does
+	if (depth == 1.0)
+	{
+		FragColor = vec4(texture(skybox, position - viewPos).rgb, 1.0);
+		return;
+	}
+
+	vec4 normalShininess = texture(gNormalShininess, fs_in.TexCoords);
+	Surface surface;
+	surface.position = position;
+	surface.normal = OctahedralDecode(normalShininess.xy);
+	surface.albedo = texture(gAlbedo, fs_in.TexCoords).rgb;
+	surface.specular = texture(gSpecular, fs_in.TexCoords).rgb;
+	surface.shininess = normalShininess.z * 256.0;
+	vec3 viewDirection = normalize(viewPos - position);
+
+	vec3 result = CalculateDirectionalLight(dirLight, surface, viewDirection);
+	for(int i = 0; i < numPointLights; i++)
+		result += CalculatePointLight(FetchPointLight(i), surface, viewDirection);
+	for(int i = 0; i < numSpotLights; i++)
+		result += CalculateSpotLight(FetchSpotLight(i), surface, viewDirection);
+
+	if (cascadeParams.y > 0.0)
+	{
+		int cascade = SelectCascade(surface.position);
+		if (cascade >= 0)
+			result *= mix(vec3(0.25), vec3(1.0), vec3(cascade == 0 || cascade == 3, cascade == 1 || cascade == 3, cascade == 2));
+	}
+
+	float gamma = 2.2;
+	FragColor = vec4(pow(result, vec3(1.0/gamma)), 1.0);
+}
+
+vec3 OctahedralDecode(vec2 encoded)
+{
+	vec2 f = encoded * 2.0 - 1.0;
+	vec3 n = vec3(f, 1.0 - abs(f.x) - abs(f.y));
+	float t = clamp(-n.z, 0.0, 1.0);
+	n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+	return normalize(n);
+}
+
+PointLight FetchPointLight(int index)
+{
+	int base = index * 4;
+	vec4 t0 = texelFetch(pointLightBuffer, base);
+	vec4 t1 = texelFetch(pointLightBuffer, base + 1);
+	vec4 t2 = texelFetch(pointLightBuffer, base + 2);
+	vec4 t3 = texelFetch(pointLightBuffer, base + 3);
+
+	PointLight light;
+	light.position = t0.xyz;
+	light.constant = t0.w;
+	light.ambient = t1.rgb;
+	light.linear = t1.w;
+	light.diffuse = t2.rgb;
+	light.quadratic = t2.w;
+	light.specular = t3.rgb;
+	return light;
+}
+
+SpotLight FetchSpotLight(int index)
+{
+	int base = index * 5;
+	vec4 t0 = texelFetch(spotLightBuffer, base);
+	vec4 t1 = texelFetch(spotLightBuffer, base + 1);
+	vec4 t2 = texelFetch(spotLightBuffer, base + 2);
+	vec4 t3 = texelFetch(spotLightBuffer, base + 3);
+	vec4 t4 = texelFetch(spotLightBuffer, base + 4);
+
+	SpotLight light;
+	light.position = t0.xyz;
+	light.innerCutOff = t0.w;
+	light.direction = t1.xyz;
+	light.outerCutOff = t1.w;
+	light.ambient = t2.rgb;
+	light.constant = t2.w;
+	light.diffuse = t3.rgb;
+	light.linear = t3.w;
+	light.specular = t4.rgb;
+	light.quadratic = t4.w;
+	return light;
+}
+
+int SelectCascade(vec3 position)
+{
+	float depth = -(view * vec4(position, 1.0)).z;
+	int count = int(cascadeParams.x);
+	for (int i = 0; i < count; i++)
+	{
+		if (depth < cascadeSplits[i])
+			return i;
+	}
+	return -1;
+}
+
+float ShadowCalculation(Surface surface, vec3 lightDirection)
+{
+	int cascade = SelectCascade(surface.position);
+	if (cascade < 0)
+		return 0.0;
+	vec4 lightSpace = cascadeMatrices[cascade] * vec4(surface.position, 1.0);
+	vec3 projCoords = lightSpace.xyz / lightSpace.w * 0.5 + 0.5;
+	if (projCoords.z > 1.0)
+		return 0.0;
+	float closestDepth = texture(shadowMap, vec3(projCoords.xy, cascade)).r;
+	float bias = max(0.05 * (1.0 - dot(surface.normal, lightDirection)), 0.005);
+	return projCoords.z - bias > closestDepth ? 1.0 : 0.0;
+}
+
+// Same terms as FragmentShader.frag, evaluated in world space
+vec3 CalculateDirectionalLight(DirectionalLight light, Surface surface, vec3 viewDirection)
+{
+	vec3 lightDir = normalize(-light.direction);
+	vec3 halfwayDir = normalize(lightDir + viewDirection);
+	float diff = max(dot(surface.normal, lightDir), 0.0);
+	float spec = pow(max(dot(surface.normal, halfwayDir), 0.0), surface.shininess);
+
+	vec3 ambient = light.ambient * surface.albedo;
+	vec3 diffuse = light.diffuse * diff * surface.albedo;
+	vec3 specular = light.specular * spec * surface.specular;
+	float shadow = ShadowCalculation(surface, lightDir);
+	return (ambient + (1.0 - shadow) * (diffuse + specular)) * light.diffuse;
+}
+
+vec3 CalculatePointLight(PointLight light, Surface surface, vec3 viewDirection)
+{
+	vec3 lightDir = normalize(light.position - surface.position);
+	vec3 halfwayDir = normalize(lightDir + viewDirection);
+	float diff = max(dot(lightDir, surface.normal), 0.0);
+	float spec = pow(max(dot(surface.normal, halfwayDir), 0.0), surface.shininess);
+	float distance = length(light.position - surface.position);
+	float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));
+
+	vec3 ambient = light.ambient * surface.albedo;
+	vec3 diffuse = light.diffuse * diff * surface.albedo;
+	vec3 specular = light.specular * spec * surface.specular;
+	return (ambient + diffuse + specular) * attenuation;
+}
+
+vec3 CalculateSpotLight(SpotLight light, Surface surface, vec3 viewDirection)
+{
+	vec3 lightDir = normalize(light.position - surface.position);
+	vec3 halfwayDir = normalize(lightDir + viewDirection);
+	float diff = max(dot(surface.normal, lightDir), 0.0);
+	float spec = pow(max(dot(surface.normal, halfwayDir), 0.0), surface.shininess);
+	float distance = length(light.position - surface.position);
+	float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));
+	float theta = dot(lightDir, normalize(-light.direction));
+	float epsilon = light.innerCutOff - light.outerCutOff;
+	float intensity = clamp((theta - light.outerCutOff) / epsilon, 0.0, 1.0);
+
+	vec3 ambient = light.ambient * surface.albedo;
+	vec3 diffuse = light.diffuse * diff * surface.albedo;
+	vec3 specular = light.specular * spec * surface.specular;
+	return (ambient + diffuse + specular) * attenuation * intensity;
+}
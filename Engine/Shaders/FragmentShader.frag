@@ -1,30 +1,27 @@
 #version 330 core
+#ifdef BINDLESS_TEXTURES
+#extension GL_ARB_bindless_texture : require
+#endif
+#ifdef GBUFFER
+layout (location = 0) out vec4 GAlbedo;
+layout (location = 1) out vec4 GNormalShininess;
+layout (location = 2) out vec4 GSpecular;
+#else
 out vec4 FragColor;
-
-#define NUM_POINT_LIGHTS 1
+#endif
 
 in VS_OUT
 {
 	vec3 FragPos;  // Position in world space
 	vec2 TexCoords;
-	vec4 FragPosLightSpace;
 	vec3 TangentViewPos;
 	vec3 TangentFragPos;
 	mat3 TBN;
 } fs_in;
 
-struct Material
-{
-	sampler2D texture_diffuse1;
-	sampler2D texture_specular1;
-	sampler2D texture_normal1;
-	float shininess;
-};
-
 struct DirectionalLight
 {
 	vec3 direction;
-
 	vec3 ambient;
 	vec3 diffuse;
 	vec3 specular;
@@ -33,78 +30,319 @@ struct DirectionalLight
 struct SpotLight
 {
 	vec3 position;
-	vec3 direction;
 	float innerCutOff;
+	vec3 direction;
 	float outerCutOff;
 
 	vec3 ambient;
-	vec3 diffuse;
-	vec3 specular;
-
 	float constant;
+	vec3 diffuse;
 	float linear;
+	vec3 specular;
 	float quadratic;
 };
 
 struct PointLight
 {
 	vec3 position;
-
 	float constant;
-	float linear;
-	float quadratic;
-
 	vec3 ambient;
+	float linear;
 	vec3 diffuse;
+	float quadratic;
 	vec3 specular;
 };
 
 
-uniform Material material;
+layout (std140) uniform FrameData
+{
+	mat4 projection;
+	mat4 view;
+	vec3 viewPos;
+	float time;
+};
+
+layout (std140) uniform ObjectData
+{
+	mat4 model;
+	uvec4 material;  // material ID in x
+};
+
+// Packed by MaterialLibrary, see Materials.h for the texel layout
+uniform usamplerBuffer materialBuffer;
+
+// The draw's material, read by FetchMaterial. Maps are array slot << 16 | layer
+// in the arrays packed by MaterialTextures, see MaterialTextures.h
+uvec4 materialTextures;
+vec4 materialDiffuse;   // color, opacity
+vec4 materialSpecular;  // color, shininess
+
+#ifdef BINDLESS_TEXTURES
+layout (std140) uniform MaterialTextureData
+{
+	uvec4 arrayHandles[64];  // 64 bit handle in xy
+};
+#else
+uniform sampler2DArray materialArrays[7];
+#endif
+
+const uint NO_TEXTURE = 0xFFFFFFFFu;
+
+layout (std140) uniform MaterialData
+{
+	float height_scale;
+};
 
 // Lights
 // ------
-uniform DirectionalLight dirLight;
-uniform PointLight pointLights[NUM_POINT_LIGHTS];
-uniform SpotLight spotLight;
+layout (std140) uniform LightData
+{
+	DirectionalLight dirLight;
+	int numPointLights;
+	int numSpotLights;
+	vec4 clusterGrid;       // tiles x, tiles y, depth slices, attenuation cutoff
+	vec4 clusterDepth;      // near plane, far plane, slice scale, slice bias
+	vec4 clusterTileScale;  // tiles per pixel in x and y
+	mat4 cascadeMatrices[4];
+	vec4 cascadeSplits;     // view depth where each cascade ends
+	vec4 cascadeParams;     // cascade count, cascade tint on/off
+};
+
+// Packed by LightManager, see LightManager.h for the texel layout
+uniform samplerBuffer pointLightBuffer;
+uniform samplerBuffer spotLightBuffer;
+
+#ifdef CLUSTERED
+// Packed by LightClusters, see LightClusters.h
+uniform usamplerBuffer clusterBuffer;
+uniform usamplerBuffer clusterLightBuffer;
+#endif
 
 uniform samplerCube skybox;
-uniform sampler2D shadowMap;
+// One layer per cascade, see ShadowCascades.h
+uniform sampler2DArray shadowMap;
 uniform sampler2D depthMap;
 
-uniform float height_scale;
-
 vec2 parallaxTexCoords;
 
 // Method signatures
 // -----------------
+void FetchMaterial();
 vec2 ParallaxMapping(vec2 texCoords, vec3 viewDir);
+PointLight FetchPointLight(int index);
+SpotLight FetchSpotLight(int index);
 vec3 CalculateDirectionalLight(DirectionalLight light, vec3 normal, vec3 viewDirection);
 vec3 CalculatePointLight(PointLight light, vec3 normal, vec3 fragPosition, vec3 viewDirection);
 vec3 CalculateSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir);
-float ShadowCalculation(vec4 fragPosLightSpace, vec3 normal, vec3 lightDirection);
-
+int SelectCascade();
+float ShadowCalculation(vec3 normal, vec3 lightDirection);
+float CutOffAttenuation(float attenuation, vec3 ambient, vec3 diffuse, vec3 specular);
+int ClusterIndex();
+vec2 OctahedralEncode(vec3 n);
+vec4 SampleMaterial(uint textureRef, vec2 texCoords, vec4 fallback);
+vec4 SampleDiffuse(vec2 texCoords);
+vec4 SampleSpecular(vec2 texCoords);
+vec4 SampleNormal(vec2 texCoords);
+
+// Variants, see Source.cpp:
+// DEPTH_ONLY   depth pre-pass, runs the parallax discard and nothing else
+// DEPTH_EQUAL  color pass after the pre-pass, whose depth already holds the
+//              discard so it is skipped here and early depth testing stays on
+// GBUFFER      deferred geometry pass, writes the surface for DeferredLighting.frag
+// CLUSTERED    forward shading of only the lights binned into the fragment's cluster
 void main()
 {
-	vec3 normal = texture(material.texture_normal1, fs_in.TexCoords).rgb;
-	normal = normalize(normal * 2.0 - 1.0);
+	FetchMaterial();
 	vec3 viewDirection = normalize(fs_in.TangentViewPos - fs_in.TangentFragPos);
 
 	parallaxTexCoords = ParallaxMapping(fs_in.TexCoords, viewDirection);
+#ifndef DEPTH_EQUAL
 	if(parallaxTexCoords.x > 1.0 || parallaxTexCoords.y > 1.0 || parallaxTexCoords.x < 0.0 || parallaxTexCoords.y < 0.0)
 		discard;
+#endif
 
-	vec3 result;// = CalculateDirectionalLight(dirLight, normal, viewDirection);
+#if defined(DEPTH_ONLY)
+	FragColor = vec4(0.0);
+#elif defined(GBUFFER)
+	vec3 normal = SampleNormal(fs_in.TexCoords).rgb;
+	normal = normalize(normal * 2.0 - 1.0);
+	// TBN takes world space to tangent space, its transpose takes the normal back
+	vec3 worldNormal = normalize(transpose(fs_in.TBN) * normal);
+	GAlbedo = vec4(SampleDiffuse(parallaxTexCoords).rgb, 1.0);
+	GNormalShininess = vec4(OctahedralEncode(worldNormal), materialSpecular.w / 256.0, 0.0);
+	GSpecular = vec4(SampleSpecular(parallaxTexCoords).rgb, 1.0);
+#else
+	vec3 normal = SampleNormal(fs_in.TexCoords).rgb;
+	normal = normalize(normal * 2.0 - 1.0);
+
+	vec3 result = CalculateDirectionalLight(dirLight, normal, viewDirection);
 
-	for(int i = 0; i < NUM_POINT_LIGHTS; i++)
+#ifdef CLUSTERED
+	uvec2 cluster = texelFetch(clusterBuffer, ClusterIndex()).xy;
+	int first = int(cluster.x);
+	int pointCount = int(cluster.y & 0xFFFFu);
+	int lightCount = pointCount + int(cluster.y >> 16);
+	for(int i = first; i < first + pointCount; i++)
+	{
+		int light = int(texelFetch(clusterLightBuffer, i).r);
+		result += CalculatePointLight(FetchPointLight(light), normal, fs_in.TangentFragPos, viewDirection);
+	}
+	// Spot light indices follow the point lights
+	for(int i = first + pointCount; i < first + lightCount; i++)
+	{
+		int light = int(texelFetch(clusterLightBuffer, i).r) - numPointLights;
+		result += CalculateSpotLight(FetchSpotLight(light), normal, fs_in.TangentFragPos, viewDirection);
+	}
+#else
+	for(int i = 0; i < numPointLights; i++)
 	{
-		result += CalculatePointLight(pointLights[i], normal, fs_in.TangentFragPos, viewDirection);
+		result += CalculatePointLight(FetchPointLight(i), normal, fs_in.TangentFragPos, viewDirection);
     }    
 
-//	result += CalculateSpotLight(spotLight, normal, fs_in.TangentFragPos, viewDirection);
+	for(int i = 0; i < numSpotLights; i++)
+	{
+		result += CalculateSpotLight(FetchSpotLight(i), normal, fs_in.TangentFragPos, viewDirection);
+	}
+#endif
+
+	// Debug overlay, red, green, blue and yellow from the nearest cascade out
+	if (cascadeParams.y > 0.0)
+	{
+		int cascade = SelectCascade();
+		if (cascade >= 0)
+			result *= mix(vec3(0.25), vec3(1.0), vec3(cascade == 0 || cascade == 3, cascade == 1 || cascade == 3, cascade == 2));
+	}
 
 	float gamma = 2.2;
-	FragColor = vec4(pow(result.rgb, vec3(1.0/gamma)), 1.0);
+	// Only blended for materials with Material::TRANSLUCENT
+	FragColor = vec4(pow(result.rgb, vec3(1.0/gamma)), materialDiffuse.a);
+#endif
+}
+
+void FetchMaterial()
+{
+	int base = int(material.x) * 3;
+	materialTextures = texelFetch(materialBuffer, base);
+	materialDiffuse = uintBitsToFloat(texelFetch(materialBuffer, base + 1));
+	materialSpecular = uintBitsToFloat(texelFetch(materialBuffer, base + 2));
+}
+
+PointLight FetchPointLight(int index)
+{
+	int base = index * 4;
+	vec4 t0 = texelFetch(pointLightBuffer, base);
+	vec4 t1 = texelFetch(pointLightBuffer, base + 1);
+	vec4 t2 = texelFetch(pointLightBuffer, base + 2);
+	vec4 t3 = texelFetch(pointLightBuffer, base + 3);
+
+	PointLight light;
+	light.position = t0.xyz;
+	light.constant = t0.w;
+	light.ambient = t1.rgb;
+	light.linear = t1.w;
+	light.diffuse = t2.rgb;
+	light.quadratic = t2.w;
+	light.specular = t3.rgb;
+	return light;
+}
+
+SpotLight FetchSpotLight(int index)
+{
+	int base = index * 5;
+	vec4 t0 = texelFetch(spotLightBuffer, base);
+	vec4 t1 = texelFetch(spotLightBuffer, base + 1);
+	vec4 t2 = texelFetch(spotLightBuffer, base + 2);
+	vec4 t3 = texelFetch(spotLightBuffer, base + 3);
+	vec4 t4 = texelFetch(spotLightBuffer, base + 4);
+
+	SpotLight light;
+	light.position = t0.xyz;
+	light.innerCutOff = t0.w;
+	light.direction = t1.xyz;
+	light.outerCutOff = t1.w;
+	light.ambient = t2.rgb;
+	light.constant = t2.w;
+	light.diffuse = t3.rgb;
+	light.linear = t3.w;
+	light.specular = t4.rgb;
+	light.quadratic = t4.w;
+	return light;
+}
+
+vec4 SampleMaterial(uint textureRef, vec2 texCoords, vec4 fallback)
+{
+	if (textureRef == NO_TEXTURE)
+		return fallback;
+	uint slot = textureRef >> 16;
+	vec3 coords = vec3(texCoords, float(textureRef & 0xFFFFu));
+#ifdef BINDLESS_TEXTURES
+	return texture(sampler2DArray(arrayHandles[slot].xy), coords);
+#else
+	// GLSL 3.30 only indexes sampler arrays with constants, slot is the same for the whole draw
+	switch (slot)
+	{
+	case 0u: return texture(materialArrays[0], coords);
+	case 1u: return texture(materialArrays[1], coords);
+	case 2u: return texture(materialArrays[2], coords);
+	case 3u: return texture(materialArrays[3], coords);
+	case 4u: return texture(materialArrays[4], coords);
+	case 5u: return texture(materialArrays[5], coords);
+	case 6u: return texture(materialArrays[6], coords);
+	}
+	return fallback;
+#endif
+}
+
+// Materials without a map of a kind use their colors, normals stay unperturbed
+vec4 SampleDiffuse(vec2 texCoords)
+{
+	return SampleMaterial(materialTextures.x, texCoords, materialDiffuse);
+}
+
+vec4 SampleSpecular(vec2 texCoords)
+{
+	return SampleMaterial(materialTextures.y, texCoords, vec4(materialSpecular.rgb, 1.0));
+}
+
+vec4 SampleNormal(vec2 texCoords)
+{
+	return SampleMaterial(materialTextures.z, texCoords, vec4(0.5, 0.5, 1.0, 1.0));
+}
+
+// Cluster of the fragment, tiles over the render target and depth slices
+// spaced exponentially between the near and far planes
+int ClusterIndex()
+{
+	float nearPlane = clusterDepth.x;
+	float farPlane = clusterDepth.y;
+	float depth = 2.0 * nearPlane * farPlane / (farPlane + nearPlane - (gl_FragCoord.z * 2.0 - 1.0) * (farPlane - nearPlane));
+	ivec3 grid = ivec3(clusterGrid.xyz);
+	ivec2 tile = min(ivec2(gl_FragCoord.xy * clusterTileScale.xy), grid.xy - 1);
+	int slice = clamp(int(floor(log(depth) * clusterDepth.z - clusterDepth.w)), 0, grid.z - 1);
+	return (slice * grid.y + tile.y) * grid.x + tile.x;
+}
+
+// Lights were binned with the radius where their brightest channel fades to
+// the cutoff, subtracting it there brings the light to zero at that radius
+// instead of cutting it off with a visible edge
+float CutOffAttenuation(float attenuation, vec3 ambient, vec3 diffuse, vec3 specular)
+{
+#ifdef CLUSTERED
+	vec3 intensity = ambient + diffuse + specular;
+	return max(attenuation - clusterGrid.w / max(max(intensity.r, intensity.g), intensity.b), 0.0);
+#else
+	return attenuation;
+#endif
+}
+
+// Unit vector folded onto the octahedron |x| + |y| + |z| = 1 and unwrapped
+// into [0, 1]^2, see DeferredLighting.frag for the decode
+vec2 OctahedralEncode(vec3 n)
+{
+	n /= abs(n.x) + abs(n.y) + abs(n.z);
+	vec2 signs = vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+	vec2 folded = n.z >= 0.0 ? n.xy : (1.0 - abs(n.yx)) * signs;
+	return folded * 0.5 + 0.5;
 }
 
 vec2 ParallaxMapping(vec2 texCoords, vec3 viewDir)
@@ -138,14 +376,31 @@ vec2 ParallaxMapping(vec2 texCoords, vec3 viewDir)
 	return finalTexCoords;
 }
 
-float ShadowCalculation(vec4 fragPosLightSpace, vec3 normal, vec3 lightDirection)
+// Cascade of the fragment by view depth, -1 past the last one
+int SelectCascade()
 {
+	float depth = -(view * vec4(fs_in.FragPos, 1.0)).z;
+	int count = int(cascadeParams.x);
+	for (int i = 0; i < count; i++)
+	{
+		if (depth < cascadeSplits[i])
+			return i;
+	}
+	return -1;
+}
+
+float ShadowCalculation(vec3 normal, vec3 lightDirection)
+{
+	int cascade = SelectCascade();
+	if (cascade < 0)
+		return 0.0;
+	vec4 fragPosLightSpace = cascadeMatrices[cascade] * vec4(fs_in.FragPos, 1.0);
     // perform perspective divide
     vec3 projCoords = fragPosLightSpace.xyz / fragPosLightSpace.w;
     // transform to [0,1] range
     projCoords = projCoords * 0.5 + 0.5;
     // get closest depth value from light's perspective (using [0,1] range fragPosLight as coords)
-    float closestDepth = texture(shadowMap, projCoords.xy).r; 
+    float closestDepth = texture(shadowMap, vec3(projCoords.xy, cascade)).r; 
     // get depth of current fragment from light's perspective
     float currentDepth = projCoords.z;
     // check whether current frag pos is in shadow
@@ -154,13 +409,13 @@ float ShadowCalculation(vec4 fragPosLightSpace, vec3 normal, vec3 lightDirection
     float shadow = currentDepth - bias > closestDepth  ? 1.0 : 0.0;
 	
 	// Soft shadows (Performance Heavy)
-//	vec2 texelSize = 1.0 / textureSize(shadowMap, 0);
+//	vec2 texelSize = 1.0 / vec2(textureSize(shadowMap, 0).xy);
 //	const int halfKernalWidth = 3;
 //	for(int x= -halfKernalWidth; x <= halfKernalWidth; ++x)
 //	{
 //		for(int y = -halfKernalWidth; y <= halfKernalWidth; ++y)
 //		{
-//			float pcfDepth = texture(shadowMap, projCoords.xy + vec2(x, y) * texelSize).r;
+//			float pcfDepth = texture(shadowMap, vec3(projCoords.xy + vec2(x, y) * texelSize, cascade)).r;
 //			shadow += currentDepth - bias > pcfDepth ? 1.0 : 0.0;
 //		}
 //	}
@@ -176,18 +431,19 @@ float ShadowCalculation(vec4 fragPosLightSpace, vec3 normal, vec3 lightDirection
 
 vec3 CalculateDirectionalLight(DirectionalLight light, vec3 normal, vec3 viewDirection)
 {
-	vec3 lightDir = normalize(-light.direction);
+	// The normal and view direction are in tangent space
+	vec3 lightDir = normalize(fs_in.TBN * -light.direction);
 	vec3 halfwayDir = normalize(lightDir + viewDirection);
     // diffuse shading
     float diff = max(dot(normal, lightDir), 0.0);
     // specular shading
-    float spec = pow(max(dot(normal, halfwayDir), 0.0), material.shininess);
+    float spec = pow(max(dot(normal, halfwayDir), 0.0), materialSpecular.w);
     // combine results
-    vec3 ambient = light.ambient * vec3(texture(material.texture_diffuse1, fs_in.TexCoords));
-    vec3 diffuse = light.diffuse * diff * vec3(texture(material.texture_diffuse1, fs_in.TexCoords));
-    vec3 specular = light.specular * spec * vec3(texture(material.texture_specular1, fs_in.TexCoords));
+    vec3 ambient = light.ambient * vec3(SampleDiffuse(fs_in.TexCoords));
+    vec3 diffuse = light.diffuse * diff * vec3(SampleDiffuse(fs_in.TexCoords));
+    vec3 specular = light.specular * spec * vec3(SampleSpecular(fs_in.TexCoords));
 
-	float shadow = ShadowCalculation(fs_in.FragPosLightSpace, normal, light.direction);
+	float shadow = ShadowCalculation(normal, lightDir);
 	vec3 result = (ambient + (1.0 - shadow) * (diffuse + specular)) * light.diffuse;  
 
     return result;
@@ -201,14 +457,15 @@ vec3 CalculatePointLight(PointLight light, vec3 normal, vec3 fragPosition, vec3
     // diffuse shading
     float diff = max(dot(lightDir, normal), 0.0);
     // specular shading
-    float spec = pow(max(dot(normal, halfwayDir), 0.0), material.shininess);
+    float spec = pow(max(dot(normal, halfwayDir), 0.0), materialSpecular.w);
     // attenuation
     float distance = length(tangentLightPos - fragPosition);
     float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));    
+    attenuation = CutOffAttenuation(attenuation, light.ambient, light.diffuse, light.specular);
     // combine results
-    vec3 ambient = light.ambient * vec3(texture(material.texture_diffuse1, parallaxTexCoords));
-    vec3 diffuse = light.diffuse * diff * vec3(texture(material.texture_diffuse1, parallaxTexCoords));
-    vec3 specular = light.specular * spec * vec3(texture(material.texture_specular1, parallaxTexCoords));
+    vec3 ambient = light.ambient * vec3(SampleDiffuse(parallaxTexCoords));
+    vec3 diffuse = light.diffuse * diff * vec3(SampleDiffuse(parallaxTexCoords));
+    vec3 specular = light.specular * spec * vec3(SampleSpecular(parallaxTexCoords));
     ambient *= attenuation;
     diffuse *= attenuation;
     specular *= attenuation;
@@ -217,24 +474,26 @@ vec3 CalculatePointLight(PointLight light, vec3 normal, vec3 fragPosition, vec3
 
 vec3 CalculateSpotLight(SpotLight light, vec3 normal, vec3 fragPosition, vec3 viewDirection)
 {
-//	vec3 tangentLightPos = fs_in.TBN * light.position;
-    vec3 lightDir = normalize(light.position - fragPosition);
+	vec3 tangentLightPos = fs_in.TBN * light.position;
+	vec3 tangentLightDir = fs_in.TBN * light.direction;
+    vec3 lightDir = normalize(tangentLightPos - fragPosition);
 	vec3 halfwayDir = normalize(lightDir + viewDirection);
     // diffuse shading
     float diff = max(dot(normal, lightDir), 0.0);
     // specular shading
-    float spec = pow(max(dot(normal, halfwayDir), 0.0), material.shininess);
+    float spec = pow(max(dot(normal, halfwayDir), 0.0), materialSpecular.w);
     // attenuation
-    float distance = length(light.position - fragPosition);
+    float distance = length(tangentLightPos - fragPosition);
     float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));    
+    attenuation = CutOffAttenuation(attenuation, light.ambient, light.diffuse, light.specular);
     // spotlight intensity
-    float theta = dot(lightDir, normalize(-light.direction)); 
+    float theta = dot(lightDir, normalize(-tangentLightDir)); 
     float epsilon = light.innerCutOff - light.outerCutOff;
     float intensity = clamp((theta - light.outerCutOff) / epsilon, 0.0, 1.0);
     // combine results
-    vec3 ambient = light.ambient * vec3(texture(material.texture_diffuse1, fs_in.TexCoords));
-    vec3 diffuse = light.diffuse * diff * vec3(texture(material.texture_diffuse1, fs_in.TexCoords));
-    vec3 specular = light.specular * spec * vec3(texture(material.texture_specular1, fs_in.TexCoords));
+    vec3 ambient = light.ambient * vec3(SampleDiffuse(fs_in.TexCoords));
+    vec3 diffuse = light.diffuse * diff * vec3(SampleDiffuse(fs_in.TexCoords));
+    vec3 specular = light.specular * spec * vec3(SampleSpecular(fs_in.TexCoords));
     ambient *= attenuation * intensity;
     diffuse *= attenuation * intensity;
     specular *= attenuation * intensity;
@@ -12,17 +12,29 @@ const float offset = 1.0 / 300.0;
 
 uniform bool postProcessEnabled;
 
-uniform float time;
+layout (std140) uniform FrameData
+{
+	mat4 projection;
+	mat4 view;
+	vec3 viewPos;
+	float time;
+};
 
-// Film Grain
-uniform float filmgrainEnabled;
-uniform float grainStrength;
+layout (std140) uniform PostProcessData
+{
+	// Film Grain
+	float filmgrainEnabled;
+	float grainStrength;
 
-// Vignette
-uniform float vignetteEnabled;
-uniform float vignetteInnerRadius;
-uniform float vignetteOuterRadius;
-uniform float vignetteOpacity;
+	// Vignette
+	float vignetteEnabled;
+	float vignetteInnerRadius;
+	float vignetteOuterRadius;
+	float vignetteOpacity;
+
+	float near_plane;
+	float far_plane;
+};
 
 vec4 GetTextureColor();
 
@@ -30,9 +42,6 @@ vec4 AddVignette(vec4 sourceColor);
 vec4 AddFilmGrain(vec4 sourceColor);
 float LinearizeDepth(float depth);
 
-uniform float near_plane;
-uniform float far_plane;
-
 void main()
 {
 //	float depthValue = texture(screenTexture, fs_in.TexCoords).r;
@@ -0,0 +1,20 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+
+layout (std140) uniform FrameData
+{
+	mat4 projection;
+	mat4 view;
+	vec3 viewPos;
+	float time;
+};
+
+layout (std140) uniform ObjectData
+{
+	mat4 model;
+};
+
+void main()
+{
+	gl_Position = projection * view * model * vec4(aPos, 1.0);
+}
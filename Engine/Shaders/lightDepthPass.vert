@@ -1,10 +1,18 @@
 #version 330 core
 layout (location = 0) in vec3 aPos;
+layout (location = 4) in mat4 aInstanceModel;
 
-uniform mat4 lightSpaceMatrix;
-uniform mat4 model;
+layout (std140) uniform PassData
+{
+	mat4 lightSpaceMatrix;
+};
+
+layout (std140) uniform ObjectData
+{
+	mat4 model;
+};
 
 void main()
 {
-	gl_Position = lightSpaceMatrix * model * vec4(aPos, 1.0f);
+	gl_Position = lightSpaceMatrix * model * aInstanceModel * vec4(aPos, 1.0f);
 }
\ No newline at end of file
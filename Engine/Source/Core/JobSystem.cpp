@@ -0,0 +1,322 @@
+#include "JobSystem.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+
+JobSystem g_jobSystem;
+
+namespace
+{
+	// Which job system the current thread works for and its worker index
+	thread_local JobSystem* t_jobSystem = nullptr;
+	thread_local unsigned int t_workerIndex = 0;
+
+	const unsigned int SPINS_BEFORE_SLEEP = 64;
+}
+
+bool WorkStealingDeque::Push(Job* job)
+{
+	long long b = bottom.load(std::memory_order_relaxed);
+	long long t = top.load(std::memory_order_acquire);
+	if (b - t >= static_cast<long long>(CAPACITY))
+		return false;
+
+	jobs[b & (CAPACITY - 1)].store(job, std::memory_order_relaxed);
+	// Publishes the job's contents to thieves that acquire bottom
+	bottom.store(b + 1, std::memory_order_release);
+	return true;
+}
+
+Job* WorkStealingDeque::Pop()
+{
+	long long b = bottom.load(std::memory_order_relaxed) - 1;
+	bottom.store(b, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	long long t = top.load(std::memory_order_relaxed);
+
+	if (t > b)
+	{
+		// Empty
+		bottom.store(b + 1, std::memory_order_relaxed);
+		return nullptr;
+	}
+
+	Job* job = jobs[b & (CAPACITY - 1)].load(std::memory_order_relaxed);
+	if (t == b)
+	{
+		// Last job, race thieves for it
+		if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+			job = nullptr;
+		bottom.store(b + 1, std::memory_order_relaxed);
+	}
+	return job;
+}
+
+Job* WorkStealingDeque::Steal()
+{
+	long long t = top.load(std::memory_order_acquire);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	long long b = bottom.load(std::memory_order_acquire);
+	if (t >= b)
+		return nullptr;
+
+	Job* job = jobs[t & (CAPACITY - 1)].load(std::memory_order_relaxed);
+	if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+		return nullptr;
+	return job;
+}
+
+void JobSystem::Init(unsigned int threadCount)
+{
+	if (running)
+		return;
+
+	unsigned int count = threadCount ? threadCount : std::max(1u, std::thread::hardware_concurrency());
+	for (unsigned int i = 0; i < count; i++)
+	{
+		workers.emplace_back(new Worker());
+		workers.back()->ring.reset(new Job[JOB_RING_SIZE]);
+		workers.back()->random = 2654435761u * (i + 1);
+	}
+
+	t_jobSystem = this;
+	t_workerIndex = 0;
+	running = true;
+	for (unsigned int i = 1; i < count; i++)
+		threads.emplace_back(&JobSystem::WorkerLoop, this, i);
+}
+
+void JobSystem::Shutdown()
+{
+	if (!running)
+		return;
+
+	running = false;
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		wake.notify_all();
+	}
+	for (std::thread& thread : threads)
+		thread.join();
+	threads.clear();
+	workers.clear();
+	if (t_jobSystem == this)
+		t_jobSystem = nullptr;
+}
+
+bool JobSystem::IsWorkerThread() const
+{
+	return t_jobSystem == this;
+}
+
+unsigned int JobSystem::BatchSizeFor(unsigned int count, unsigned int minBatch) const
+{
+	unsigned int batches = std::max(1u, GetWorkerCount()) * 4;
+	return std::max(minBatch, (count + batches - 1) / batches);
+}
+
+Job* JobSystem::AllocateJob()
+{
+	Worker& worker = *workers[t_workerIndex];
+	Job* job = &worker.ring[worker.next++ & (JOB_RING_SIZE - 1)];
+	// The slot's previous job still runs in place, help until it is done
+	while (!job->finished.load(std::memory_order_acquire))
+	{
+		Job* other = FindJob(t_workerIndex);
+		if (other)
+			Execute(other);
+		else
+			std::this_thread::yield();
+	}
+	job->finished.store(false, std::memory_order_relaxed);
+	return job;
+}
+
+void JobSystem::Submit(Job* job)
+{
+	queuedJobs++;
+	if (!workers[t_workerIndex]->deque.Push(job))
+	{
+		// Full, run it here instead
+		queuedJobs--;
+		Execute(job);
+		return;
+	}
+	wake.notify_one();
+}
+
+Job* JobSystem::FindJob(unsigned int workerIndex)
+{
+	Worker& worker = *workers[workerIndex];
+	Job* job = worker.deque.Pop();
+	if (job)
+	{
+		queuedJobs--;
+		return job;
+	}
+
+	// Start at a random victim so thieves spread out
+	unsigned int count = GetWorkerCount();
+	worker.random ^= worker.random << 13;
+	worker.random ^= worker.random >> 17;
+	worker.random ^= worker.random << 5;
+	unsigned int start = worker.random % count;
+	for (unsigned int i = 0; i < count; i++)
+	{
+		unsigned int victim = (start + i) % count;
+		if (victim == workerIndex)
+			continue;
+		job = workers[victim]->deque.Steal();
+		if (job)
+		{
+			queuedJobs--;
+			return job;
+		}
+	}
+	return nullptr;
+}
+
+void JobSystem::Execute(Job* job)
+{
+	JobCounter* counter = job->counter;
+	job->function(*job);
+	counter->value.fetch_sub(1, std::memory_order_release);
+	job->finished.store(true, std::memory_order_release);
+}
+
+void JobSystem::Wait(JobCounter& counter)
+{
+	while (!counter.IsDone())
+	{
+		Job* job = IsWorkerThread() ? FindJob(t_workerIndex) : nullptr;
+		if (job)
+			Execute(job);
+		else
+			std::this_thread::yield();
+	}
+}
+
+void JobSystem::WorkerLoop(unsigned int workerIndex)
+{
+	t_jobSystem = this;
+	t_workerIndex = workerIndex;
+
+	unsigned int spins = 0;
+	while (running)
+	{
+		Job* job = FindJob(workerIndex);
+		if (job)
+		{
+			Execute(job);
+			spins = 0;
+			continue;
+		}
+
+		if (++spins < SPINS_BEFORE_SLEEP)
+		{
+			std::this_thread::yield();
+			continue;
+		}
+
+		// The timeout covers a wake up sent between the check and the wait
+		std::unique_lock<std::mutex> lock(sleepMutex);
+		wake.wait_for(lock, std::chrono::milliseconds(1), [this]() { return queuedJobs > 0 || !running; });
+		spins = 0;
+	}
+}
+
+namespace
+{
+	const unsigned int FIB_CUTOFF = 14;
+
+	unsigned long long SerialFib(unsigned int n)
+	{
+		return n < 2 ? n : SerialFib(n - 1) + SerialFib(n - 2);
+	}
+
+	void JobFib(JobSystem& jobs, unsigned int n, unsigned long long& result)
+	{
+		if (n < FIB_CUTOFF)
+		{
+			result = SerialFib(n);
+			return;
+		}
+
+		unsigned long long a = 0, b = 0;
+		JobCounter counter;
+		jobs.Run([&jobs, n, &a]() { JobFib(jobs, n - 1, a); }, counter);
+		JobFib(jobs, n - 2, b);
+		jobs.Wait(counter);
+		result = a + b;
+	}
+}
+
+JobSystem::BenchmarkResult JobSystem::Benchmark()
+{
+	BenchmarkResult result = {};
+	result.workers = GetWorkerCount();
+
+	unsigned long long expectedFib = SerialFib(FIB_N);
+	unsigned long long fib = 0;
+	auto start = std::chrono::high_resolution_clock::now();
+	JobFib(*this, FIB_N, fib);
+	result.fibMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	if (fib != expectedFib)
+	{
+		std::cout << "Error::JobSystem::fib(" << FIB_N << ") returned " << fib << " instead of " << expectedFib << "\n";
+		result.failures++;
+	}
+
+	const unsigned int count = 1 << 22;
+	std::vector<float> values(count);
+	for (unsigned int i = 0; i < count; i++)
+		values[i] = static_cast<float>(i % 1000);
+
+	start = std::chrono::high_resolution_clock::now();
+	double serialSum = 0.0;
+	for (float value : values)
+		serialSum += std::sqrt(value);
+	result.serialForMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+	unsigned int batch = BatchSizeFor(count, 4096);
+	std::vector<double> partials((count + batch - 1) / batch, 0.0);
+	start = std::chrono::high_resolution_clock::now();
+	ParallelFor(count, batch, [&](unsigned int begin, unsigned int end)
+	{
+		double sum = 0.0;
+		for (unsigned int i = begin; i < end; i++)
+			sum += std::sqrt(values[i]);
+		partials[begin / batch] = sum;
+	});
+	double parallelSum = 0.0;
+	for (double partial : partials)
+		parallelSum += partial;
+	result.parallelForMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	if (std::fabs(parallelSum - serialSum) > 1e-6 * serialSum)
+	{
+		std::cout << "Error::JobSystem::Parallel sum " << parallelSum << " differs from serial sum " << serialSum << "\n";
+		result.failures++;
+	}
+
+	const unsigned int tinyJobs = 1 << 16;
+	const unsigned int tinyBatch = 1024;
+	std::atomic<unsigned int> ran(0);
+	start = std::chrono::high_resolution_clock::now();
+	for (unsigned int first = 0; first < tinyJobs; first += tinyBatch)
+	{
+		JobCounter counter;
+		for (unsigned int i = 0; i < tinyBatch; i++)
+			Run([&ran]() { ran.fetch_add(1, std::memory_order_relaxed); }, counter);
+		Wait(counter);
+	}
+	result.tinyJobsMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	result.nsPerJob = result.tinyJobsMs * 1e6 / tinyJobs;
+	if (ran != tinyJobs)
+	{
+		std::cout << "Error::JobSystem::Ran " << ran << " of " << tinyJobs << " tiny jobs\n";
+		result.failures++;
+	}
+	return result;
+}
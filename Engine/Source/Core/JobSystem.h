@@ -0,0 +1,177 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Counts the unfinished jobs started with it, Wait on it to join them
+class JobCounter
+{
+public:
+	JobCounter() : value(0) {}
+	bool IsDone() const { return value.load(std::memory_order_acquire) == 0; }
+
+private:
+	friend class JobSystem;
+	std::atomic<int> value;
+};
+
+// Small closure stored inline, Run copies the callable into data
+struct Job
+{
+	static const unsigned int DATA_SIZE = 48;
+
+	void (*function)(Job& job) = nullptr;
+	JobCounter* counter = nullptr;
+	// Cleared while the job is queued or running, its ring slot is reused after
+	std::atomic<bool> finished{ true };
+	std::aligned_storage<DATA_SIZE, 16>::type data;
+};
+
+// Chase-Lev deque of a fixed power of two capacity. The owning worker pushes
+// and pops at the bottom, other workers steal from the top.
+class WorkStealingDeque
+{
+public:
+	static const unsigned int CAPACITY = 4096;
+
+	WorkStealingDeque() : top(0), bottom(0) {}
+	// Owner only, false when full
+	bool Push(Job* job);
+	// Owner only
+	Job* Pop();
+	// Any thread
+	Job* Steal();
+
+private:
+	std::atomic<long long> top;
+	std::atomic<long long> bottom;
+	std::atomic<Job*> jobs[CAPACITY];
+};
+
+// One worker per core, the thread that calls Init is worker 0 and joins in
+// whenever it waits. Every worker owns a deque, idle workers steal from
+// random victims and sleep once there is nothing left to steal.
+//
+// Jobs come from a per thread ring of JOB_RING_SIZE entries. A thread with
+// that many jobs in flight runs other jobs until the next slot has finished.
+// Jobs started from a thread that is not a worker run immediately on that
+// thread.
+class JobSystem
+{
+public:
+	// Twice the deque capacity, so queued jobs plus the ones running cannot wrap it
+	static const unsigned int JOB_RING_SIZE = 2 * WorkStealingDeque::CAPACITY;
+
+	JobSystem() {}
+	~JobSystem() { Shutdown(); }
+	// threadCount 0 uses every core
+	void Init(unsigned int threadCount = 0);
+	void Shutdown();
+
+	unsigned int GetWorkerCount() const { return static_cast<unsigned int>(workers.size()); }
+	bool IsWorkerThread() const;
+
+	// Queues f() on the calling worker, counter is incremented now and
+	// decremented when f returns
+	template<typename F>
+	void Run(F f, JobCounter& counter)
+	{
+		typedef typename std::decay<F>::type Callable;
+		static_assert(sizeof(Callable) <= Job::DATA_SIZE, "Job closure too large, capture by reference");
+		static_assert(std::alignment_of<Callable>::value <= 16, "Job closure over aligned");
+		if (!IsWorkerThread())
+		{
+			f();
+			return;
+		}
+
+		Job* job = AllocateJob();
+		new (&job->data) Callable(std::move(f));
+		job->function = [](Job& self)
+		{
+			Callable* callable = reinterpret_cast<Callable*>(&self.data);
+			(*callable)();
+			callable->~Callable();
+		};
+		job->counter = &counter;
+		counter.value.fetch_add(1, std::memory_order_relaxed);
+		Submit(job);
+	}
+
+	// Runs other jobs until every job started with counter has finished
+	void Wait(JobCounter& counter);
+
+	// f(begin, end) over [0, count) in batches of at most batchSize, returns
+	// once all batches ran. The calling worker takes part.
+	template<typename F>
+	void ParallelFor(unsigned int count, unsigned int batchSize, const F& f)
+	{
+		if (count == 0)
+			return;
+		if (batchSize == 0)
+			batchSize = 1;
+		if (!IsWorkerThread() || count <= batchSize)
+		{
+			f(0u, count);
+			return;
+		}
+
+		JobCounter counter;
+		for (unsigned int begin = batchSize; begin < count; begin += batchSize)
+		{
+			unsigned int end = begin + batchSize < count ? begin + batchSize : count;
+			const F* body = &f;
+			Run([body, begin, end]() { (*body)(begin, end); }, counter);
+		}
+		f(0u, batchSize);
+		Wait(counter);
+	}
+
+	// Batch size that gives every worker a few batches to balance with
+	unsigned int BatchSizeFor(unsigned int count, unsigned int minBatch = 1) const;
+
+	struct BenchmarkResult
+	{
+		unsigned int workers;
+		double fibMs;             // recursive fib(FIB_N), a job per call above the cutoff
+		double parallelForMs;     // sqrt sum over 4M floats
+		double serialForMs;       // same loop on one thread
+		double tinyJobsMs;        // 64k empty jobs, started 1024 at a time
+		double nsPerJob;          // tinyJobsMs per job
+		unsigned int failures;    // results that did not match the serial answer
+	};
+	static const unsigned int FIB_N = 28;
+	BenchmarkResult Benchmark();
+
+private:
+	struct Worker
+	{
+		WorkStealingDeque deque;
+		std::unique_ptr<Job[]> ring;
+		unsigned int next = 0;
+		unsigned int random = 0;
+	};
+
+	std::vector<std::unique_ptr<Worker>> workers;
+	std::vector<std::thread> threads;
+	std::atomic<bool> running{ false };
+	// Jobs pushed and not yet taken by a worker, running ones are not counted
+	std::atomic<int> queuedJobs{ 0 };
+	std::mutex sleepMutex;
+	std::condition_variable wake;
+
+	Job* AllocateJob();
+	void Submit(Job* job);
+	Job* FindJob(unsigned int workerIndex);
+	void Execute(Job* job);
+	void WorkerLoop(unsigned int workerIndex);
+};
+
+// The engine's job system, initialized by the main thread at startup
+extern JobSystem g_jobSystem;
@@ -0,0 +1,69 @@
+#include "CommandList.h"
+#include "Shaders.h"
+#include "Materials.h"
+#include "..\Objects\Geometry\Mesh.h"
+
+#include <algorithm>
+
+namespace
+{
+	uint64_t Field(unsigned int value, unsigned int bits, unsigned int shift)
+	{
+		return (static_cast<uint64_t>(value) & ((1ull << bits) - 1)) << shift;
+	}
+
+	unsigned int QuantizeDepth(float depth, unsigned int bits)
+	{
+		depth = std::min(std::max(depth, 0.0f), 1.0f);
+		return static_cast<unsigned int>(depth * static_cast<float>((1u << bits) - 1));
+	}
+}
+
+uint64_t DrawKey::Opaque(RenderPass pass, unsigned int shader, unsigned int material, unsigned int vao, float depth)
+{
+	return Field(pass, 4, 60) | Field(0, 1, 59) | Field(shader, 10, 49) | Field(material, 16, 33) |
+		Field(vao, 12, 21) | Field(QuantizeDepth(depth, 21), 21, 0);
+}
+
+uint64_t DrawKey::Translucent(RenderPass pass, unsigned int shader, unsigned int material, unsigned int vao, float depth)
+{
+	// Invert depth so the farthest draw sorts first
+	unsigned int farToNear = (1u << 24) - 1 - QuantizeDepth(depth, 24);
+	return Field(pass, 4, 60) | Field(1, 1, 59) | Field(farToNear, 24, 35) | Field(shader, 10, 25) |
+		Field(material, 16, 9) | Field(vao, 9, 0);
+}
+
+void CommandList::SetView(glm::vec3 position, glm::vec3 forward, float nearPlane, float farPlane)
+{
+	viewPosition = position;
+	viewForward = forward;
+	this->nearPlane = nearPlane;
+	this->farPlane = farPlane;
+}
+
+void CommandList::Clear()
+{
+	packets.clear();
+	transforms.clear();
+	worldBounds.Clear();
+}
+
+void CommandList::AddMesh(const Shader & shader, const Mesh & mesh, const glm::mat4 & transform, bool translucent)
+{
+	glm::vec3 worldPosition = glm::vec3(transform[3]);
+	float viewDepth = glm::dot(worldPosition - viewPosition, viewForward);
+	float depth = (viewDepth - nearPlane) / (farPlane - nearPlane);
+
+	// The material library only grows on the main thread between frames
+	translucent = translucent || (g_materials.Get(mesh.GetMaterialID()).variant & Material::TRANSLUCENT) != 0;
+	DrawPacket packet;
+	packet.key = translucent
+		? DrawKey::Translucent(pass, shader.ProgramID, mesh.GetMaterialID(), mesh.GetVAO(), depth)
+		: DrawKey::Opaque(pass, shader.ProgramID, mesh.GetMaterialID(), mesh.GetVAO(), depth);
+	packet.shader = &shader;
+	packet.mesh = &mesh;
+	packet.transform = static_cast<unsigned int>(transforms.size());
+	transforms.push_back(transform);
+	packets.push_back(packet);
+	worldBounds.Add(mesh.GetBounds().Transform(transform));
+}
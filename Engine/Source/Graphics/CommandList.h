@@ -0,0 +1,71 @@
+#pragma once
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+#include "..\Objects\Camera\Frustum.h"
+
+class Shader;
+class Mesh;
+
+enum RenderPass
+{
+	PASS_SHADOW = 0,
+	PASS_DEPTH = 1,
+	PASS_OPAQUE = 2,
+	PASS_SKYBOX = 3,
+	PASS_TRANSPARENT = 4,
+	PASS_POST = 5
+};
+
+// 64 bit draw sort key, most significant field first:
+//   opaque:      pass(4) | 0 | shader(10) | material(16) | vao(12) | depth(21, front to back)
+//   translucent: pass(4) | 1 | depth(24, back to front) | shader(10) | material(16) | vao(9)
+// Opaque draws are grouped by state and only ordered by depth within equal state,
+// translucent draws must blend in order so depth comes first.
+namespace DrawKey
+{
+	uint64_t Opaque(RenderPass pass, unsigned int shader, unsigned int material, unsigned int vao, float depth);
+	uint64_t Translucent(RenderPass pass, unsigned int shader, unsigned int material, unsigned int vao, float depth);
+	inline bool IsTranslucent(uint64_t key) { return ((key >> 59) & 1) != 0; }
+}
+
+struct DrawPacket
+{
+	uint64_t key;
+	const Shader * shader;
+	const Mesh * mesh;
+	unsigned int transform;  // index into the bucket's transforms
+};
+
+// Draw packets recorded by one thread. Lists share nothing, so every worker
+// records into its own and the owning DrawBucket merges them before sorting.
+// Recording touches no GL state and may run off the context thread.
+class CommandList
+{
+public:
+	CommandList(RenderPass pass = PASS_OPAQUE) : pass(pass) {}
+
+	// Camera the packet depths are measured from
+	void SetView(glm::vec3 position, glm::vec3 forward, float nearPlane, float farPlane);
+	void Clear();
+
+	// Meshes whose material has Material::TRANSLUCENT always get a translucent key
+	void AddMesh(const Shader & shader, const Mesh & mesh, const glm::mat4 & transform, bool translucent = false);
+
+	unsigned int GetPacketCount() const { return static_cast<unsigned int>(packets.size()); }
+
+private:
+	friend class DrawBucket;
+
+	RenderPass pass;
+	glm::vec3 viewPosition = glm::vec3(0.0f);
+	glm::vec3 viewForward = glm::vec3(0.0f, 0.0f, -1.0f);
+	float nearPlane = 0.1f;
+	float farPlane = 100.0f;
+
+	std::vector<DrawPacket> packets;
+	std::vector<glm::mat4> transforms;
+	AABBArray worldBounds;
+};
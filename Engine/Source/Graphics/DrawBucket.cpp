@@ -0,0 +1,451 @@
+#include "DrawBucket.h"
+#include "Shaders.h"
+#include "UniformBlocks.h"
+#include "InstanceBuffer.h"
+#include "GLExtensions.h"
+#include "..\Objects\Geometry\Mesh.h"
+#include "..\Core\JobSystem.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <random>
+
+void DrawBucket::SetView(glm::vec3 position, glm::vec3 forward, float nearPlane, float farPlane)
+{
+	viewPosition = position;
+	viewForward = forward;
+	this->nearPlane = nearPlane;
+	this->farPlane = farPlane;
+	for (CommandList & list : lists)
+		list.SetView(position, forward, nearPlane, farPlane);
+}
+
+void DrawBucket::SetFrustum(const Frustum & frustum)
+{
+	this->frustum = frustum;
+	hasFrustum = true;
+}
+
+void DrawBucket::Clear()
+{
+	packets.clear();
+	transforms.clear();
+	worldBounds.Clear();
+	runs.clear();
+	translucentRun = 0;
+	for (CommandList & list : lists)
+		list.Clear();
+}
+
+void DrawBucket::AddMesh(const Shader & shader, const Mesh & mesh, const glm::mat4 & transform, bool translucent)
+{
+	lists[0].AddMesh(shader, mesh, transform, translucent);
+}
+
+void DrawBucket::SetCommandListCount(unsigned int count)
+{
+	lists.resize(std::max(count, 1u), CommandList(pass));
+	for (CommandList & list : lists)
+		list.SetView(viewPosition, viewForward, nearPlane, farPlane);
+}
+
+void DrawBucket::Merge()
+{
+	// Take over the first non empty list's storage and append the rest behind it
+	for (CommandList & list : lists)
+	{
+		if (packets.empty())
+		{
+			packets.swap(list.packets);
+			transforms.swap(list.transforms);
+			std::swap(worldBounds, list.worldBounds);
+		}
+		else
+		{
+			unsigned int transformBase = static_cast<unsigned int>(transforms.size());
+			for (DrawPacket packet : list.packets)
+			{
+				packet.transform += transformBase;
+				packets.push_back(packet);
+			}
+			transforms.insert(transforms.end(), list.transforms.begin(), list.transforms.end());
+			worldBounds.Append(list.worldBounds);
+		}
+		list.Clear();
+	}
+}
+
+void DrawBucket::Sort()
+{
+	Merge();
+	auto start = std::chrono::high_resolution_clock::now();
+
+	bool cull = CullingEnabled && hasFrustum;
+	VisibleCount = cull ? frustum.CullAABBs(worldBounds, visible) : GetPacketCount();
+	CulledCount = GetPacketCount() - VisibleCount;
+	auto culled = std::chrono::high_resolution_clock::now();
+	CullTimeUs = std::chrono::duration<double, std::micro>(culled - start).count();
+
+	entries.clear();
+	for (unsigned int i = 0; i < packets.size(); i++)
+	{
+		if ((cull && !visible[i]) || (SkipTranslucent && DrawKey::IsTranslucent(packets[i].key)))
+			continue;
+		SortEntry entry = { packets[i].key, i };
+		entries.push_back(entry);
+	}
+	RadixSort(entries, scratch);
+
+	SortTimeUs = std::chrono::duration<double, std::micro>(std::chrono::high_resolution_clock::now() - culled).count();
+}
+
+void DrawBucket::Submit(UniformRingBuffer & uniforms)
+{
+	Submit(uniforms, g_instanceBuffer, g_renderState);
+}
+
+void DrawBucket::Submit(UniformRingBuffer & uniforms, InstanceBuffer & instances, RenderState & state)
+{
+	DrawCalls = 0;
+	InstancedDrawCalls = 0;
+	MultiDrawCommands = 0;
+	// The pool's VAO and indirect stream belong to the main context
+	if (MultiDrawEnabled && g_geometryPool.IsEnabled() && &state == &g_renderState)
+	{
+		SubmitMultiDraw(uniforms, instances, state);
+		return;
+	}
+
+	// Gather the whole bucket's ObjectData and instance matrices first, each
+	// is written once and the draws below only bind ranges into them
+	runs.clear();
+	objectScratch.clear();
+	instanceScratch.clear();
+	unsigned int first = 0;
+	while (first < entries.size())
+	{
+		const DrawPacket & packet = packets[entries[first].index];
+
+		// Extend the run over following packets of the same mesh and shader
+		unsigned int last = first + 1;
+		if (InstancingEnabled)
+		{
+			while (last < entries.size() && packets[entries[last].index].mesh == packet.mesh &&
+				packets[entries[last].index].shader == packet.shader)
+				last++;
+		}
+
+		DrawRun run = { first, last, static_cast<unsigned int>(objectScratch.size()), static_cast<unsigned int>(instanceScratch.size()), 0, 0 };
+		if (last - first >= MIN_INSTANCES)
+		{
+			for (unsigned int i = first; i < last; i++)
+				instanceScratch.push_back(transforms[packets[entries[i].index].transform]);
+			// Instance matrices already hold the full model transform
+			objectScratch.push_back(ObjectBlock{ glm::mat4(1.0f), glm::uvec4(packet.mesh->GetMaterialID(), 0u, 0u, 0u) });
+		}
+		else
+		{
+			for (unsigned int i = first; i < last; i++)
+			{
+				const DrawPacket & single = packets[entries[i].index];
+				objectScratch.push_back(ObjectBlock{ transforms[single.transform], glm::uvec4(single.mesh->GetMaterialID(), 0u, 0u, 0u) });
+			}
+		}
+		runs.push_back(run);
+		first = last;
+	}
+	instanceOffset = 0;
+	if (!instanceScratch.empty())
+	{
+		instanceOffset = instances.Push(instanceScratch.data(), static_cast<unsigned int>(instanceScratch.size()));
+		instances.Flush();
+	}
+	instanceBufferID = instances.GetBufferID();
+	commandOffset = 0;
+	DrawOpaqueRuns(uniforms, state);
+}
+
+void DrawBucket::SubmitMultiDraw(UniformRingBuffer & uniforms, InstanceBuffer & instances, RenderState & state)
+{
+	g_geometryPool.Upload();
+
+	// Like Submit, every command, instance matrix and ObjectData of the bucket
+	// is written before the first draw. Runs with commands are drawn by
+	// DrawRuns with one glMultiDrawElementsIndirect.
+	runs.clear();
+	objectScratch.clear();
+	instanceScratch.clear();
+	commandScratch.clear();
+	unsigned int first = 0;
+	while (first < entries.size())
+	{
+		const DrawPacket & packet = packets[entries[first].index];
+		DrawRun run = { first, first + 1, static_cast<unsigned int>(objectScratch.size()), 0, static_cast<unsigned int>(commandScratch.size()), 0 };
+
+		if (!packet.mesh->IsPooled())
+		{
+			objectScratch.push_back(ObjectBlock{ transforms[packet.transform], glm::uvec4(packet.mesh->GetMaterialID(), 0u, 0u, 0u) });
+			runs.push_back(run);
+			first++;
+			continue;
+		}
+
+		// One command per mesh in the run of equal shader and material, sorting
+		// keeps packets of the same mesh adjacent within it
+		unsigned int last = first;
+		const Mesh * previous = nullptr;
+		while (last < entries.size())
+		{
+			const DrawPacket & next = packets[entries[last].index];
+			if (next.shader != packet.shader || !next.mesh->IsPooled() || next.mesh->GetMaterialID() != packet.mesh->GetMaterialID())
+				break;
+
+			if (next.mesh != previous)
+			{
+				const GeometryRange & range = next.mesh->GetPoolRange();
+				DrawElementsIndirectCommand command = { range.indexCount, 0, range.firstIndex, range.baseVertex,
+					static_cast<unsigned int>(instanceScratch.size()) };
+				commandScratch.push_back(command);
+				previous = next.mesh;
+			}
+			commandScratch.back().instanceCount++;
+			instanceScratch.push_back(transforms[next.transform]);
+			last++;
+		}
+
+		// Per draw matrices come from the instance attribute, ObjectData only selects the material
+		objectScratch.push_back(ObjectBlock{ glm::mat4(1.0f), glm::uvec4(packet.mesh->GetMaterialID(), 0u, 0u, 0u) });
+		run.last = last;
+		run.commandCount = static_cast<unsigned int>(commandScratch.size()) - run.command;
+		runs.push_back(run);
+		first = last;
+	}
+	instanceOffset = 0;
+	commandOffset = 0;
+	if (!commandScratch.empty())
+	{
+		unsigned int instanceBase = instances.Push(instanceScratch.data(), static_cast<unsigned int>(instanceScratch.size())) / sizeof(glm::mat4);
+		instances.Flush();
+		for (DrawElementsIndirectCommand & command : commandScratch)
+			command.baseInstance += instanceBase;
+		commandOffset = g_geometryPool.PushCommands(commandScratch.data(), static_cast<unsigned int>(commandScratch.size()));
+	}
+	instanceBufferID = instances.GetBufferID();
+	DrawOpaqueRuns(uniforms, state);
+}
+
+void DrawBucket::DrawOpaqueRuns(UniformRingBuffer & uniforms, RenderState & state)
+{
+	objects = uniforms.PushArray(objectScratch.data(), static_cast<unsigned int>(objectScratch.size()));
+
+	// Translucent keys sort after every opaque key of the pass
+	translucentRun = 0;
+	while (translucentRun < runs.size() && !DrawKey::IsTranslucent(packets[entries[runs[translucentRun].first].index].key))
+		translucentRun++;
+	DrawRuns(uniforms, state, 0, BlendTranslucent ? translucentRun : static_cast<unsigned int>(runs.size()));
+}
+
+void DrawBucket::SubmitTranslucent(UniformRingBuffer & uniforms)
+{
+	SubmitTranslucent(uniforms, g_renderState);
+}
+
+void DrawBucket::SubmitTranslucent(UniformRingBuffer & uniforms, RenderState & state)
+{
+	if (!BlendTranslucent || translucentRun >= runs.size())
+		return;
+
+	// Blended over what is already drawn without hiding each other. After a
+	// depth pre-pass the color pass tests GL_EQUAL, which these never pass.
+	state.SetBlend(true);
+	state.SetBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	state.SetDepthMask(false);
+	state.SetDepthFunc(GL_LEQUAL);
+	DrawRuns(uniforms, state, translucentRun, static_cast<unsigned int>(runs.size()));
+	state.SetBlend(false);
+	state.SetDepthMask(true);
+	state.SetDepthFunc(GL_LESS);
+}
+
+void DrawBucket::DrawRuns(UniformRingBuffer & uniforms, RenderState & state, unsigned int firstRun, unsigned int lastRun)
+{
+	for (unsigned int r = firstRun; r < lastRun; r++)
+	{
+		const DrawRun & run = runs[r];
+		const DrawPacket & packet = packets[entries[run.first].index];
+		packet.shader->Use(state);
+		unsigned int count = run.last - run.first;
+		if (run.commandCount > 0)
+		{
+			uniforms.Bind(OBJECT_BLOCK_BINDING, objects[run.object]);
+			g_geometryPool.BindVertexArray(instanceBufferID);
+			state.GL().MultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT,
+				(const void*)(uintptr_t)(commandOffset + run.command * sizeof(DrawElementsIndirectCommand)),
+				static_cast<GLsizei>(run.commandCount), 0);
+			MultiDrawCommands += run.commandCount;
+			DrawCalls++;
+		}
+		else if (count >= MIN_INSTANCES)
+		{
+			uniforms.Bind(OBJECT_BLOCK_BINDING, objects[run.object]);
+			packet.mesh->DrawInstanced(state, instanceBufferID, instanceOffset + run.instance * sizeof(glm::mat4), count);
+			InstancedDrawCalls++;
+			DrawCalls++;
+		}
+		else
+		{
+			for (unsigned int i = 0; i < count; i++)
+			{
+				uniforms.Bind(OBJECT_BLOCK_BINDING, objects[run.object + i]);
+				packets[entries[run.first + i].index].mesh->Draw(state);
+			}
+			DrawCalls += count;
+		}
+	}
+}
+
+void DrawBucket::RadixSort(std::vector<SortEntry> & entries, std::vector<SortEntry> & scratch)
+{
+	// LSD radix sort with 11 bit digits, six passes cover all 64 bits
+	const unsigned int DIGIT_BITS = 11;
+	const unsigned int BUCKETS = 1 << DIGIT_BITS;
+	const unsigned int PASSES = (64 + DIGIT_BITS - 1) / DIGIT_BITS;
+
+	unsigned int count = static_cast<unsigned int>(entries.size());
+	scratch.resize(count);
+	if (count < 2)
+		return;
+
+	// Histogram every digit in a single read of the keys
+	std::vector<unsigned int> histograms(PASSES * BUCKETS, 0u);
+	for (const SortEntry & entry : entries)
+	{
+		for (unsigned int pass = 0; pass < PASSES; pass++)
+			histograms[pass * BUCKETS + ((entry.key >> (pass * DIGIT_BITS)) & (BUCKETS - 1))]++;
+	}
+
+	std::vector<SortEntry> * source = &entries;
+	std::vector<SortEntry> * destination = &scratch;
+	for (unsigned int pass = 0; pass < PASSES; pass++)
+	{
+		unsigned int * histogram = &histograms[pass * BUCKETS];
+		unsigned int shift = pass * DIGIT_BITS;
+
+		// All keys share this digit, e.g. the pass field, nothing to reorder
+		if (histogram[((*source)[0].key >> shift) & (BUCKETS - 1)] == count)
+			continue;
+
+		unsigned int offset = 0;
+		for (unsigned int i = 0; i < BUCKETS; i++)
+		{
+			unsigned int bucketCount = histogram[i];
+			histogram[i] = offset;
+			offset += bucketCount;
+		}
+		for (const SortEntry & entry : *source)
+			(*destination)[histogram[(entry.key >> shift) & (BUCKETS - 1)]++] = entry;
+		std::swap(source, destination);
+	}
+	if (source != &entries)
+		entries.swap(scratch);
+}
+
+double DrawBucket::BenchmarkSort(unsigned int count)
+{
+	std::mt19937 random(1234);
+	std::uniform_int_distribution<unsigned int> shaders(0, 7);
+	std::uniform_int_distribution<unsigned int> materials(0, 255);
+	std::uniform_int_distribution<unsigned int> vaos(0, 1023);
+	std::uniform_real_distribution<float> depths(0.0f, 1.0f);
+
+	std::vector<SortEntry> entries(count);
+	std::vector<SortEntry> scratch;
+	for (unsigned int i = 0; i < count; i++)
+	{
+		entries[i].key = (i % 8 == 0)
+			? DrawKey::Translucent(PASS_OPAQUE, shaders(random), materials(random), vaos(random), depths(random))
+			: DrawKey::Opaque(PASS_OPAQUE, shaders(random), materials(random), vaos(random), depths(random));
+		entries[i].index = i;
+	}
+
+	auto start = std::chrono::high_resolution_clock::now();
+	RadixSort(entries, scratch);
+	double elapsed = std::chrono::duration<double, std::micro>(std::chrono::high_resolution_clock::now() - start).count();
+
+	if (!std::is_sorted(entries.begin(), entries.end(), [](const SortEntry & a, const SortEntry & b) { return a.key < b.key; }))
+		std::cout << "Error::DrawBucket::Radix sort produced unordered keys\n";
+	return elapsed;
+}
+
+std::vector<DrawBucket::RecordBenchmarkResult> DrawBucket::BenchmarkRecording(const Shader & shader, const std::vector<Mesh> & meshes, unsigned int drawCount)
+{
+	std::vector<RecordBenchmarkResult> results;
+	if (meshes.empty())
+		return results;
+
+	std::mt19937 random(1234);
+	std::uniform_real_distribution<float> positions(-50.0f, 50.0f);
+	std::vector<glm::mat4> transforms(drawCount);
+	for (glm::mat4 & transform : transforms)
+		transform[3] = glm::vec4(positions(random), positions(random), positions(random), 1.0f);
+
+	// The real Submit, with its state, uniform and instance uploads going to the null table
+	RenderState nullState;
+	nullState.Init(GLFunctionTable::Null());
+	UniformRingBuffer nullUniforms;
+	nullUniforms.Init(drawCount * 256, nullState);
+	InstanceBuffer nullInstances;
+	nullInstances.Init(drawCount, nullState);
+
+	unsigned int cores = std::max(1u, g_jobSystem.GetWorkerCount());
+	for (unsigned int threads = 1; ; threads = std::min(threads * 2, cores))
+	{
+		DrawBucket bucket(PASS_OPAQUE);
+		bucket.CullingEnabled = false;
+		bucket.MultiDrawEnabled = false;
+		bucket.SetView(glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, -1.0f), 0.1f, 100.0f);
+		bucket.SetCommandListCount(threads);
+
+		auto start = std::chrono::high_resolution_clock::now();
+		g_jobSystem.ParallelFor(threads, 1, [&](unsigned int first, unsigned int last)
+		{
+			for (unsigned int t = first; t < last; t++)
+			{
+				CommandList & list = bucket.GetCommandList(t);
+				unsigned int begin = drawCount * t / threads;
+				unsigned int end = drawCount * (t + 1) / threads;
+				for (unsigned int i = begin; i < end; i++)
+					list.AddMesh(shader, meshes[i % meshes.size()], transforms[i]);
+			}
+		});
+		auto recorded = std::chrono::high_resolution_clock::now();
+
+		bucket.Sort();
+		auto sorted = std::chrono::high_resolution_clock::now();
+
+		nullState.Invalidate();
+		nullState.ResetFrameStats();
+		nullUniforms.BeginFrame();
+		nullInstances.BeginFrame();
+		bucket.Submit(nullUniforms, nullInstances, nullState);
+		auto submitted = std::chrono::high_resolution_clock::now();
+
+		RecordBenchmarkResult result;
+		result.threads = threads;
+		result.recordMs = std::chrono::duration<double, std::milli>(recorded - start).count();
+		result.sortMs = std::chrono::duration<double, std::milli>(sorted - recorded).count();
+		result.submitMs = std::chrono::duration<double, std::milli>(submitted - sorted).count();
+		result.stateChanges = nullState.FrameStats.issued;
+		result.drawCalls = bucket.DrawCalls;
+		results.push_back(result);
+
+		if (bucket.GetPacketCount() != drawCount)
+			std::cout << "Error::DrawBucket::Merged " << bucket.GetPacketCount() << " of " << drawCount << " recorded packets\n";
+		if (threads == cores)
+			break;
+	}
+	nullUniforms.Destroy();
+	nullInstances.Destroy();
+	return results;
+}
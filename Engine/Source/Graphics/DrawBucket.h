@@ -0,0 +1,145 @@
+#pragma once
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+#include "CommandList.h"
+#include "UniformBuffer.h"
+#include "UniformBlocks.h"
+#include "GeometryPool.h"
+#include "RenderState.h"
+
+class InstanceBuffer;
+
+// Draw packets for one pass. Passes append packets in any order, the bucket
+// radix sorts them by key and then submits them. Sorting leaves packets of the
+// same mesh and shader adjacent, such runs are drawn as one instanced draw.
+// Packets are recorded into command lists, one per recording thread, which
+// Sort merges. Only Submit issues GL calls, it writes the ObjectData of
+// every draw as one array before drawing.
+class DrawBucket
+{
+public:
+	DrawBucket(RenderPass pass = PASS_OPAQUE) : pass(pass), lists(1, CommandList(pass)) {}
+
+	// Camera the packet depths are measured from
+	void SetView(glm::vec3 position, glm::vec3 forward, float nearPlane, float farPlane);
+	// Packets whose world bounds miss the frustum are dropped by Sort
+	void SetFrustum(const Frustum & frustum);
+	void Clear();
+
+	// Records into the first command list
+	void AddMesh(const Shader & shader, const Mesh & mesh, const glm::mat4 & transform, bool translucent = false);
+	// Lists are cleared with the bucket and keep the bucket's view
+	void SetCommandListCount(unsigned int count);
+	unsigned int GetCommandListCount() const { return static_cast<unsigned int>(lists.size()); }
+	CommandList & GetCommandList(unsigned int index) { return lists[index]; }
+
+	void Sort();
+	// Draws through g_renderState with instances in g_instanceBuffer
+	void Submit(UniformRingBuffer & uniforms);
+	// Multi-draw is only used with g_renderState, the geometry pool belongs to it
+	void Submit(UniformRingBuffer & uniforms, InstanceBuffer & instances, RenderState & state);
+	// With BlendTranslucent, Submit stops at the translucent packets and this
+	// draws them back to front with alpha blending and no depth writes, after
+	// anything else the pass draws behind them. Leaves blending off, depth
+	// writes on and GL_LESS.
+	void SubmitTranslucent(UniformRingBuffer & uniforms);
+	void SubmitTranslucent(UniformRingBuffer & uniforms, RenderState & state);
+
+	unsigned int GetPacketCount() const { return static_cast<unsigned int>(packets.size()); }
+	double SortTimeUs = 0.0;
+	unsigned int DrawCalls = 0;
+	unsigned int InstancedDrawCalls = 0;
+
+	// Runs shorter than this are drawn one by one with their own ObjectData
+	static const unsigned int MIN_INSTANCES = 2;
+	bool InstancingEnabled = true;
+	// Draws each material's pooled meshes with one glMultiDrawElementsIndirect,
+	// ignored unless GL 4.3 is available
+	bool MultiDrawEnabled = true;
+	unsigned int MultiDrawCommands = 0;
+	// Translucent packets are drawn like opaque ones unless one of these is set.
+	// Passes writing final color blend them, depth only passes drop them so
+	// they hide nothing.
+	bool BlendTranslucent = false;
+	bool SkipTranslucent = false;
+
+	bool CullingEnabled = true;
+	unsigned int VisibleCount = 0;
+	unsigned int CulledCount = 0;
+	double CullTimeUs = 0.0;
+
+	// Sorts count random keys through the same radix sort, returns microseconds
+	static double BenchmarkSort(unsigned int count);
+
+	struct RecordBenchmarkResult
+	{
+		unsigned int threads;
+		double recordMs;  // parallel recording into one list per thread
+		double sortMs;    // merge, cull and sort
+		double submitMs;  // Submit against a null GL backend
+		unsigned int stateChanges;
+		unsigned int drawCalls;
+	};
+	// Records drawCount packets of the given meshes into 1, 2, 4... lists, one
+	// job each, up to the job system's worker count. Submit then runs with a
+	// RenderState holding GLFunctionTable::Null() and streaming buffers that
+	// upload through it, so only CPU cost is measured.
+	static std::vector<RecordBenchmarkResult> BenchmarkRecording(const Shader & shader, const std::vector<Mesh> & meshes, unsigned int drawCount);
+
+private:
+	RenderPass pass;
+	glm::vec3 viewPosition = glm::vec3(0.0f);
+	glm::vec3 viewForward = glm::vec3(0.0f, 0.0f, -1.0f);
+	float nearPlane = 0.1f;
+	float farPlane = 100.0f;
+
+	std::vector<CommandList> lists;
+	// Merged from the command lists by Sort
+	std::vector<DrawPacket> packets;
+	Frustum frustum;
+	bool hasFrustum = false;
+	AABBArray worldBounds;
+	std::vector<unsigned char> visible;
+	std::vector<glm::mat4> transforms;
+	std::vector<glm::mat4> instanceScratch;
+	std::vector<DrawElementsIndirectCommand> commandScratch;
+	std::vector<ObjectBlock> objectScratch;
+
+	// Sorted entries [first, last) drawn together, with the index of their first
+	// ObjectBlock, instance matrix and indirect command in the scratch arrays
+	struct DrawRun
+	{
+		unsigned int first;
+		unsigned int last;
+		unsigned int object;
+		unsigned int instance;
+		unsigned int command;
+		unsigned int commandCount;
+	};
+	std::vector<DrawRun> runs;
+	// Where Submit wrote the runs' data, kept for SubmitTranslucent
+	UniformArrayAllocation objects;
+	unsigned int instanceBufferID = 0;
+	unsigned int instanceOffset = 0;
+	unsigned int commandOffset = 0;
+	unsigned int translucentRun = 0;
+
+	// Key plus packet index, sorted instead of the larger packets
+	struct SortEntry
+	{
+		uint64_t key;
+		unsigned int index;
+	};
+	std::vector<SortEntry> entries;
+	std::vector<SortEntry> scratch;
+
+	void Merge();
+	void SubmitMultiDraw(UniformRingBuffer & uniforms, InstanceBuffer & instances, RenderState & state);
+	// Pushes the ObjectData and draws every run before the translucent ones
+	void DrawOpaqueRuns(UniformRingBuffer & uniforms, RenderState & state);
+	void DrawRuns(UniformRingBuffer & uniforms, RenderState & state, unsigned int firstRun, unsigned int lastRun);
+	static void RadixSort(std::vector<SortEntry> & entries, std::vector<SortEntry> & scratch);
+};
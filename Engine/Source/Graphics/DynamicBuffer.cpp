@@ -0,0 +1,164 @@
+#include "DynamicBuffer.h"
+#include "GLExtensions.h"
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+void DynamicBuffer::Init(GLenum bufferTarget, unsigned int bytesPerFrame, unsigned int offsetAlignment, RenderState & submitState)
+{
+	state = &submitState;
+	target = bufferTarget;
+	alignment = offsetAlignment > 0 ? offsetAlignment : 1;
+	regionSize = (bytesPerFrame + alignment - 1) / alignment * alignment;
+	Allocate();
+}
+
+void DynamicBuffer::Allocate()
+{
+	glGenBuffers(1, &bufferID);
+	glBindBuffer(target, bufferID);
+	persistent = GLExtensions::BufferStorage;
+	staging.clear();
+	if (persistent)
+	{
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		GLExtensions::glBufferStorage(target, regionSize * FRAMES_IN_FLIGHT, NULL, flags);
+		mappedData = (unsigned char *)glMapBufferRange(target, 0, regionSize * FRAMES_IN_FLIGHT, flags);
+		if (!mappedData)
+		{
+			std::cout << "Error::DynamicBuffer::Failed to persistently map buffer, falling back to unsynchronized maps\n";
+			persistent = false;
+		}
+	}
+	else
+	{
+		glBufferData(target, regionSize * FRAMES_IN_FLIGHT, NULL, GL_STREAM_DRAW);
+	}
+	glBindBuffer(target, 0);
+	if (!persistent)
+		staging.resize(regionSize);
+}
+
+void DynamicBuffer::Destroy()
+{
+	for (unsigned int i = 0; i < FRAMES_IN_FLIGHT; i++)
+	{
+		if (fences[i])
+			glDeleteSync(fences[i]);
+		fences[i] = 0;
+	}
+	for (const RetiredBuffer & old : retired)
+		DeleteBuffer(old.bufferID, old.mapped);
+	retired.clear();
+	DeleteBuffer(bufferID, mappedData != nullptr);
+	mappedData = nullptr;
+	bufferID = 0;
+}
+
+void DynamicBuffer::DeleteBuffer(unsigned int buffer, bool mapped)
+{
+	if (mapped)
+	{
+		glBindBuffer(target, buffer);
+		glUnmapBuffer(target);
+		glBindBuffer(target, 0);
+	}
+	glDeleteBuffers(1, &buffer);
+}
+
+void DynamicBuffer::Grow(unsigned int minimumRegionSize)
+{
+	// Draws issued this frame may still read the old buffer, and its other
+	// regions belong to frames in flight. It goes once all of them are fenced.
+	Flush();
+	RetiredBuffer old = { bufferID, mappedData != nullptr, FRAMES_IN_FLIGHT };
+	retired.push_back(old);
+
+	unsigned int size = regionSize * 2;
+	if (size < minimumRegionSize)
+		size = minimumRegionSize;
+	std::cout << "DynamicBuffer::Frame region of " << regionSize << " bytes exhausted, growing to " << size << "\n";
+	regionSize = size;
+	mappedData = nullptr;
+	Allocate();
+	head = 0;
+	flushed = 0;
+}
+
+void DynamicBuffer::BeginFrame()
+{
+	frameIndex = (frameIndex + 1) % FRAMES_IN_FLIGHT;
+	head = 0;
+	flushed = 0;
+
+	// Wait until the GPU is done with the frame that last used this region
+	FenceWaitMs = 0.0;
+	GLsync & fence = fences[frameIndex];
+	if (fence)
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+		GLenum result = glClientWaitSync(fence, 0, 0);
+		while (result == GL_TIMEOUT_EXPIRED)
+			result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+		FenceWaitMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+		glDeleteSync(fence);
+		fence = 0;
+	}
+
+	// The wait above covers the frame each retired buffer was last used in
+	// once it has come around to that frame's region again
+	for (unsigned int i = 0; i < retired.size();)
+	{
+		if (--retired[i].framesLeft > 0)
+		{
+			i++;
+			continue;
+		}
+		DeleteBuffer(retired[i].bufferID, retired[i].mapped);
+		retired[i] = retired.back();
+		retired.pop_back();
+	}
+}
+
+void DynamicBuffer::EndFrame()
+{
+	fences[frameIndex] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	BytesUsed = head;
+}
+
+unsigned int DynamicBuffer::Write(const void * data, unsigned int size)
+{
+	unsigned int alignedSize = (size + alignment - 1) / alignment * alignment;
+	// Never wraps, the start of the region may still be used by this frame's draws
+	if (head + alignedSize > regionSize)
+		Grow(alignedSize);
+
+	unsigned int offset = frameIndex * regionSize + head;
+	if (persistent)
+		std::memcpy(mappedData + offset, data, size);
+	else
+		std::memcpy(staging.data() + head, data, size);
+	head += alignedSize;
+	return offset;
+}
+
+void DynamicBuffer::Flush()
+{
+	if (persistent || head <= flushed)
+		return;
+
+	// The fence guarantees this range is idle, so skip the driver's own synchronization
+	const GLFunctionTable & gl = state->GL();
+	unsigned int size = head - flushed;
+	gl.BindBuffer(target, bufferID);
+	void * dest = gl.MapBufferRange(target, frameIndex * regionSize + flushed, size,
+		GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+	if (dest)
+	{
+		std::memcpy(dest, staging.data() + flushed, size);
+		gl.UnmapBuffer(target);
+	}
+	gl.BindBuffer(target, 0);
+	flushed = head;
+}
@@ -0,0 +1,82 @@
+#pragma once
+#include <glad/glad.h>
+
+#include <vector>
+
+#include "RenderState.h"
+
+// CPU written buffer streamed every frame. Storage is split into a region
+// per frame in flight; each region is fenced when its frame ends and waited
+// on before it is written again, so writes never touch memory the GPU still
+// reads and the driver never has to stall or rename the buffer.
+// The buffer is persistently mapped when GL 4.4 is available. Otherwise
+// writes are staged in CPU memory and Flush uploads everything written since
+// the last flush with one unsynchronized map, so a pass costs one map rather
+// than one per write.
+//
+// A frame that writes more than its region moves to a new buffer with larger
+// regions. Ranges written earlier in the frame stay where they are, the old
+// buffer is deleted once the frames that used it are done, so callers must
+// take GetBufferID right after each Write.
+// Flush uploads through the RenderState given to Init, creation, deletion
+// and fences always use the context directly.
+class DynamicBuffer
+{
+public:
+	static const unsigned int FRAMES_IN_FLIGHT = 3;
+
+	DynamicBuffer() {}
+	// Offsets returned by Write are multiples of alignment
+	void Init(GLenum target, unsigned int bytesPerFrame, unsigned int alignment, RenderState & state = g_renderState);
+	void Destroy();
+
+	void BeginFrame();
+	void EndFrame();
+
+	// Copies data into this frame's region and returns its byte offset from
+	// the start of the buffer GetBufferID returns afterwards. Leaves the
+	// target unbound.
+	unsigned int Write(const void * data, unsigned int size);
+	// Makes every Write so far visible to the GPU, call before the draws that
+	// read them. Nothing to do when persistently mapped.
+	void Flush();
+	bool HasPendingWrites() const { return head > flushed; }
+
+	unsigned int GetBufferID() const { return bufferID; }
+	unsigned int GetAlignment() const { return alignment; }
+	bool IsPersistent() const { return persistent; }
+
+	// Statistics for the last completed frame
+	unsigned int BytesUsed = 0;
+	double FenceWaitMs = 0.0;
+
+private:
+	// A buffer left behind by a grow, deleted after framesLeft more BeginFrames
+	struct RetiredBuffer
+	{
+		unsigned int bufferID;
+		bool mapped;
+		unsigned int framesLeft;
+	};
+	std::vector<RetiredBuffer> retired;
+
+	RenderState * state = &g_renderState;
+	GLenum target = GL_ARRAY_BUFFER;
+	unsigned int bufferID = 0;
+	unsigned int regionSize = 0;
+	unsigned int alignment = 1;
+	unsigned int frameIndex = 0;
+	unsigned int head = 0;
+	// Start of the writes in this frame's region not uploaded yet
+	unsigned int flushed = 0;
+	bool persistent = false;
+	unsigned char * mappedData = nullptr;
+	// Mirror of the current frame's region when not persistently mapped
+	std::vector<unsigned char> staging;
+	GLsync fences[FRAMES_IN_FLIGHT] = {};
+
+	// Creates and maps a buffer with regions of regionSize bytes
+	void Allocate();
+	void DeleteBuffer(unsigned int buffer, bool mapped);
+	void Grow(unsigned int minimumRegionSize);
+};
@@ -0,0 +1,61 @@
+#include "GLExtensions.h"
+
+#include <cstring>
+#include <iostream>
+
+int GLExtensions::MajorVersion = 3;
+int GLExtensions::MinorVersion = 3;
+
+bool GLExtensions::BufferStorage = false;
+PFNGLBUFFERSTORAGEPROC GLExtensions::glBufferStorage = nullptr;
+bool GLExtensions::MultiDrawIndirect = false;
+PFNGLMULTIDRAWELEMENTSINDIRECTPROC GLExtensions::glMultiDrawElementsIndirect = nullptr;
+bool GLExtensions::BindlessTexture = false;
+PFNGLGETTEXTUREHANDLEARBPROC GLExtensions::glGetTextureHandleARB = nullptr;
+PFNGLMAKETEXTUREHANDLERESIDENTARBPROC GLExtensions::glMakeTextureHandleResidentARB = nullptr;
+PFNGLMAKETEXTUREHANDLENONRESIDENTARBPROC GLExtensions::glMakeTextureHandleNonResidentARB = nullptr;
+
+void GLExtensions::Load(GLADloadproc loader)
+{
+	glGetIntegerv(GL_MAJOR_VERSION, &MajorVersion);
+	glGetIntegerv(GL_MINOR_VERSION, &MinorVersion);
+
+	if (IsVersionAtLeast(4, 4) || HasExtension("GL_ARB_buffer_storage"))
+		glBufferStorage = (PFNGLBUFFERSTORAGEPROC)loader("glBufferStorage");
+	BufferStorage = glBufferStorage != nullptr;
+
+	if (IsVersionAtLeast(4, 3))
+		glMultiDrawElementsIndirect = (PFNGLMULTIDRAWELEMENTSINDIRECTPROC)loader("glMultiDrawElementsIndirect");
+	MultiDrawIndirect = glMultiDrawElementsIndirect != nullptr;
+
+	if (HasExtension("GL_ARB_bindless_texture"))
+	{
+		glGetTextureHandleARB = (PFNGLGETTEXTUREHANDLEARBPROC)loader("glGetTextureHandleARB");
+		glMakeTextureHandleResidentARB = (PFNGLMAKETEXTUREHANDLERESIDENTARBPROC)loader("glMakeTextureHandleResidentARB");
+		glMakeTextureHandleNonResidentARB = (PFNGLMAKETEXTUREHANDLENONRESIDENTARBPROC)loader("glMakeTextureHandleNonResidentARB");
+	}
+	BindlessTexture = glGetTextureHandleARB && glMakeTextureHandleResidentARB && glMakeTextureHandleNonResidentARB;
+
+	std::cout << "OpenGL " << MajorVersion << "." << MinorVersion << " context"
+		<< (BufferStorage ? ", persistent mapping enabled" : "")
+		<< (MultiDrawIndirect ? ", multi draw indirect enabled" : "")
+		<< (BindlessTexture ? ", bindless textures enabled" : "") << "\n";
+}
+
+bool GLExtensions::HasExtension(const char * name)
+{
+	int count = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+	for (int i = 0; i < count; i++)
+	{
+		const char * extension = (const char *)glGetStringi(GL_EXTENSIONS, i);
+		if (extension && std::strcmp(extension, name) == 0)
+			return true;
+	}
+	return false;
+}
+
+bool GLExtensions::IsVersionAtLeast(int major, int minor)
+{
+	return MajorVersion > major || (MajorVersion == major && MinorVersion >= minor);
+}
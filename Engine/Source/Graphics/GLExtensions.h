@@ -0,0 +1,43 @@
+#pragma once
+#include <glad/glad.h>
+
+// Our glad loader is generated for core 3.3 only. Entry points from newer
+// versions are loaded here at runtime and are only valid when the matching
+// flag is set.
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#define GL_MAP_COHERENT_BIT 0x0080
+#define GL_DYNAMIC_STORAGE_BIT 0x0100
+#define GL_CLIENT_STORAGE_BIT 0x0200
+#define GL_DRAW_INDIRECT_BUFFER 0x8F3F
+
+typedef void (APIENTRYP PFNGLBUFFERSTORAGEPROC)(GLenum target, GLsizeiptr size, const void * data, GLbitfield flags);
+typedef void (APIENTRYP PFNGLMULTIDRAWELEMENTSINDIRECTPROC)(GLenum mode, GLenum type, const void * indirect, GLsizei drawcount, GLsizei stride);
+typedef GLuint64 (APIENTRYP PFNGLGETTEXTUREHANDLEARBPROC)(GLuint texture);
+typedef void (APIENTRYP PFNGLMAKETEXTUREHANDLERESIDENTARBPROC)(GLuint64 handle);
+typedef void (APIENTRYP PFNGLMAKETEXTUREHANDLENONRESIDENTARBPROC)(GLuint64 handle);
+
+class GLExtensions
+{
+public:
+	static int MajorVersion;
+	static int MinorVersion;
+
+	// GL 4.4 / ARB_buffer_storage
+	static bool BufferStorage;
+	static PFNGLBUFFERSTORAGEPROC glBufferStorage;
+
+	// GL 4.3 / ARB_multi_draw_indirect, base instance in the commands needs 4.2
+	static bool MultiDrawIndirect;
+	static PFNGLMULTIDRAWELEMENTSINDIRECTPROC glMultiDrawElementsIndirect;
+
+	// ARB_bindless_texture, not part of any core version
+	static bool BindlessTexture;
+	static PFNGLGETTEXTUREHANDLEARBPROC glGetTextureHandleARB;
+	static PFNGLMAKETEXTUREHANDLERESIDENTARBPROC glMakeTextureHandleResidentARB;
+	static PFNGLMAKETEXTUREHANDLENONRESIDENTARBPROC glMakeTextureHandleNonResidentARB;
+
+	// Must be called after gladLoadGLLoader with a current context
+	static void Load(GLADloadproc loader);
+	static bool HasExtension(const char * name);
+	static bool IsVersionAtLeast(int major, int minor);
+};
@@ -0,0 +1,123 @@
+#include "GeometryPool.h"
+#include "GLExtensions.h"
+#include "RenderState.h"
+
+#include <cstddef>
+#include <cstring>
+
+GeometryPool g_geometryPool;
+
+void GeometryPool::Init(unsigned int instanceBuffer)
+{
+	glGenVertexArrays(1, &VAO);
+	glGenBuffers(1, &VBO);
+	glGenBuffers(1, &EBO);
+
+	g_renderState.BindVertexArray(VAO);
+	glBindBuffer(GL_ARRAY_BUFFER, VBO);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+
+	// Same layout as Mesh::SetupMesh
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
+	glEnableVertexAttribArray(2);
+	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
+	glEnableVertexAttribArray(3);
+	glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
+
+	instanceBufferID = instanceBuffer;
+	SetupInstanceAttributes();
+
+	indirectBuffer.Init(GL_DRAW_INDIRECT_BUFFER, indirectCapacity * sizeof(DrawElementsIndirectCommand), sizeof(unsigned int));
+}
+
+void GeometryPool::SetupInstanceAttributes()
+{
+	// Instance matrices from the start of the instance buffer, offset by baseInstance
+	glBindBuffer(GL_ARRAY_BUFFER, instanceBufferID);
+	for (unsigned int column = 0; column < 4; column++)
+	{
+		glEnableVertexAttribArray(4 + column);
+		glVertexAttribPointer(4 + column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(column * sizeof(glm::vec4)));
+		glVertexAttribDivisor(4 + column, 1);
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void GeometryPool::Destroy()
+{
+	if (!IsEnabled())
+		return;
+
+	g_renderState.OnVertexArrayDeleted(VAO);
+	glDeleteVertexArrays(1, &VAO);
+	glDeleteBuffers(1, &VBO);
+	glDeleteBuffers(1, &EBO);
+	indirectBuffer.Destroy();
+	VAO = 0;
+}
+
+GeometryRange GeometryPool::Add(const std::vector<Vertex> & meshVertices, const std::vector<unsigned int> & meshIndices)
+{
+	GeometryRange range;
+	range.indexCount = static_cast<unsigned int>(meshIndices.size());
+	range.firstIndex = static_cast<unsigned int>(indices.size());
+	range.baseVertex = static_cast<int>(vertices.size());
+
+	vertices.insert(vertices.end(), meshVertices.begin(), meshVertices.end());
+	indices.insert(indices.end(), meshIndices.begin(), meshIndices.end());
+	dirty = true;
+	return range;
+}
+
+void GeometryPool::Upload()
+{
+	if (!dirty || vertices.empty())
+		return;
+
+	// The element buffer binding is VAO state
+	g_renderState.BindVertexArray(VAO);
+	glBindBuffer(GL_ARRAY_BUFFER, VBO);
+	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	dirty = false;
+}
+
+void GeometryPool::BindVertexArray(unsigned int instanceBuffer)
+{
+	g_renderState.BindVertexArray(VAO);
+	if (instanceBuffer != instanceBufferID)
+	{
+		instanceBufferID = instanceBuffer;
+		SetupInstanceAttributes();
+	}
+}
+
+void GeometryPool::BeginFrame()
+{
+	if (!IsEnabled())
+		return;
+
+	indirectBuffer.BeginFrame();
+	FenceWaitMs = indirectBuffer.FenceWaitMs;
+	CommandsPushed = 0;
+}
+
+void GeometryPool::EndFrame()
+{
+	if (IsEnabled())
+		indirectBuffer.EndFrame();
+}
+
+unsigned int GeometryPool::PushCommands(const DrawElementsIndirectCommand * commands, unsigned int count)
+{
+	unsigned int offset = indirectBuffer.Write(commands, count * sizeof(DrawElementsIndirectCommand));
+	indirectBuffer.Flush();
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer.GetBufferID());
+	CommandsPushed += count;
+	return offset;
+}
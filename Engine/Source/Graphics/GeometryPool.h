@@ -0,0 +1,71 @@
+#pragma once
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <vector>
+
+#include "DynamicBuffer.h"
+#include "Vertex.h"
+
+// Location of a mesh inside the shared geometry buffers
+struct GeometryRange
+{
+	unsigned int indexCount = 0;
+	unsigned int firstIndex = 0;
+	int baseVertex = 0;
+};
+
+// Layout consumed by glMultiDrawElementsIndirect
+struct DrawElementsIndirectCommand
+{
+	unsigned int count;
+	unsigned int instanceCount;
+	unsigned int firstIndex;
+	int baseVertex;
+	unsigned int baseInstance;
+};
+
+// Every static mesh appended into one vertex and one index buffer behind a
+// single VAO, so a whole material's meshes can be drawn by one
+// glMultiDrawElementsIndirect call. The VAO also sources the instance matrix
+// from the instance buffer, each command's baseInstance selects its matrices.
+// Only created when GLExtensions::MultiDrawIndirect is set.
+class GeometryPool
+{
+public:
+	GeometryPool() {}
+	void Init(unsigned int instanceBuffer);
+	void Destroy();
+	bool IsEnabled() const { return VAO != 0; }
+
+	GeometryRange Add(const std::vector<Vertex> & vertices, const std::vector<unsigned int> & indices);
+	// Re-uploads the buffers if meshes were added since the last draw
+	void Upload();
+	// Binds the VAO with its instance matrices sourced from instanceBuffer,
+	// which moves when the instance stream grows
+	void BindVertexArray(unsigned int instanceBuffer);
+
+	void BeginFrame();
+	void EndFrame();
+	// Streams commands for this frame, returns their byte offset in the indirect
+	// buffer and leaves it bound for the draw
+	unsigned int PushCommands(const DrawElementsIndirectCommand * commands, unsigned int count);
+	unsigned int CommandsPushed = 0;
+	double FenceWaitMs = 0.0;
+
+private:
+	unsigned int VAO = 0, VBO = 0, EBO = 0;
+	unsigned int instanceBufferID = 0;
+	DynamicBuffer indirectBuffer;
+	// Commands per frame the indirect buffer starts with, it grows as needed
+	unsigned int indirectCapacity = 4096;
+
+	// Points the instance matrix attributes at instanceBufferID, VAO bound
+	void SetupInstanceAttributes();
+
+	std::vector<Vertex> vertices;
+	std::vector<unsigned int> indices;
+	bool dirty = false;
+};
+
+extern GeometryPool g_geometryPool;
@@ -0,0 +1,98 @@
+#include "GpuProfiler.h"
+
+GpuProfiler g_gpuProfiler;
+
+void GpuProfiler::Destroy()
+{
+	for (Scope& scope : scopes)
+	{
+		glDeleteQueries(LATENCY, scope.timeQueries);
+		glDeleteQueries(LATENCY, scope.sampleQueries);
+	}
+	scopes.clear();
+}
+
+void GpuProfiler::BeginFrame()
+{
+	frame++;
+	unsigned int slot = frame % LATENCY;
+	for (Scope& scope : scopes)
+	{
+		// A result still not available is dropped, the query is simply reissued
+		GLuint available = 0;
+		if (scope.timePending[slot])
+		{
+			glGetQueryObjectuiv(scope.timeQueries[slot], GL_QUERY_RESULT_AVAILABLE, &available);
+			if (available)
+			{
+				GLuint64 nanoseconds = 0;
+				glGetQueryObjectui64v(scope.timeQueries[slot], GL_QUERY_RESULT, &nanoseconds);
+				scope.gpuMs = nanoseconds / 1000000.0;
+			}
+			scope.timePending[slot] = false;
+		}
+		if (scope.samplesPending[slot])
+		{
+			glGetQueryObjectuiv(scope.sampleQueries[slot], GL_QUERY_RESULT_AVAILABLE, &available);
+			if (available)
+				glGetQueryObjectui64v(scope.sampleQueries[slot], GL_QUERY_RESULT, &scope.samples);
+			scope.samplesPending[slot] = false;
+		}
+	}
+}
+
+GpuProfiler::Scope& GpuProfiler::FindOrAdd(const char* name)
+{
+	for (Scope& scope : scopes)
+	{
+		if (scope.name == name)
+			return scope;
+	}
+
+	Scope scope;
+	scope.name = name;
+	glGenQueries(LATENCY, scope.timeQueries);
+	glGenQueries(LATENCY, scope.sampleQueries);
+	scopes.push_back(scope);
+	return scopes.back();
+}
+
+const GpuProfiler::Scope* GpuProfiler::Find(const char* name) const
+{
+	for (const Scope& scope : scopes)
+	{
+		if (scope.name == name)
+			return &scope;
+	}
+	return nullptr;
+}
+
+void GpuProfiler::BeginTimer(const char* name)
+{
+	Scope& scope = FindOrAdd(name);
+	unsigned int slot = frame % LATENCY;
+	scope.hasTime = true;
+	scope.lastFrame = frame;
+	scope.timePending[slot] = true;
+	glBeginQuery(GL_TIME_ELAPSED, scope.timeQueries[slot]);
+}
+
+void GpuProfiler::EndTimer()
+{
+	glEndQuery(GL_TIME_ELAPSED);
+}
+
+void GpuProfiler::BeginSamples(const char* name)
+{
+	Scope& scope = FindOrAdd(name);
+	unsigned int slot = frame % LATENCY;
+	scope.hasSamples = true;
+	scope.lastFrame = frame;
+	scope.samplesPending[slot] = true;
+	glBeginQuery(GL_SAMPLES_PASSED, scope.sampleQueries[slot]);
+}
+
+void GpuProfiler::EndSamples()
+{
+	glEndQuery(GL_SAMPLES_PASSED);
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include <glad/glad.h>
+
+#include <string>
+#include <vector>
+
+// GPU time and samples passed of named scopes, e.g. render graph passes.
+// Each scope keeps a query per frame of latency and reads it back LATENCY
+// frames later, only if the result is available, so the CPU never waits on
+// the GPU. Scopes are registered the first time their name is used.
+class GpuProfiler
+{
+public:
+	static const unsigned int LATENCY = 4;
+
+	struct Scope
+	{
+		std::string name;
+		double gpuMs = 0.0;
+		GLuint64 samples = 0;
+		bool hasTime = false;
+		bool hasSamples = false;
+		unsigned int lastFrame = 0;
+
+		GLuint timeQueries[LATENCY] = {};
+		GLuint sampleQueries[LATENCY] = {};
+		bool timePending[LATENCY] = {};
+		bool samplesPending[LATENCY] = {};
+	};
+
+	void Destroy();
+
+	// Collects the results of the queries about to be reused
+	void BeginFrame();
+
+	// Timers of different scopes must not overlap
+	void BeginTimer(const char* name);
+	void EndTimer();
+	// Counts fragments passing the depth test, must not overlap an occlusion query
+	void BeginSamples(const char* name);
+	void EndSamples();
+
+	const std::vector<Scope>& GetScopes() const { return scopes; }
+	const Scope* Find(const char* name) const;
+	// False for scopes no longer used, whose values are stale
+	bool IsCurrent(const Scope& scope) const { return scope.lastFrame + LATENCY >= frame; }
+
+private:
+	std::vector<Scope> scopes;
+	unsigned int frame = 0;
+
+	Scope& FindOrAdd(const char* name);
+};
+
+extern GpuProfiler g_gpuProfiler;
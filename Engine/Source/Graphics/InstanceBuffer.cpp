@@ -0,0 +1,31 @@
+#include "InstanceBuffer.h"
+
+InstanceBuffer g_instanceBuffer;
+
+void InstanceBuffer::Init(unsigned int instancesPerFrame, RenderState & state)
+{
+	buffer.Init(GL_ARRAY_BUFFER, instancesPerFrame * sizeof(glm::mat4), sizeof(glm::mat4), state);
+}
+
+void InstanceBuffer::Destroy()
+{
+	buffer.Destroy();
+}
+
+void InstanceBuffer::BeginFrame()
+{
+	buffer.BeginFrame();
+	FenceWaitMs = buffer.FenceWaitMs;
+	InstancesPushed = 0;
+}
+
+void InstanceBuffer::EndFrame()
+{
+	buffer.EndFrame();
+}
+
+unsigned int InstanceBuffer::Push(const glm::mat4 * transforms, unsigned int count)
+{
+	InstancesPushed += count;
+	return buffer.Write(transforms, count * sizeof(glm::mat4));
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "DynamicBuffer.h"
+
+// Per-instance model matrices for instanced draws, streamed through a
+// DynamicBuffer. Offsets stay multiples of a matrix so they can also be
+// turned into a baseInstance.
+class InstanceBuffer
+{
+public:
+	InstanceBuffer() {}
+	// The buffer grows past this when a frame needs more, uploads go through state
+	void Init(unsigned int instancesPerFrame, RenderState & state = g_renderState);
+	void Destroy();
+
+	void BeginFrame();
+	void EndFrame();
+
+	// Stores all count transforms and returns the byte offset of the first,
+	// in the buffer GetBufferID returns afterwards
+	unsigned int Push(const glm::mat4 * transforms, unsigned int count);
+	// Uploads the pushes since the last flush, call before drawing with them
+	void Flush() { buffer.Flush(); }
+
+	unsigned int GetBufferID() const { return buffer.GetBufferID(); }
+	unsigned int InstancesPushed = 0;
+	double FenceWaitMs = 0.0;
+
+private:
+	DynamicBuffer buffer;
+};
+
+// Shared instance stream for the main GL context
+extern InstanceBuffer g_instanceBuffer;
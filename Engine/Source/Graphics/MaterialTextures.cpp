@@ -0,0 +1,205 @@
+#include "MaterialTextures.h"
+#include "GLExtensions.h"
+#include "RenderState.h"
+#include "UniformBuffer.h"
+#include "UniformBlocks.h"
+
+#include <iostream>
+
+MaterialTextures g_materialTextures;
+
+void MaterialTextures::Init()
+{
+	glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &maxLayers);
+	bindless = GLExtensions::BindlessTexture;
+	if (bindless)
+	{
+		glGenBuffers(1, &handleBufferID);
+		UploadHandles();
+	}
+}
+
+void MaterialTextures::Destroy()
+{
+	for (TextureArray & array : arrays)
+	{
+		if (array.handle)
+			GLExtensions::glMakeTextureHandleNonResidentARB(array.handle);
+		g_renderState.OnTextureDeleted(array.textureID);
+		glDeleteTextures(1, &array.textureID);
+	}
+	arrays.clear();
+	packedTextures.clear();
+	glDeleteBuffers(1, &handleBufferID);
+	handleBufferID = 0;
+}
+
+unsigned int MaterialTextures::Add(unsigned int textureID)
+{
+	if (textureID == 0)
+		return NO_TEXTURE;
+	auto found = packedTextures.find(textureID);
+	if (found != packedTextures.end())
+		return found->second;
+
+	GLint width = 0, height = 0, format = 0;
+	g_renderState.BindTexture(0, GL_TEXTURE_2D, textureID);
+	glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &width);
+	glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &height);
+	glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_INTERNAL_FORMAT, &format);
+	bool srgb = format == GL_SRGB || format == GL_SRGB8 || format == GL_SRGB_ALPHA || format == GL_SRGB8_ALPHA8;
+
+	unsigned int packed = NO_TEXTURE;
+	unsigned int slot = 0;
+	while (slot < arrays.size() && (arrays[slot].width != width || arrays[slot].height != height || arrays[slot].srgb != srgb))
+		slot++;
+	if (width == 0 || height == 0)
+	{
+		std::cout << "Error::MaterialTextures::Texture " << textureID << " has no image\n";
+	}
+	else if (slot == arrays.size() && slot == MaxArrays())
+	{
+		std::cout << "Error::MaterialTextures::No array slot left for " << width << "x" << height << " textures\n";
+	}
+	else
+	{
+		if (slot == arrays.size())
+		{
+			TextureArray array;
+			array.width = width;
+			array.height = height;
+			array.srgb = srgb;
+			arrays.push_back(array);
+		}
+		TextureArray & array = arrays[slot];
+		unsigned int layer = array.builtLayers + static_cast<unsigned int>(array.pending.size());
+		if (layer < static_cast<unsigned int>(maxLayers))
+		{
+			array.pending.push_back(textureID);
+			packed = slot << 16 | layer;
+		}
+		else
+			std::cout << "Error::MaterialTextures::" << width << "x" << height << " array is full\n";
+	}
+
+	// Failures are remembered too so they are reported once
+	packedTextures[textureID] = packed;
+	return packed;
+}
+
+void MaterialTextures::Update()
+{
+	deletedTextures.clear();
+	bool rebuilt = false;
+	for (TextureArray & array : arrays)
+	{
+		if (!array.pending.empty())
+		{
+			Build(array);
+			rebuilt = true;
+		}
+	}
+	if (rebuilt && bindless)
+		UploadHandles();
+}
+
+void MaterialTextures::Bind() const
+{
+	if (bindless)
+	{
+		glBindBufferBase(GL_UNIFORM_BUFFER, TEXTURE_BLOCK_BINDING, handleBufferID);
+		return;
+	}
+	for (unsigned int slot = 0; slot < arrays.size(); slot++)
+		g_renderState.BindTexture(FIRST_UNIT + slot, GL_TEXTURE_2D_ARRAY, arrays[slot].textureID);
+}
+
+unsigned int MaterialTextures::GetLayerCount() const
+{
+	unsigned int layers = 0;
+	for (const TextureArray & array : arrays)
+		layers += array.builtLayers;
+	return layers;
+}
+
+unsigned long long MaterialTextures::GetArrayBytes() const
+{
+	unsigned long long bytes = 0;
+	for (const TextureArray & array : arrays)
+		bytes += 4ull * array.width * array.height * array.builtLayers;
+	return bytes;
+}
+
+unsigned int MaterialTextures::MaxArrays() const
+{
+	return bindless ? MaterialTextureBlock::MAX_ARRAYS : MAX_BOUND_ARRAYS;
+}
+
+void MaterialTextures::Build(TextureArray & array)
+{
+	// GL 3.3 cannot copy between textures, so the existing layers and the
+	// new textures are read back and the array is specified again
+	unsigned int layerBytes = 4 * array.width * array.height;
+	unsigned int layers = array.builtLayers + static_cast<unsigned int>(array.pending.size());
+	std::vector<unsigned char> pixels(static_cast<size_t>(layerBytes) * layers);
+	if (array.textureID)
+	{
+		g_renderState.BindTexture(0, GL_TEXTURE_2D_ARRAY, array.textureID);
+		glGetTexImage(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+	}
+	for (unsigned int i = 0; i < array.pending.size(); i++)
+	{
+		g_renderState.BindTexture(0, GL_TEXTURE_2D, array.pending[i]);
+		glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data() + static_cast<size_t>(layerBytes) * (array.builtLayers + i));
+	}
+
+	// The layers are the only copy from now on. A recycled name must not map
+	// to the old layer, so the source is forgotten too.
+	for (unsigned int source : array.pending)
+	{
+		g_renderState.OnTextureDeleted(source);
+		glDeleteTextures(1, &source);
+		packedTextures.erase(source);
+		deletedTextures.push_back(source);
+	}
+
+	if (array.handle)
+		GLExtensions::glMakeTextureHandleNonResidentARB(array.handle);
+	g_renderState.OnTextureDeleted(array.textureID);
+	glDeleteTextures(1, &array.textureID);
+
+	glGenTextures(1, &array.textureID);
+	g_renderState.BindTexture(0, GL_TEXTURE_2D_ARRAY, array.textureID);
+	glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, array.srgb ? GL_SRGB8_ALPHA8 : GL_RGBA8, array.width, array.height, layers, 0,
+		GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+	glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+	// A handle freezes the texture's state, so it is taken once the array is complete
+	array.handle = 0;
+	if (bindless)
+	{
+		array.handle = GLExtensions::glGetTextureHandleARB(array.textureID);
+		GLExtensions::glMakeTextureHandleResidentARB(array.handle);
+	}
+
+	array.builtLayers = layers;
+	array.pending.clear();
+	Rebuilds++;
+}
+
+void MaterialTextures::UploadHandles()
+{
+	MaterialTextureBlock block = {};
+	for (unsigned int slot = 0; slot < arrays.size(); slot++)
+	{
+		GLuint64 handle = arrays[slot].handle;
+		block.arrayHandles[slot] = glm::uvec4(static_cast<unsigned int>(handle & 0xFFFFFFFFu), static_cast<unsigned int>(handle >> 32), 0u, 0u);
+	}
+	glBindBuffer(GL_UNIFORM_BUFFER, handleBufferID);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(block), &block, GL_STATIC_DRAW);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
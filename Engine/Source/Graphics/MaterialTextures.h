@@ -0,0 +1,76 @@
+#pragma once
+#include <glad/glad.h>
+
+#include <unordered_map>
+#include <vector>
+
+// Material textures packed into GL_TEXTURE_2D_ARRAYs, one array per size
+// and color space. Draws select a texture with an array slot and a layer
+// carried in ObjectData, so switching materials between draws switches
+// uniform ranges instead of texture bindings.
+//
+// Without ARB_bindless_texture the arrays are bound once per pass to
+// MAX_BOUND_ARRAYS units starting at FIRST_UNIT. With it, every array gets a
+// resident handle in the MaterialTextureData block and nothing is bound.
+class MaterialTextures
+{
+public:
+	// Marks a missing texture, the shader substitutes a default value
+	static const unsigned int NO_TEXTURE = 0xFFFFFFFF;
+	// GL 3.3 guarantees 16 fragment units, the ones below are taken by the lighting shader
+	static const unsigned int FIRST_UNIT = 9;
+	static const unsigned int MAX_BOUND_ARRAYS = 16 - FIRST_UNIT;
+
+	MaterialTextures() {}
+	// After GLExtensions::Load, decides between bound arrays and bindless handles
+	void Init();
+	void Destroy();
+
+	// Queues a 2D texture for packing and returns slot << 16 | layer, or
+	// NO_TEXTURE when textureID is 0 or no slot is left. Adding the same
+	// texture again returns the same value. A queued texture belongs to this
+	// class from then on, the next Update reads it back and deletes it.
+	unsigned int Add(unsigned int textureID);
+	// Rebuilds the arrays that received textures since the last call
+	void Update();
+	// Textures the last Update packed and deleted, their names may come back
+	// from glGenTextures
+	const std::vector<unsigned int> & GetDeletedTextures() const { return deletedTextures; }
+	// Binds the arrays, or the handle block when bindless
+	void Bind() const;
+
+	bool IsBindless() const { return bindless; }
+	// For Shader defines, selects the sampling path in FragmentShader.frag
+	const char * GetShaderDefines() const { return bindless ? "#define BINDLESS_TEXTURES\n" : ""; }
+
+	unsigned int GetArrayCount() const { return static_cast<unsigned int>(arrays.size()); }
+	unsigned int GetLayerCount() const;
+	// Level 0 of every array, mipmaps add a third
+	unsigned long long GetArrayBytes() const;
+	unsigned int Rebuilds = 0;
+
+private:
+	struct TextureArray
+	{
+		int width = 0;
+		int height = 0;
+		bool srgb = false;
+		unsigned int textureID = 0;
+		GLuint64 handle = 0;
+		unsigned int builtLayers = 0;
+		// Textures waiting for the next Update, layer = builtLayers + index
+		std::vector<unsigned int> pending;
+	};
+	std::vector<TextureArray> arrays;
+	std::unordered_map<unsigned int, unsigned int> packedTextures;
+	std::vector<unsigned int> deletedTextures;
+	bool bindless = false;
+	int maxLayers = 256;
+	unsigned int handleBufferID = 0;
+
+	unsigned int MaxArrays() const;
+	void Build(TextureArray & array);
+	void UploadHandles();
+};
+
+extern MaterialTextures g_materialTextures;
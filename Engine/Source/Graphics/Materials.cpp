@@ -0,0 +1,196 @@
+#include "Materials.h"
+#include "RenderState.h"
+
+#include <assimp/material.h>
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+MaterialLibrary g_materials;
+
+namespace
+{
+	unsigned int FloatBits(float value)
+	{
+		unsigned int bits;
+		std::memcpy(&bits, &value, sizeof(bits));
+		return bits;
+	}
+}
+
+void MaterialLibrary::Init()
+{
+	glGenBuffers(1, &bufferID);
+	glGenTextures(1, &textureID);
+	Add(Material());
+	Upload();
+}
+
+void MaterialLibrary::Destroy()
+{
+	g_renderState.OnTextureDeleted(textureID);
+	glDeleteTextures(1, &textureID);
+	glDeleteBuffers(1, &bufferID);
+	textureID = bufferID = 0;
+	materials.clear();
+	materialIDs.clear();
+	uploadedCount = 0;
+}
+
+unsigned short MaterialLibrary::Add(const Material & material)
+{
+	auto found = materialIDs.find(material);
+	if (found != materialIDs.end())
+	{
+		Deduplicated++;
+		return found->second;
+	}
+	if (materials.size() == MAX_MATERIALS)
+	{
+		std::cout << "Error::MaterialLibrary::All " << MAX_MATERIALS << " material IDs are taken\n";
+		return DEFAULT_MATERIAL;
+	}
+
+	unsigned short id = static_cast<unsigned short>(materials.size());
+	materials.push_back(material);
+	materialIDs[material] = id;
+	return id;
+}
+
+unsigned short MaterialLibrary::Import(const aiMaterial & source, const std::vector<Texture> & textures)
+{
+	Material material;
+	aiColor3D color(1.0f, 1.0f, 1.0f);
+	if (source.Get(AI_MATKEY_COLOR_DIFFUSE, color) == AI_SUCCESS)
+		material.diffuse = glm::vec4(color.r, color.g, color.b, 1.0f);
+	float opacity = 1.0f;
+	if (source.Get(AI_MATKEY_OPACITY, opacity) == AI_SUCCESS)
+		material.diffuse.a = opacity;
+	aiColor3D specularColor(0.0f, 0.0f, 0.0f);
+	if (source.Get(AI_MATKEY_COLOR_SPECULAR, specularColor) == AI_SUCCESS)
+		material.specular = glm::vec4(specularColor.r, specularColor.g, specularColor.b, material.specular.a);
+	float shininess = 0.0f;
+	// The G-buffer stores shininess / 256, exporters often write 0 for none
+	if (source.Get(AI_MATKEY_SHININESS, shininess) == AI_SUCCESS && shininess > 0.0f)
+		material.specular.a = std::min(std::max(shininess, 1.0f), 256.0f);
+
+	SetMaps(material, textures);
+	if (material.diffuse.a < 1.0f)
+		material.variant |= Material::TRANSLUCENT;
+	return Add(material);
+}
+
+unsigned short MaterialLibrary::FromTextures(const std::vector<Texture> & textures)
+{
+	Material material;
+	SetMaps(material, textures);
+	return Add(material);
+}
+
+void MaterialLibrary::SetMaps(Material & material, const std::vector<Texture> & textures)
+{
+	// The lighting shader samples the first texture of each type, the map
+	// bits of Variant follow the same order
+	static const char * const TYPES[] = { "texture_diffuse", "texture_specular", "texture_normal" };
+	for (const Texture & texture : textures)
+	{
+		for (unsigned int slot = 0; slot < 3; slot++)
+		{
+			if (texture.type != TYPES[slot] || material.textures[slot] != MaterialTextures::NO_TEXTURE)
+				continue;
+			material.textures[slot] = g_materialTextures.Add(texture.id);
+			if (material.textures[slot] != MaterialTextures::NO_TEXTURE)
+				material.variant |= Material::DIFFUSE_MAP << slot;
+		}
+	}
+}
+
+unsigned int MaterialLibrary::LoadTexture(const char * path, const std::string & directory, bool gammaCorrection)
+{
+	std::string filename = directory + '/' + path;
+	// Linear and sRGB uploads of one image are different textures
+	std::string key = filename + (gammaCorrection ? "|srgb" : "");
+	auto found = loadedTextures.find(key);
+	if (found != loadedTextures.end())
+	{
+		TextureCacheHits++;
+		return found->second;
+	}
+	unsigned int id = Texture::TextureFromFile(path, directory, gammaCorrection);
+	loadedTextures[key] = id;
+	TexturesLoaded++;
+	return id;
+}
+
+void MaterialLibrary::OnTexturesDeleted(const std::vector<unsigned int> & textures)
+{
+	if (textures.empty())
+		return;
+	for (auto it = loadedTextures.begin(); it != loadedTextures.end();)
+	{
+		if (std::find(textures.begin(), textures.end(), it->second) != textures.end())
+			it = loadedTextures.erase(it);
+		else
+			++it;
+	}
+}
+
+void MaterialLibrary::Upload()
+{
+	unsigned int count = GetCount();
+	if (count == uploadedCount)
+		return;
+
+	std::vector<unsigned int> packed(count * MATERIAL_TEXELS * 4);
+	for (unsigned int i = 0; i < count; i++)
+	{
+		const Material & material = materials[i];
+		unsigned int * texels = &packed[i * MATERIAL_TEXELS * 4];
+		texels[0] = material.textures.x;
+		texels[1] = material.textures.y;
+		texels[2] = material.textures.z;
+		texels[3] = material.variant;
+		for (unsigned int c = 0; c < 4; c++)
+		{
+			texels[4 + c] = FloatBits(material.diffuse[c]);
+			texels[8 + c] = FloatBits(material.specular[c]);
+		}
+	}
+
+	// Materials are only ever added, so the whole buffer is specified again
+	glBindBuffer(GL_TEXTURE_BUFFER, bufferID);
+	glBufferData(GL_TEXTURE_BUFFER, packed.size() * sizeof(unsigned int), packed.data(), GL_STATIC_DRAW);
+	g_renderState.BindTexture(0, GL_TEXTURE_BUFFER, textureID);
+	glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32UI, bufferID);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+	uploadedCount = count;
+}
+
+void MaterialLibrary::Bind(unsigned int unit) const
+{
+	g_renderState.BindTexture(unit, GL_TEXTURE_BUFFER, textureID);
+}
+
+size_t MaterialLibrary::MaterialHash::operator()(const Material & material) const
+{
+	// FNV-1a over the values operator== compares. Adding 0 turns -0 into +0,
+	// the only equal floats with different bits.
+	unsigned int words[13] = { material.variant, material.textures.x, material.textures.y, material.textures.z, material.textures.w };
+	for (unsigned int c = 0; c < 4; c++)
+	{
+		words[5 + c] = FloatBits(material.diffuse[c] + 0.0f);
+		words[9 + c] = FloatBits(material.specular[c] + 0.0f);
+	}
+
+	size_t hash = 2166136261u;
+	for (unsigned int word : words)
+	{
+		for (unsigned int byte = 0; byte < 4; byte++)
+		{
+			hash ^= (word >> (byte * 8)) & 0xFFu;
+			hash *= 16777619u;
+		}
+	}
+	return hash;
+}
@@ -0,0 +1,100 @@
+#pragma once
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Texture.h"
+#include "MaterialTextures.h"
+
+struct aiMaterial;
+
+// Everything a draw needs to shade a surface besides its geometry
+struct Material
+{
+	// Bits of variant, which inputs the material has. Materials with equal
+	// variants take the same path through the lighting shader.
+	enum Variant
+	{
+		DIFFUSE_MAP = 1 << 0,
+		SPECULAR_MAP = 1 << 1,
+		NORMAL_MAP = 1 << 2,
+		TRANSLUCENT = 1 << 3
+	};
+
+	unsigned int variant = 0;
+	// Diffuse, specular and normal map as g_materialTextures references
+	glm::uvec4 textures = glm::uvec4(MaterialTextures::NO_TEXTURE);
+	// Used where the matching map is missing
+	glm::vec4 diffuse = glm::vec4(1.0f);                      // color, opacity
+	glm::vec4 specular = glm::vec4(0.0f, 0.0f, 0.0f, 32.0f);  // color, shininess
+
+	bool operator==(const Material & other) const
+	{
+		return variant == other.variant && textures == other.textures && diffuse == other.diffuse && specular == other.specular;
+	}
+};
+
+// Owns every material and gives each a stable 16 bit ID, which is what
+// meshes store, ObjectData carries and draw sort keys group by. Adding a
+// material equal to an existing one returns the existing ID, so models
+// sharing textures and parameters share materials.
+//
+// Materials are packed into an RGBA32UI texture buffer, uploaded when new
+// ones were added:
+//   [diffuse map, specular map, normal map, variant] [diffuse, opacity] [specular, shininess]
+// Floats are stored as their bits.
+class MaterialLibrary
+{
+public:
+	static const unsigned int MATERIAL_TEXELS = 3;
+	static const unsigned int MAX_MATERIALS = 1 << 16;
+	// White, no specular, shininess 32. Also what an ObjectBlock without a material selects.
+	static const unsigned short DEFAULT_MATERIAL = 0;
+
+	MaterialLibrary() {}
+	void Init();
+	void Destroy();
+
+	unsigned short Add(const Material & material);
+	// Colors, shininess and opacity from the aiMaterial, maps from textures
+	unsigned short Import(const aiMaterial & material, const std::vector<Texture> & textures);
+	// Default parameters, maps from textures
+	unsigned short FromTextures(const std::vector<Texture> & textures);
+	const Material & Get(unsigned short id) const { return materials[id]; }
+	unsigned int GetCount() const { return static_cast<unsigned int>(materials.size()); }
+
+	// Loads an image once per path for all models, see Texture::TextureFromFile
+	unsigned int LoadTexture(const char * path, const std::string & directory, bool gammaCorrection);
+	// Drops cached loads of deleted textures, a later load reads the file again
+	void OnTexturesDeleted(const std::vector<unsigned int> & textures);
+
+	// Uploads the materials added since the last call
+	void Upload();
+	void Bind(unsigned int unit) const;
+
+	// Add calls answered with an existing material
+	unsigned int Deduplicated = 0;
+	unsigned int TextureCacheHits = 0;
+	// Images read from disk, the cache drops them once they are packed
+	unsigned int TexturesLoaded = 0;
+
+private:
+	struct MaterialHash
+	{
+		size_t operator()(const Material & material) const;
+	};
+	std::vector<Material> materials;
+	std::unordered_map<Material, unsigned short, MaterialHash> materialIDs;
+	std::unordered_map<std::string, unsigned int> loadedTextures;
+	unsigned int uploadedCount = 0;
+	unsigned int bufferID = 0;
+	unsigned int textureID = 0;
+
+	// Fills textures and the map bits of variant
+	void SetMaps(Material & material, const std::vector<Texture> & textures);
+};
+
+extern MaterialLibrary g_materials;
@@ -0,0 +1,182 @@
+#include "OcclusionQueries.h"
+#include "Shaders.h"
+#include "RenderState.h"
+#include "Materials.h"
+#include "..\Objects\Geometry\Mesh.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+void OcclusionQueries::Init()
+{
+	// Unit cube from -1 to 1, scaled onto each box
+	float vertices[] = {
+		-1.0f, -1.0f, -1.0f,   1.0f, -1.0f, -1.0f,   1.0f,  1.0f, -1.0f,  -1.0f,  1.0f, -1.0f,
+		-1.0f, -1.0f,  1.0f,   1.0f, -1.0f,  1.0f,   1.0f,  1.0f,  1.0f,  -1.0f,  1.0f,  1.0f
+	};
+	unsigned int indices[] = {
+		0, 2, 1, 0, 3, 2,   4, 5, 6, 4, 6, 7,   0, 1, 5, 0, 5, 4,
+		3, 6, 2, 3, 7, 6,   0, 4, 7, 0, 7, 3,   1, 2, 6, 1, 6, 5
+	};
+
+	glGenVertexArrays(1, &boxVAO);
+	glGenBuffers(1, &boxVBO);
+	glGenBuffers(1, &boxEBO);
+	g_renderState.BindVertexArray(boxVAO);
+	glBindBuffer(GL_ARRAY_BUFFER, boxVBO);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, boxEBO);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+}
+
+void OcclusionQueries::Destroy()
+{
+	Reset();
+	g_renderState.OnVertexArrayDeleted(boxVAO);
+	glDeleteVertexArrays(1, &boxVAO);
+	glDeleteBuffers(1, &boxVBO);
+	glDeleteBuffers(1, &boxEBO);
+}
+
+void OcclusionQueries::Reset()
+{
+	for (ItemState& state : items)
+	{
+		if (state.query)
+			glDeleteQueries(1, &state.query);
+	}
+	items.clear();
+}
+
+void OcclusionQueries::BeginFrame(unsigned int itemCount)
+{
+	frame++;
+	Visible = Queried = Skipped = Occluded = 0;
+	queue.clear();
+
+	if (items.size() < itemCount)
+		items.resize(itemCount);
+
+	for (ItemState& state : items)
+	{
+		if (!state.pending)
+			continue;
+
+		GLuint available = 0;
+		glGetQueryObjectuiv(state.query, GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available)
+			continue;
+
+		GLuint anySamples = 0;
+		glGetQueryObjectuiv(state.query, GL_QUERY_RESULT, &anySamples);
+		state.visible = anySamples != 0;
+		state.pending = false;
+	}
+}
+
+bool OcclusionQueries::Schedule(unsigned int item, const Mesh& mesh, const glm::mat4& transform, const AABB& bounds)
+{
+	ItemState& state = items[item];
+
+	if (state.visible)
+	{
+		// Spread the re-queries of visible items over the interval
+		bool due = !state.pending && frame - state.lastQueryFrame >= VISIBLE_QUERY_INTERVAL + (item % VISIBLE_QUERY_INTERVAL) / 2;
+		if (due)
+			queue.push_back({ item, &mesh, transform, bounds, false, false });
+		else
+			Skipped++;
+		Visible++;
+		return true;
+	}
+
+	queue.push_back({ item, &mesh, transform, bounds, true, true });
+	Occluded++;
+	return false;
+}
+
+void OcclusionQueries::Submit(const Shader& boxShader, const Shader& drawShader, UniformRingBuffer& uniforms, glm::vec3 viewPosition)
+{
+	if (queue.empty())
+		return;
+
+	// Decide which boxes are queried and write their ObjectData together with
+	// that of the conditional draws, so the whole batch is one uniform write
+	queried.clear();
+	objectScratch.clear();
+	for (unsigned int i = 0; i < queue.size(); i++)
+	{
+		QueuedItem& queued = queue[i];
+		ItemState& state = items[queued.item];
+
+		// A box around the camera would be clipped away, such items are always visible
+		glm::vec3 center = queued.bounds.Center();
+		glm::vec3 extents = queued.bounds.Extents() + glm::vec3(0.2f);
+		if (glm::all(glm::lessThanEqual(glm::abs(viewPosition - center), extents)))
+		{
+			state.visible = true;
+			queued.conditional = false;
+			continue;
+		}
+		// Still in flight from an earlier frame, keep drawing on the last known result
+		if (state.pending)
+			continue;
+
+		glm::mat4 boxTransform = glm::scale(glm::translate(glm::mat4(1.0f), center), glm::max(queued.bounds.Extents(), glm::vec3(1e-3f)));
+		objectScratch.push_back(ObjectBlock{ boxTransform, glm::uvec4(MaterialLibrary::DEFAULT_MATERIAL, 0u, 0u, 0u) });
+		queried.push_back(i);
+	}
+	unsigned int drawObjects = static_cast<unsigned int>(objectScratch.size());
+	for (const QueuedItem& queued : queue)
+	{
+		if (queued.drawAfterQueries)
+			objectScratch.push_back(ObjectBlock{ queued.transform, glm::uvec4(queued.mesh->GetMaterialID(), 0u, 0u, 0u) });
+	}
+	UniformArrayAllocation objects = uniforms.PushArray(objectScratch.data(), static_cast<unsigned int>(objectScratch.size()));
+
+	// All box queries in one batch: no color or depth writes, both faces count
+	boxShader.Use();
+	g_renderState.BindVertexArray(boxVAO);
+	g_renderState.SetDepthMask(false);
+	g_renderState.SetCullFace(false);
+	glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+
+	for (unsigned int i = 0; i < queried.size(); i++)
+	{
+		ItemState& state = items[queue[queried[i]].item];
+		if (!state.query)
+			glGenQueries(1, &state.query);
+
+		uniforms.Bind(OBJECT_BLOCK_BINDING, objects[i]);
+		glBeginQuery(GL_ANY_SAMPLES_PASSED, state.query);
+		glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
+		glEndQuery(GL_ANY_SAMPLES_PASSED);
+
+		state.pending = true;
+		state.lastQueryFrame = frame;
+		Queried++;
+	}
+
+	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+	g_renderState.SetDepthMask(true);
+	g_renderState.SetCullFace(true);
+
+	// Hidden items are drawn if this frame's box query passes, without waiting for it
+	drawShader.Use();
+	unsigned int object = drawObjects;
+	for (const QueuedItem& queued : queue)
+	{
+		if (!queued.drawAfterQueries)
+			continue;
+
+		const ItemState& state = items[queued.item];
+		bool conditional = queued.conditional && state.query;
+		uniforms.Bind(OBJECT_BLOCK_BINDING, objects[object++]);
+		if (conditional)
+			glBeginConditionalRender(state.query, GL_QUERY_NO_WAIT);
+		queued.mesh->Draw();
+		if (conditional)
+			glEndConditionalRender();
+	}
+}
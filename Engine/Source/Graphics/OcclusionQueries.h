@@ -0,0 +1,74 @@
+#pragma once
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <vector>
+
+#include "UniformBuffer.h"
+#include "UniformBlocks.h"
+#include "..\Objects\Geometry\Bounds.h"
+
+class Shader;
+class Mesh;
+
+// Hardware occlusion queries on bounding boxes, scheduled in the spirit of
+// CHC++. Every item keeps the visibility of its last finished query. Items
+// that were visible are drawn normally and only re-queried every few frames,
+// items that were hidden are queried every frame and drawn under conditional
+// rendering on their own query. Results are read only once available, so the
+// CPU never waits on the GPU and visibility lags by a frame or two.
+class OcclusionQueries
+{
+public:
+	// Visible items are re-queried after this many frames, jittered per item
+	static const unsigned int VISIBLE_QUERY_INTERVAL = 8;
+
+	void Init();
+	void Destroy();
+	// Forgets all item state, for when item indices change
+	void Reset();
+
+	// Grows the per item state and collects finished queries
+	void BeginFrame(unsigned int itemCount);
+
+	// False when the item must not go into the regular draw list, it is
+	// queued for a conditional draw instead
+	bool Schedule(unsigned int item, const Mesh& mesh, const glm::mat4& transform, const AABB& bounds);
+
+	// Issues the queued box queries, then the conditional draws. Call after
+	// the regular opaque draws so their depth occludes the boxes.
+	void Submit(const Shader& boxShader, const Shader& drawShader, UniformRingBuffer& uniforms, glm::vec3 viewPosition);
+
+	unsigned int Visible = 0;   // drawn without a query this frame
+	unsigned int Queried = 0;   // box queries issued
+	unsigned int Skipped = 0;   // visible items whose query was skipped thanks to coherence
+	unsigned int Occluded = 0;  // drawn conditionally because the last result was hidden
+
+private:
+	struct ItemState
+	{
+		GLuint query = 0;
+		bool pending = false;
+		bool visible = true;
+		unsigned int lastQueryFrame = 0;
+	};
+	std::vector<ItemState> items;
+
+	struct QueuedItem
+	{
+		unsigned int item;
+		const Mesh* mesh;
+		glm::mat4 transform;
+		AABB bounds;
+		bool drawAfterQueries;  // not in the regular draw list
+		bool conditional;       // draw only if the box query passes
+	};
+	std::vector<QueuedItem> queue;
+	// Indices into queue of this frame's box queries, and the ObjectData of
+	// the boxes followed by that of the draws after them
+	std::vector<unsigned int> queried;
+	std::vector<ObjectBlock> objectScratch;
+
+	unsigned int frame = 0;
+	unsigned int boxVAO = 0, boxVBO = 0, boxEBO = 0;
+};
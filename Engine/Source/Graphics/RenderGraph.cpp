@@ -0,0 +1,306 @@
+#include "RenderGraph.h"
+#include "GpuProfiler.h"
+#include "RenderState.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::Read(RenderResource resource)
+{
+	graph.passes[pass].reads.push_back(resource);
+	return *this;
+}
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::Write(RenderResource resource)
+{
+	graph.passes[pass].writes.push_back(resource);
+	return *this;
+}
+
+void RenderGraph::Reset()
+{
+	resources.clear();
+	passes.clear();
+	order.clear();
+}
+
+RenderResource RenderGraph::CreateTexture(const char* name, const RenderTextureDesc& desc)
+{
+	Resource resource;
+	resource.name = name;
+	resource.desc = desc;
+	resources.push_back(resource);
+	return static_cast<RenderResource>(resources.size() - 1);
+}
+
+RenderResource RenderGraph::ImportBackbuffer(const char* name, int width, int height)
+{
+	Resource resource;
+	resource.name = name;
+	resource.desc.width = width;
+	resource.desc.height = height;
+	resource.imported = true;
+	resources.push_back(resource);
+	return static_cast<RenderResource>(resources.size() - 1);
+}
+
+void RenderGraph::MarkOutput(RenderResource resource)
+{
+	resources[resource].output = true;
+}
+
+RenderGraph::PassBuilder RenderGraph::AddPass(const char* name, ExecuteFunction execute)
+{
+	Pass pass;
+	pass.name = name;
+	pass.execute = execute;
+	passes.push_back(pass);
+	return PassBuilder(*this, static_cast<unsigned int>(passes.size() - 1));
+}
+
+void RenderGraph::Compile()
+{
+	CullPasses();
+	SortPasses();
+	AssignPhysical();
+}
+
+void RenderGraph::CullPasses()
+{
+	// A pass lives if it writes an imported or output resource, or one a living pass reads
+	std::vector<unsigned char> needed(resources.size(), 0);
+	for (unsigned int r = 0; r < resources.size(); r++)
+		needed[r] = resources[r].imported || resources[r].output;
+	for (Pass& pass : passes)
+		pass.culled = true;
+
+	bool changed = true;
+	while (changed)
+	{
+		changed = false;
+		for (Pass& pass : passes)
+		{
+			if (!pass.culled)
+				continue;
+			bool writesNeeded = false;
+			for (RenderResource resource : pass.writes)
+				writesNeeded = writesNeeded || needed[resource];
+			if (!writesNeeded)
+				continue;
+
+			pass.culled = false;
+			for (RenderResource resource : pass.reads)
+				needed[resource] = 1;
+			changed = true;
+		}
+	}
+
+	CulledPasses = 0;
+	for (const Pass& pass : passes)
+		CulledPasses += pass.culled ? 1 : 0;
+}
+
+void RenderGraph::SortPasses()
+{
+	// A reader depends on every writer of what it reads, a pass that reads and
+	// writes a resource only on the writers declared before it. Writers of the
+	// same resource keep their declaration order, ties go to the earlier pass.
+	unsigned int count = static_cast<unsigned int>(passes.size());
+	std::vector<std::vector<unsigned int>> dependents(count);
+	std::vector<unsigned int> dependencies(count, 0);
+	auto contains = [](const std::vector<RenderResource>& list, RenderResource resource)
+	{
+		return std::find(list.begin(), list.end(), resource) != list.end();
+	};
+	for (unsigned int writer = 0; writer < count; writer++)
+	{
+		for (unsigned int other = 0; other < count; other++)
+		{
+			if (other == writer || passes[writer].culled || passes[other].culled)
+				continue;
+
+			bool depends = false;
+			for (RenderResource resource : passes[writer].writes)
+			{
+				bool otherWrites = contains(passes[other].writes, resource);
+				if (contains(passes[other].reads, resource) && (!otherWrites || writer < other))
+					depends = true;
+				if (otherWrites && writer < other)
+					depends = true;
+			}
+			if (depends)
+			{
+				dependents[writer].push_back(other);
+				dependencies[other]++;
+			}
+		}
+	}
+
+	order.clear();
+	std::vector<unsigned char> done(count, 0);
+	for (unsigned int step = 0; step < count; step++)
+	{
+		unsigned int next = count;
+		for (unsigned int i = 0; i < count && next == count; i++)
+		{
+			if (!passes[i].culled && !done[i] && dependencies[i] == 0)
+				next = i;
+		}
+		if (next == count)
+			break;
+		done[next] = 1;
+		order.push_back(next);
+		for (unsigned int dependent : dependents[next])
+			dependencies[dependent]--;
+	}
+
+	unsigned int alive = count - CulledPasses;
+	if (order.size() != alive)
+	{
+		std::cout << "Error::RenderGraph::Pass dependencies form a cycle, using declaration order\n";
+		order.clear();
+		for (unsigned int i = 0; i < count; i++)
+		{
+			if (!passes[i].culled)
+				order.push_back(i);
+		}
+	}
+}
+
+void RenderGraph::AssignPhysical()
+{
+	for (unsigned int position = 0; position < order.size(); position++)
+	{
+		const Pass& pass = passes[order[position]];
+		for (const std::vector<RenderResource>* list : { &pass.reads, &pass.writes })
+		{
+			for (RenderResource r : *list)
+			{
+				resources[r].firstUse = std::min(resources[r].firstUse, position);
+				resources[r].lastUse = std::max(resources[r].lastUse, position);
+			}
+		}
+	}
+
+	UnaliasedTransientBytes = 0;
+	PeakTransientBytes = 0;
+	unsigned int liveBytes = 0;
+	std::vector<unsigned int> used;
+	for (unsigned int position = 0; position < order.size(); position++)
+	{
+		for (Resource& resource : resources)
+		{
+			if (resource.imported || resource.firstUse != position)
+				continue;
+			resource.physical = pool.Acquire(resource.desc);
+			if (std::find(used.begin(), used.end(), resource.physical) == used.end())
+				used.push_back(resource.physical);
+			UnaliasedTransientBytes += resource.desc.GetByteSize();
+			liveBytes += resource.desc.GetByteSize();
+		}
+		PeakTransientBytes = std::max(PeakTransientBytes, liveBytes);
+
+		// Textures last used here can back later resources
+		for (Resource& resource : resources)
+		{
+			if (resource.imported || resource.output || resource.physical == RenderTargetPool::INVALID_TARGET || resource.lastUse != position)
+				continue;
+			pool.Release(resource.physical);
+			liveBytes -= resource.desc.GetByteSize();
+		}
+	}
+	PhysicalTextures = static_cast<unsigned int>(used.size());
+}
+
+void RenderGraph::Execute()
+{
+	for (unsigned int index : order)
+	{
+		Pass& pass = passes[index];
+
+		bool backbuffer = false;
+		std::vector<unsigned int> attachments;
+		int width = 0, height = 0;
+		for (RenderResource r : pass.writes)
+		{
+			backbuffer = backbuffer || resources[r].imported;
+			if (!resources[r].imported)
+				attachments.push_back(resources[r].physical);
+			width = std::max(width, resources[r].desc.width);
+			height = std::max(height, resources[r].desc.height);
+		}
+
+		if (backbuffer)
+			g_renderState.BindFramebuffer(GL_FRAMEBUFFER, 0);
+		else if (!attachments.empty())
+			g_renderState.BindFramebuffer(GL_FRAMEBUFFER, pool.GetFramebuffer(attachments));
+		if (width > 0 && height > 0)
+			g_renderState.SetViewport(0, 0, width, height);
+
+		if (profiler)
+			profiler->BeginTimer(pass.name.c_str());
+		pass.execute(*this);
+		if (profiler)
+			profiler->EndTimer();
+	}
+}
+
+unsigned int RenderGraph::GetTexture(RenderResource resource) const
+{
+	const Resource& r = resources[resource];
+	return (r.imported || r.physical == RenderTargetPool::INVALID_TARGET) ? 0 : pool.GetTexture(r.physical);
+}
+
+unsigned int RenderGraph::GetFramebuffer(RenderResource resource)
+{
+	const Resource& r = resources[resource];
+	if (r.imported || r.physical == RenderTargetPool::INVALID_TARGET)
+		return 0;
+	return pool.GetFramebuffer(std::vector<unsigned int>(1, r.physical));
+}
+
+unsigned int RenderGraph::GetLayerFramebuffer(RenderResource resource, unsigned int layer)
+{
+	const Resource& r = resources[resource];
+	if (r.imported || r.physical == RenderTargetPool::INVALID_TARGET)
+		return 0;
+	return pool.GetLayerFramebuffer(r.physical, layer);
+}
+
+bool RenderGraph::DumpDot(const char* path) const
+{
+	std::ofstream file(path);
+	if (!file)
+	{
+		std::cout << "Error::RenderGraph::Could not open " << path << "\n";
+		return false;
+	}
+
+	file << "digraph RenderGraph\n{\n\trankdir=LR;\n";
+	for (unsigned int i = 0; i < passes.size(); i++)
+	{
+		const Pass& pass = passes[i];
+		file << "\tpass" << i << " [shape=box, label=\"" << pass.name << "\"" << (pass.culled ? ", style=dashed" : ", style=filled, fillcolor=lightblue") << "];\n";
+	}
+	for (unsigned int r = 0; r < resources.size(); r++)
+	{
+		const Resource& resource = resources[r];
+		file << "\tres" << r << " [shape=ellipse, label=\"" << resource.name;
+		if (resource.imported)
+			file << "\\nimported\", style=filled, fillcolor=lightgrey];\n";
+		else if (resource.physical == RenderTargetPool::INVALID_TARGET)
+			file << "\\nunused\", style=dashed];\n";
+		else
+			file << "\\n" << resource.desc.width << "x" << resource.desc.height << ", " << resource.desc.GetByteSize() / 1024 << " KB\\nphysical " << resource.physical << "\"];\n";
+	}
+	for (unsigned int i = 0; i < passes.size(); i++)
+	{
+		for (RenderResource r : passes[i].reads)
+			file << "\tres" << r << " -> pass" << i << ";\n";
+		for (RenderResource r : passes[i].writes)
+			file << "\tpass" << i << " -> res" << r << " [color=red];\n";
+	}
+	file << "\tlabel=\"peak transient " << PeakTransientBytes / 1024 << " KB, unaliased " << UnaliasedTransientBytes / 1024 << " KB\";\n}\n";
+	return true;
+}
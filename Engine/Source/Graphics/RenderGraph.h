@@ -0,0 +1,104 @@
+#pragma once
+#include <glad/glad.h>
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "RenderTargetPool.h"
+
+class GpuProfiler;
+
+typedef unsigned int RenderResource;
+
+// Frame graph rebuilt every frame: passes declare the textures they read and
+// write, Compile culls passes nothing consumes, orders the rest by their
+// dependencies and gives every transient texture a physical one from the
+// render target pool. A transient's target goes back to the pool after its
+// last pass, so transients with equal descriptions and disjoint lifetimes
+// share it. Execute binds a framebuffer holding each pass's writes and runs it.
+class RenderGraph
+{
+public:
+	static const RenderResource INVALID_RESOURCE = 0xFFFFFFFF;
+
+	typedef std::function<void(RenderGraph&)> ExecuteFunction;
+
+	class PassBuilder
+	{
+	public:
+		PassBuilder& Read(RenderResource resource);
+		PassBuilder& Write(RenderResource resource);
+	private:
+		friend class RenderGraph;
+		PassBuilder(RenderGraph& graph, unsigned int pass) : graph(graph), pass(pass) {}
+		RenderGraph& graph;
+		unsigned int pass;
+	};
+
+	explicit RenderGraph(RenderTargetPool& pool) : pool(pool) {}
+
+	// Times every executed pass under its name when set
+	void SetProfiler(GpuProfiler* gpuProfiler) { profiler = gpuProfiler; }
+
+	// Clears the passes and resources of the previous frame
+	void Reset();
+
+	RenderResource CreateTexture(const char* name, const RenderTextureDesc& desc);
+	// The default framebuffer, passes writing it render to the window
+	RenderResource ImportBackbuffer(const char* name, int width, int height);
+	// Keeps a resource alive to the end of the frame, e.g. for ImGui
+	void MarkOutput(RenderResource resource);
+
+	PassBuilder AddPass(const char* name, ExecuteFunction execute);
+
+	void Compile();
+	void Execute();
+
+	// Physical texture of a resource, valid from Compile to the next Reset
+	unsigned int GetTexture(RenderResource resource) const;
+	// A framebuffer with only this resource attached, for blits
+	unsigned int GetFramebuffer(RenderResource resource);
+	// A framebuffer with one layer of an array resource attached, for rendering layers one by one
+	unsigned int GetLayerFramebuffer(RenderResource resource, unsigned int layer);
+
+	// Writes the compiled graph in graphviz DOT format
+	bool DumpDot(const char* path) const;
+
+	unsigned int CulledPasses = 0;
+	unsigned int PhysicalTextures = 0;  // distinct pool targets used by the frame
+	// Largest transient memory live at once, and what it would be without aliasing
+	unsigned int PeakTransientBytes = 0;
+	unsigned int UnaliasedTransientBytes = 0;
+
+private:
+	struct Resource
+	{
+		std::string name;
+		RenderTextureDesc desc;
+		bool imported = false;
+		bool output = false;
+		unsigned int physical = RenderTargetPool::INVALID_TARGET;
+		unsigned int firstUse = 0xFFFFFFFF;  // position in the execution order
+		unsigned int lastUse = 0;
+	};
+
+	struct Pass
+	{
+		std::string name;
+		ExecuteFunction execute;
+		std::vector<RenderResource> reads;
+		std::vector<RenderResource> writes;
+		bool culled = false;
+	};
+
+	std::vector<Resource> resources;
+	std::vector<Pass> passes;
+	std::vector<unsigned int> order;
+	RenderTargetPool& pool;
+	GpuProfiler* profiler = nullptr;
+
+	void CullPasses();
+	void SortPasses();
+	void AssignPhysical();
+};
@@ -0,0 +1,290 @@
+#include "RenderState.h"
+
+#include <iostream>
+
+RenderState g_renderState;
+
+GLFunctionTable GLFunctionTable::FromGlad()
+{
+	GLFunctionTable table;
+	table.UseProgram = glad_glUseProgram;
+	table.BindVertexArray = glad_glBindVertexArray;
+	table.ActiveTexture = glad_glActiveTexture;
+	table.BindTexture = glad_glBindTexture;
+	table.BindFramebuffer = glad_glBindFramebuffer;
+	table.Enable = glad_glEnable;
+	table.Disable = glad_glDisable;
+	table.DepthFunc = glad_glDepthFunc;
+	table.DepthMask = glad_glDepthMask;
+	table.CullFace = glad_glCullFace;
+	table.BlendFunc = glad_glBlendFunc;
+	table.Viewport = glad_glViewport;
+	table.BindBuffer = glad_glBindBuffer;
+	table.BindBufferRange = glad_glBindBufferRange;
+	table.MapBufferRange = glad_glMapBufferRange;
+	table.UnmapBuffer = glad_glUnmapBuffer;
+	table.EnableVertexAttribArray = glad_glEnableVertexAttribArray;
+	table.DisableVertexAttribArray = glad_glDisableVertexAttribArray;
+	table.VertexAttribPointer = glad_glVertexAttribPointer;
+	table.VertexAttribDivisor = glad_glVertexAttribDivisor;
+	table.VertexAttrib4f = glad_glVertexAttrib4f;
+	table.DrawElements = glad_glDrawElements;
+	table.DrawElementsInstanced = glad_glDrawElementsInstanced;
+	table.MultiDrawElementsIndirect = GLExtensions::glMultiDrawElementsIndirect;
+	return table;
+}
+
+namespace
+{
+	void APIENTRY NullUInt(GLuint) {}
+	void APIENTRY NullEnum(GLenum) {}
+	void APIENTRY NullEnumUInt(GLenum, GLuint) {}
+	void APIENTRY NullBoolean(GLboolean) {}
+	void APIENTRY NullEnumEnum(GLenum, GLenum) {}
+	void APIENTRY NullViewport(GLint, GLint, GLsizei, GLsizei) {}
+	void APIENTRY NullBindBufferRange(GLenum, GLuint, GLuint, GLintptr, GLsizeiptr) {}
+	// No storage behind it, callers skip their copy like on a failed map
+	void * APIENTRY NullMapBufferRange(GLenum, GLintptr, GLsizeiptr, GLbitfield) { return nullptr; }
+	GLboolean APIENTRY NullUnmapBuffer(GLenum) { return GL_TRUE; }
+	void APIENTRY NullVertexAttribPointer(GLuint, GLint, GLenum, GLboolean, GLsizei, const void *) {}
+	void APIENTRY NullUIntUInt(GLuint, GLuint) {}
+	void APIENTRY NullVertexAttrib4f(GLuint, GLfloat, GLfloat, GLfloat, GLfloat) {}
+	void APIENTRY NullDrawElements(GLenum, GLsizei, GLenum, const void *) {}
+	void APIENTRY NullDrawElementsInstanced(GLenum, GLsizei, GLenum, const void *, GLsizei) {}
+	void APIENTRY NullMultiDrawElementsIndirect(GLenum, GLenum, const void *, GLsizei, GLsizei) {}
+}
+
+GLFunctionTable GLFunctionTable::Null()
+{
+	GLFunctionTable table;
+	table.UseProgram = NullUInt;
+	table.BindVertexArray = NullUInt;
+	table.ActiveTexture = NullEnum;
+	table.BindTexture = NullEnumUInt;
+	table.BindFramebuffer = NullEnumUInt;
+	table.Enable = NullEnum;
+	table.Disable = NullEnum;
+	table.DepthFunc = NullEnum;
+	table.DepthMask = NullBoolean;
+	table.CullFace = NullEnum;
+	table.BlendFunc = NullEnumEnum;
+	table.Viewport = NullViewport;
+	table.BindBuffer = NullEnumUInt;
+	table.BindBufferRange = NullBindBufferRange;
+	table.MapBufferRange = NullMapBufferRange;
+	table.UnmapBuffer = NullUnmapBuffer;
+	table.EnableVertexAttribArray = NullUInt;
+	table.DisableVertexAttribArray = NullUInt;
+	table.VertexAttribPointer = NullVertexAttribPointer;
+	table.VertexAttribDivisor = NullUIntUInt;
+	table.VertexAttrib4f = NullVertexAttrib4f;
+	table.DrawElements = NullDrawElements;
+	table.DrawElementsInstanced = NullDrawElementsInstanced;
+	table.MultiDrawElementsIndirect = NullMultiDrawElementsIndirect;
+	return table;
+}
+
+void RenderState::Init(const GLFunctionTable & functions)
+{
+	gl = functions;
+	Invalidate();
+	ResetFrameStats();
+}
+
+void RenderState::Invalidate()
+{
+	program = vertexArray = activeTexture = UNKNOWN;
+	for (unsigned int unit = 0; unit < MAX_TEXTURE_UNITS; unit++)
+	{
+		for (unsigned int target = 0; target < TARGET_COUNT; target++)
+			textures[unit][target] = UNKNOWN;
+	}
+	readFramebuffer = drawFramebuffer = UNKNOWN;
+	for (unsigned int i = 0; i < CAPABILITY_COUNT; i++)
+		capabilities[i] = UNKNOWN;
+	depthFunc = depthMask = cullMode = UNKNOWN;
+	blendSource = blendDestination = UNKNOWN;
+	viewport[0] = viewport[1] = viewport[2] = viewport[3] = -1;
+}
+
+void RenderState::ResetFrameStats()
+{
+	FrameStats = Stats();
+}
+
+bool RenderState::Changed(unsigned int & cached, unsigned int value)
+{
+	if (cached == value)
+	{
+		FrameStats.elided++;
+		return false;
+	}
+	cached = value;
+	FrameStats.issued++;
+	return true;
+}
+
+void RenderState::UseProgram(unsigned int programID)
+{
+	if (Changed(program, programID))
+		gl.UseProgram(programID);
+}
+
+void RenderState::BindVertexArray(unsigned int vao)
+{
+	if (Changed(vertexArray, vao))
+		gl.BindVertexArray(vao);
+}
+
+void RenderState::BindTexture(unsigned int unit, GLenum target, unsigned int texture)
+{
+	int targetIndex = TargetIndex(target);
+	if (unit >= MAX_TEXTURE_UNITS || targetIndex < 0)
+	{
+		// Untracked, forward and forget what we knew about the unit
+		gl.ActiveTexture(GL_TEXTURE0 + unit);
+		gl.BindTexture(target, texture);
+		activeTexture = GL_TEXTURE0 + unit;
+		FrameStats.issued += 2;
+		FrameStats.textureBinds++;
+		return;
+	}
+
+	if (textures[unit][targetIndex] == texture)
+	{
+		FrameStats.elided++;
+		return;
+	}
+	if (Changed(activeTexture, GL_TEXTURE0 + unit))
+		gl.ActiveTexture(GL_TEXTURE0 + unit);
+	textures[unit][targetIndex] = texture;
+	FrameStats.issued++;
+	FrameStats.textureBinds++;
+	gl.BindTexture(target, texture);
+}
+
+void RenderState::BindFramebuffer(GLenum target, unsigned int framebuffer)
+{
+	if (target == GL_FRAMEBUFFER)
+	{
+		if (readFramebuffer == framebuffer && drawFramebuffer == framebuffer)
+		{
+			FrameStats.elided++;
+			return;
+		}
+		readFramebuffer = drawFramebuffer = framebuffer;
+		FrameStats.issued++;
+		gl.BindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	}
+	else if (target == GL_READ_FRAMEBUFFER)
+	{
+		if (Changed(readFramebuffer, framebuffer))
+			gl.BindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+	}
+	else if (target == GL_DRAW_FRAMEBUFFER)
+	{
+		if (Changed(drawFramebuffer, framebuffer))
+			gl.BindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffer);
+	}
+	else
+	{
+		std::cout << "Error::RenderState::Unknown framebuffer target " << target << "\n";
+	}
+}
+
+void RenderState::SetDepthFunc(GLenum func)
+{
+	if (Changed(depthFunc, func))
+		gl.DepthFunc(func);
+}
+
+void RenderState::SetDepthMask(bool enabled)
+{
+	if (Changed(depthMask, enabled ? GL_TRUE : GL_FALSE))
+		gl.DepthMask(enabled ? GL_TRUE : GL_FALSE);
+}
+
+void RenderState::SetCullMode(GLenum mode)
+{
+	if (Changed(cullMode, mode))
+		gl.CullFace(mode);
+}
+
+void RenderState::SetBlendFunc(GLenum source, GLenum destination)
+{
+	if (blendSource == source && blendDestination == destination)
+	{
+		FrameStats.elided++;
+		return;
+	}
+	blendSource = source;
+	blendDestination = destination;
+	FrameStats.issued++;
+	gl.BlendFunc(source, destination);
+}
+
+void RenderState::SetViewport(int x, int y, int width, int height)
+{
+	if (viewport[0] == x && viewport[1] == y && viewport[2] == width && viewport[3] == height)
+	{
+		FrameStats.elided++;
+		return;
+	}
+	viewport[0] = x;
+	viewport[1] = y;
+	viewport[2] = width;
+	viewport[3] = height;
+	FrameStats.issued++;
+	gl.Viewport(x, y, width, height);
+}
+
+void RenderState::OnTextureDeleted(unsigned int texture)
+{
+	// Deleting a bound texture reverts its unit to texture 0
+	for (unsigned int unit = 0; unit < MAX_TEXTURE_UNITS; unit++)
+	{
+		for (unsigned int target = 0; target < TARGET_COUNT; target++)
+		{
+			if (textures[unit][target] == texture)
+				textures[unit][target] = 0;
+		}
+	}
+}
+
+void RenderState::OnVertexArrayDeleted(unsigned int vao)
+{
+	if (vertexArray == vao)
+		vertexArray = 0;
+}
+
+void RenderState::OnFramebufferDeleted(unsigned int framebuffer)
+{
+	if (readFramebuffer == framebuffer)
+		readFramebuffer = 0;
+	if (drawFramebuffer == framebuffer)
+		drawFramebuffer = 0;
+}
+
+void RenderState::SetCapability(Capability capability, bool enabled)
+{
+	static const GLenum capabilityEnums[CAPABILITY_COUNT] = { GL_DEPTH_TEST, GL_CULL_FACE, GL_BLEND };
+	if (!Changed(capabilities[capability], enabled ? 1u : 0u))
+		return;
+	if (enabled)
+		gl.Enable(capabilityEnums[capability]);
+	else
+		gl.Disable(capabilityEnums[capability]);
+}
+
+int RenderState::TargetIndex(GLenum target)
+{
+	switch (target)
+	{
+	case GL_TEXTURE_2D: return TARGET_2D;
+	case GL_TEXTURE_CUBE_MAP: return TARGET_CUBE_MAP;
+	case GL_TEXTURE_2D_MULTISAMPLE: return TARGET_2D_MULTISAMPLE;
+	case GL_TEXTURE_2D_ARRAY: return TARGET_2D_ARRAY;
+	case GL_TEXTURE_BUFFER: return TARGET_BUFFER;
+	default: return -1;
+	}
+}
@@ -0,0 +1,117 @@
+#pragma once
+#include <glad/glad.h>
+
+#include "GLExtensions.h"
+
+// The GL entry points the state cache forwards to, plus the ones draw
+// submission calls directly. Filling this with stubs lets the cache and
+// submission run without a context.
+struct GLFunctionTable
+{
+	PFNGLUSEPROGRAMPROC UseProgram;
+	PFNGLBINDVERTEXARRAYPROC BindVertexArray;
+	PFNGLACTIVETEXTUREPROC ActiveTexture;
+	PFNGLBINDTEXTUREPROC BindTexture;
+	PFNGLBINDFRAMEBUFFERPROC BindFramebuffer;
+	PFNGLENABLEPROC Enable;
+	PFNGLDISABLEPROC Disable;
+	PFNGLDEPTHFUNCPROC DepthFunc;
+	PFNGLDEPTHMASKPROC DepthMask;
+	PFNGLCULLFACEPROC CullFace;
+	PFNGLBLENDFUNCPROC BlendFunc;
+	PFNGLVIEWPORTPROC Viewport;
+
+	// Not cached, see RenderState::GL
+	PFNGLBINDBUFFERPROC BindBuffer;
+	PFNGLBINDBUFFERRANGEPROC BindBufferRange;
+	PFNGLMAPBUFFERRANGEPROC MapBufferRange;
+	PFNGLUNMAPBUFFERPROC UnmapBuffer;
+	PFNGLENABLEVERTEXATTRIBARRAYPROC EnableVertexAttribArray;
+	PFNGLDISABLEVERTEXATTRIBARRAYPROC DisableVertexAttribArray;
+	PFNGLVERTEXATTRIBPOINTERPROC VertexAttribPointer;
+	PFNGLVERTEXATTRIBDIVISORPROC VertexAttribDivisor;
+	PFNGLVERTEXATTRIB4FPROC VertexAttrib4f;
+	PFNGLDRAWELEMENTSPROC DrawElements;
+	PFNGLDRAWELEMENTSINSTANCEDPROC DrawElementsInstanced;
+	// Null unless GLExtensions::MultiDrawIndirect
+	PFNGLMULTIDRAWELEMENTSINDIRECTPROC MultiDrawElementsIndirect;
+
+	// Must be called after glad has loaded the context's entry points
+	static GLFunctionTable FromGlad();
+	// Every entry a no-op, for measuring CPU side submission cost
+	static GLFunctionTable Null();
+};
+
+// Shadows the bound GL state and drops calls that would not change it.
+// Anything that binds state directly behind the cache's back must call
+// Invalidate() afterwards.
+class RenderState
+{
+public:
+	static const unsigned int MAX_TEXTURE_UNITS = 16;
+
+	struct Stats
+	{
+		unsigned int issued = 0;
+		unsigned int elided = 0;
+		unsigned int textureBinds = 0;  // issued glBindTexture calls, also counted in issued
+	};
+	Stats FrameStats;
+
+	RenderState() {}
+	void Init(const GLFunctionTable & functions);
+	void Invalidate();
+	void ResetFrameStats();
+
+	void UseProgram(unsigned int program);
+	void BindVertexArray(unsigned int vao);
+	void BindTexture(unsigned int unit, GLenum target, unsigned int texture);
+	void BindFramebuffer(GLenum target, unsigned int framebuffer);
+
+	void SetDepthTest(bool enabled) { SetCapability(DEPTH_TEST, enabled); }
+	void SetCullFace(bool enabled) { SetCapability(CULL_FACE, enabled); }
+	void SetBlend(bool enabled) { SetCapability(BLEND, enabled); }
+	void SetDepthFunc(GLenum func);
+	void SetDepthMask(bool enabled);
+	void SetCullMode(GLenum mode);
+	void SetBlendFunc(GLenum source, GLenum destination);
+	void SetViewport(int x, int y, int width, int height);
+
+	// GL names are recycled, call these before deleting objects the cache may hold
+	void OnTextureDeleted(unsigned int texture);
+	void OnVertexArrayDeleted(unsigned int vao);
+	void OnFramebufferDeleted(unsigned int framebuffer);
+
+	// Entry points for draws, buffer uploads and vertex attributes, which
+	// the cache does not shadow
+	const GLFunctionTable & GL() const { return gl; }
+
+private:
+	enum Capability { DEPTH_TEST, CULL_FACE, BLEND, CAPABILITY_COUNT };
+	enum TextureTarget { TARGET_2D, TARGET_CUBE_MAP, TARGET_2D_MULTISAMPLE, TARGET_2D_ARRAY, TARGET_BUFFER, TARGET_COUNT };
+
+	// Sentinel for state we do not know, never equal to a real GL name or enum
+	static const unsigned int UNKNOWN = 0xFFFFFFFF;
+
+	GLFunctionTable gl = {};
+	unsigned int program = UNKNOWN;
+	unsigned int vertexArray = UNKNOWN;
+	unsigned int activeTexture = UNKNOWN;
+	unsigned int textures[MAX_TEXTURE_UNITS][TARGET_COUNT];
+	unsigned int readFramebuffer = UNKNOWN;
+	unsigned int drawFramebuffer = UNKNOWN;
+	unsigned int capabilities[CAPABILITY_COUNT];
+	unsigned int depthFunc = UNKNOWN;
+	unsigned int depthMask = UNKNOWN;
+	unsigned int cullMode = UNKNOWN;
+	unsigned int blendSource = UNKNOWN;
+	unsigned int blendDestination = UNKNOWN;
+	int viewport[4];
+
+	void SetCapability(Capability capability, bool enabled);
+	static int TargetIndex(GLenum target);
+	bool Changed(unsigned int & cached, unsigned int value);
+};
+
+// Shared state cache for the GL context owned by the main thread
+extern RenderState g_renderState;
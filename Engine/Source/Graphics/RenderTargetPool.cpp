@@ -0,0 +1,287 @@
+#include "RenderTargetPool.h"
+#include "RenderState.h"
+
+#include <algorithm>
+#include <iostream>
+
+namespace
+{
+	unsigned int BytesPerPixel(GLenum internalFormat)
+	{
+		switch (internalFormat)
+		{
+		case GL_R8: return 1;
+		case GL_RG8: case GL_R16F: case GL_DEPTH_COMPONENT16: return 2;
+		case GL_RGBA16F: case GL_RG32F: case GL_DEPTH32F_STENCIL8: return 8;
+		case GL_RGBA32F: return 16;
+		default: return 4;  // 8 bit RGB(A), packed formats, 24/32 bit depth
+		}
+	}
+
+	GLenum DepthAttachment(const RenderTextureDesc& desc)
+	{
+		GLenum format = desc.internalFormat;
+		return (format == GL_DEPTH24_STENCIL8 || format == GL_DEPTH32F_STENCIL8 || format == GL_DEPTH_STENCIL)
+			? GL_DEPTH_STENCIL_ATTACHMENT : GL_DEPTH_ATTACHMENT;
+	}
+}
+
+bool RenderTextureDesc::IsDepth() const
+{
+	switch (internalFormat)
+	{
+	case GL_DEPTH_COMPONENT: case GL_DEPTH_COMPONENT16: case GL_DEPTH_COMPONENT24: case GL_DEPTH_COMPONENT32:
+	case GL_DEPTH_COMPONENT32F: case GL_DEPTH_STENCIL: case GL_DEPTH24_STENCIL8: case GL_DEPTH32F_STENCIL8:
+		return true;
+	default:
+		return false;
+	}
+}
+
+unsigned int RenderTextureDesc::GetByteSize() const
+{
+	return static_cast<unsigned int>(width) * static_cast<unsigned int>(height) * BytesPerPixel(internalFormat) *
+		std::max(samples, 1) * std::max(layers, 1);
+}
+
+bool RenderTextureDesc::operator==(const RenderTextureDesc& other) const
+{
+	return width == other.width && height == other.height && internalFormat == other.internalFormat &&
+		samples == other.samples && layers == other.layers && filter == other.filter && wrap == other.wrap;
+}
+
+void RenderTargetPool::Destroy()
+{
+	for (Target& target : targets)
+	{
+		if (target.texture != 0)
+			FreeTarget(target);
+	}
+	targets.clear();
+	TargetCount = TargetBytes = 0;
+}
+
+void RenderTargetPool::BeginFrame()
+{
+	frame++;
+	for (Target& target : targets)
+		target.acquired = false;
+}
+
+void RenderTargetPool::EndFrame()
+{
+	TargetCount = 0;
+	TargetBytes = 0;
+	for (Target& target : targets)
+	{
+		if (target.texture == 0)
+			continue;
+		if (frame - target.lastUsedFrame > UNUSED_FRAMES)
+		{
+			FreeTarget(target);
+			continue;
+		}
+		TargetCount++;
+		TargetBytes += target.desc.GetByteSize();
+	}
+}
+
+unsigned int RenderTargetPool::Acquire(const RenderTextureDesc& desc)
+{
+	unsigned int empty = INVALID_TARGET;
+	for (unsigned int i = 0; i < targets.size(); i++)
+	{
+		if (targets[i].texture == 0)
+		{
+			empty = std::min(empty, i);
+			continue;
+		}
+		if (!targets[i].acquired && targets[i].desc == desc)
+		{
+			targets[i].acquired = true;
+			targets[i].lastUsedFrame = frame;
+			return i;
+		}
+	}
+
+	if (empty == INVALID_TARGET)
+	{
+		empty = static_cast<unsigned int>(targets.size());
+		targets.push_back(Target());
+	}
+	Target& target = targets[empty];
+	target.desc = desc;
+	target.texture = CreateTexture(desc);
+	target.acquired = true;
+	target.lastUsedFrame = frame;
+	Created++;
+	return empty;
+}
+
+void RenderTargetPool::Release(unsigned int target)
+{
+	targets[target].acquired = false;
+}
+
+void RenderTargetPool::FreeTarget(Target& target)
+{
+	// Framebuffers holding it go too
+	for (auto it = framebuffers.begin(); it != framebuffers.end();)
+	{
+		if (std::find(it->first.begin(), it->first.end(), target.texture) == it->first.end())
+		{
+			++it;
+			continue;
+		}
+		g_renderState.OnFramebufferDeleted(it->second);
+		glDeleteFramebuffers(1, &it->second);
+		it = framebuffers.erase(it);
+	}
+	for (auto it = layerFramebuffers.begin(); it != layerFramebuffers.end();)
+	{
+		if (it->first.first != target.texture)
+		{
+			++it;
+			continue;
+		}
+		g_renderState.OnFramebufferDeleted(it->second);
+		glDeleteFramebuffers(1, &it->second);
+		it = layerFramebuffers.erase(it);
+	}
+	g_renderState.OnTextureDeleted(target.texture);
+	glDeleteTextures(1, &target.texture);
+	target = Target();
+	Freed++;
+}
+
+unsigned int RenderTargetPool::GetFramebuffer(const std::vector<unsigned int>& attachments)
+{
+	// Key on GL names in attachment order, depth goes last
+	std::vector<unsigned int> colors, key;
+	unsigned int depth = INVALID_TARGET;
+	for (unsigned int index : attachments)
+	{
+		if (targets[index].desc.IsDepth())
+			depth = index;
+		else
+			colors.push_back(index);
+	}
+	for (unsigned int index : colors)
+		key.push_back(targets[index].texture);
+	key.push_back(depth == INVALID_TARGET ? 0 : targets[depth].texture);
+
+	auto found = framebuffers.find(key);
+	if (found != framebuffers.end())
+		return found->second;
+
+	unsigned int framebuffer;
+	glGenFramebuffers(1, &framebuffer);
+	g_renderState.BindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	std::vector<GLenum> drawBuffers;
+	for (unsigned int i = 0; i < colors.size(); i++)
+	{
+		const Target& texture = targets[colors[i]];
+		GLenum target = texture.desc.samples > 0 ? GL_TEXTURE_2D_MULTISAMPLE : GL_TEXTURE_2D;
+		if (texture.desc.layers > 0)
+			glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i, texture.texture, 0);
+		else
+			glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i, target, texture.texture, 0);
+		drawBuffers.push_back(GL_COLOR_ATTACHMENT0 + i);
+	}
+	if (depth != INVALID_TARGET)
+	{
+		const Target& texture = targets[depth];
+		GLenum target = texture.desc.samples > 0 ? GL_TEXTURE_2D_MULTISAMPLE : GL_TEXTURE_2D;
+		// Layered, clearing the framebuffer clears every layer
+		if (texture.desc.layers > 0)
+			glFramebufferTexture(GL_FRAMEBUFFER, DepthAttachment(texture.desc), texture.texture, 0);
+		else
+			glFramebufferTexture2D(GL_FRAMEBUFFER, DepthAttachment(texture.desc), target, texture.texture, 0);
+	}
+	if (drawBuffers.empty())
+	{
+		glDrawBuffer(GL_NONE);
+		glReadBuffer(GL_NONE);
+	}
+	else
+		glDrawBuffers(static_cast<GLsizei>(drawBuffers.size()), drawBuffers.data());
+
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+		std::cout << "Error::RenderTargetPool::Framebuffer is not complete\n";
+	framebuffers[key] = framebuffer;
+	return framebuffer;
+}
+
+unsigned int RenderTargetPool::GetLayerFramebuffer(unsigned int target, unsigned int layer)
+{
+	const Target& texture = targets[target];
+	std::pair<unsigned int, unsigned int> key(texture.texture, layer);
+	auto found = layerFramebuffers.find(key);
+	if (found != layerFramebuffers.end())
+		return found->second;
+
+	unsigned int framebuffer;
+	glGenFramebuffers(1, &framebuffer);
+	g_renderState.BindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	if (texture.desc.IsDepth())
+	{
+		glFramebufferTextureLayer(GL_FRAMEBUFFER, DepthAttachment(texture.desc), texture.texture, 0, layer);
+		glDrawBuffer(GL_NONE);
+		glReadBuffer(GL_NONE);
+	}
+	else
+		glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, texture.texture, 0, layer);
+
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+		std::cout << "Error::RenderTargetPool::Layer framebuffer is not complete\n";
+	layerFramebuffers[key] = framebuffer;
+	return framebuffer;
+}
+
+unsigned int RenderTargetPool::CreateTexture(const RenderTextureDesc& desc)
+{
+	unsigned int texture;
+	glGenTextures(1, &texture);
+	if (desc.samples > 0)
+	{
+		glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, texture);
+		glTexImage2DMultisample(GL_TEXTURE_2D_MULTISAMPLE, desc.samples, desc.internalFormat, desc.width, desc.height, GL_TRUE);
+		glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, 0);
+	}
+	else
+	{
+		GLenum format = GL_RGBA, type = GL_UNSIGNED_BYTE;
+		if (desc.internalFormat == GL_DEPTH24_STENCIL8 || desc.internalFormat == GL_DEPTH_STENCIL)
+		{
+			format = GL_DEPTH_STENCIL;
+			type = GL_UNSIGNED_INT_24_8;
+		}
+		else if (desc.IsDepth())
+		{
+			format = GL_DEPTH_COMPONENT;
+			type = GL_FLOAT;
+		}
+		else if (BytesPerPixel(desc.internalFormat) > 4)
+			type = GL_FLOAT;
+
+		GLenum target = desc.layers > 0 ? GL_TEXTURE_2D_ARRAY : GL_TEXTURE_2D;
+		glBindTexture(target, texture);
+		if (desc.layers > 0)
+			glTexImage3D(target, 0, desc.internalFormat, desc.width, desc.height, desc.layers, 0, format, type, NULL);
+		else
+			glTexImage2D(target, 0, desc.internalFormat, desc.width, desc.height, 0, format, type, NULL);
+		glTexParameteri(target, GL_TEXTURE_MIN_FILTER, desc.filter);
+		glTexParameteri(target, GL_TEXTURE_MAG_FILTER, desc.filter);
+		glTexParameteri(target, GL_TEXTURE_WRAP_S, desc.wrap);
+		glTexParameteri(target, GL_TEXTURE_WRAP_T, desc.wrap);
+		if (desc.wrap == GL_CLAMP_TO_BORDER)
+		{
+			float borderColor[] = { 1.0f, 1.0f, 1.0f, 1.0f };
+			glTexParameterfv(target, GL_TEXTURE_BORDER_COLOR, borderColor);
+		}
+		glBindTexture(target, 0);
+	}
+	// Bound behind the cache's back
+	g_renderState.Invalidate();
+	return texture;
+}
@@ -0,0 +1,75 @@
+#pragma once
+#include <glad/glad.h>
+
+#include <map>
+#include <vector>
+
+struct RenderTextureDesc
+{
+	int width = 0;
+	int height = 0;
+	GLenum internalFormat = GL_RGBA8;
+	int samples = 0;  // 0 is a regular 2D texture
+	int layers = 0;   // above 0 a 2D array texture, attached with every layer
+	GLenum filter = GL_LINEAR;
+	GLenum wrap = GL_CLAMP_TO_EDGE;  // GL_CLAMP_TO_BORDER borders are white
+
+	bool IsDepth() const;
+	unsigned int GetByteSize() const;
+	bool operator==(const RenderTextureDesc& other) const;
+};
+
+// Render targets keyed by their description. Acquire hands out a released
+// target with an equal description or creates one, Release makes it available
+// again within the frame. BeginFrame releases everything, targets nobody
+// acquired for UNUSED_FRAMES frames are deleted by EndFrame together with the
+// framebuffers built from them, so a resize recreates targets lazily and the
+// old size ages out.
+class RenderTargetPool
+{
+public:
+	static const unsigned int UNUSED_FRAMES = 30;
+	static const unsigned int INVALID_TARGET = 0xFFFFFFFF;
+
+	RenderTargetPool() {}
+	~RenderTargetPool() { Destroy(); }
+	void Destroy();
+
+	void BeginFrame();
+	void EndFrame();
+
+	unsigned int Acquire(const RenderTextureDesc& desc);
+	void Release(unsigned int target);
+
+	unsigned int GetTexture(unsigned int target) const { return targets[target].texture; }
+	const RenderTextureDesc& GetDesc(unsigned int target) const { return targets[target].desc; }
+	// Framebuffer with the targets attached in order, depth formats go to the depth attachment
+	unsigned int GetFramebuffer(const std::vector<unsigned int>& attachments);
+	// Framebuffer with only one layer of an array target attached
+	unsigned int GetLayerFramebuffer(unsigned int target, unsigned int layer);
+
+	unsigned int TargetCount = 0;
+	unsigned int TargetBytes = 0;
+	// Totals since startup
+	unsigned int Created = 0;
+	unsigned int Freed = 0;
+
+private:
+	struct Target
+	{
+		RenderTextureDesc desc;
+		unsigned int texture = 0;  // 0 marks a free slot
+		unsigned int lastUsedFrame = 0;
+		bool acquired = false;
+	};
+
+	std::vector<Target> targets;
+	// Attachment textures, depth last, to framebuffer
+	std::map<std::vector<unsigned int>, unsigned int> framebuffers;
+	// Array texture and layer to framebuffer
+	std::map<std::pair<unsigned int, unsigned int>, unsigned int> layerFramebuffers;
+	unsigned int frame = 0;
+
+	void FreeTarget(Target& target);
+	static unsigned int CreateTexture(const RenderTextureDesc& desc);
+};
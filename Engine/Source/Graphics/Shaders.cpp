@@ -1,17 +1,35 @@
 #include "Shaders.h"
 
-Shader::Shader(const char * vertexPath, const char * fragmentPath, const char * geometryPath)
+#include <cstring>
+
+Shader::UniformStats Shader::FrameStats;
+unsigned int Shader::s_boundProgram = 0;
+
+// #version has to stay the first statement, so defines go on the line after it
+static void InsertDefines(std::string & code, const char * defines)
+{
+	if (!defines || !*defines || code.empty())
+		return;
+	size_t version = code.find("#version");
+	size_t lineEnd = version == std::string::npos ? std::string::npos : code.find('\n', version);
+	if (lineEnd == std::string::npos)
+		code.insert(0, defines);
+	else
+		code.insert(lineEnd + 1, defines);
+}
+
+Shader::Shader(const char * vertexPath, const char * fragmentPath, const char * geometryPath, const char * defines)
 {
-	LoadAndCompile(vertexPath, fragmentPath, geometryPath);
+	LoadAndCompile(vertexPath, fragmentPath, geometryPath, defines);
 
 }
 
-void Shader::Init(const char * vertexPath, const char * fragmentPath, const char * geometryPath)
+void Shader::Init(const char * vertexPath, const char * fragmentPath, const char * geometryPath, const char * defines)
 {
-	LoadAndCompile(vertexPath, fragmentPath, geometryPath);
+	LoadAndCompile(vertexPath, fragmentPath, geometryPath, defines);
 }
 
-void Shader::LoadAndCompile(const char * vertexPath, const char * fragmentPath, const char * geometryPath)
+void Shader::LoadAndCompile(const char * vertexPath, const char * fragmentPath, const char * geometryPath, const char * defines)
 {
 	// 1. Retrieve the vertex/fragment information source code from filepath
 	std::string vertexCode;
@@ -55,6 +73,10 @@ void Shader::LoadAndCompile(const char * vertexPath, const char * fragmentPath,
 		std::cout << "Error::Shader::Failed to read shader from file: " << e.what() << "\n";
 
 	}
+	InsertDefines(vertexCode, defines);
+	InsertDefines(fragmentCode, defines);
+	InsertDefines(geometryCode, defines);
+
 	const char * vertShaderCode = vertexCode.c_str();
 	const char * fragShaderCode = fragmentCode.c_str();
 	const char * geomShaderCode = geometryCode.c_str();
@@ -99,6 +121,7 @@ void Shader::LoadAndCompile(const char * vertexPath, const char * fragmentPath,
 	}
 
 	// 3. Create shader program
+	uniformCache.clear();
 	ProgramID = glCreateProgram();
 	glAttachShader(ProgramID, vertex);
 	glAttachShader(ProgramID, fragment);
@@ -112,6 +135,16 @@ void Shader::LoadAndCompile(const char * vertexPath, const char * fragmentPath,
 		std::cout << "Error::Shader::Program::Failed to link shaders\n" << infoLog << "\n";
 	}
 
+	// GLSL 330 has no binding layout qualifier, so wire the shared blocks up here
+	BindUniformBlock("FrameData", FRAME_BLOCK_BINDING);
+	BindUniformBlock("PassData", PASS_BLOCK_BINDING);
+	BindUniformBlock("PostProcessData", PASS_BLOCK_BINDING);
+	BindUniformBlock("DeferredData", PASS_BLOCK_BINDING);
+	BindUniformBlock("MaterialData", MATERIAL_BLOCK_BINDING);
+	BindUniformBlock("ObjectData", OBJECT_BLOCK_BINDING);
+	BindUniformBlock("LightData", LIGHT_BLOCK_BINDING);
+	BindUniformBlock("MaterialTextureData", TEXTURE_BLOCK_BINDING);
+
 	glDeleteShader(vertex);
 	glDeleteShader(fragment);
 	if (geometryPath != "")
@@ -123,70 +156,109 @@ Shader::~Shader()
 	glDeleteProgram(ProgramID);
 }
 
-void Shader::Use()
+void Shader::Use() const
+{
+	Use(g_renderState);
+}
+
+void Shader::Use(RenderState & state) const
 {
-	glUseProgram(ProgramID);
+	state.UseProgram(ProgramID);
+	if (&state == &g_renderState)
+		s_boundProgram = ProgramID;
+}
+
+void Shader::BindUniformBlock(const char * blockName, UniformBlockBinding binding) const
+{
+	unsigned int blockIndex = glGetUniformBlockIndex(ProgramID, blockName);
+	if (blockIndex != GL_INVALID_INDEX)
+		glUniformBlockBinding(ProgramID, blockIndex, binding);
+}
+
+void Shader::ResetFrameStats()
+{
+	FrameStats = UniformStats();
+	// Other code (ImGui) binds programs behind our back between frames
+	s_boundProgram = 0;
+}
+
+int Shader::CacheUniform(const std::string & name, const void * value, unsigned int size) const
+{
+	// Uniform setters act on the bound program, so only shadow values when we are it
+	if (ProgramID != s_boundProgram)
+	{
+		FrameStats.issued++;
+		return glGetUniformLocation(ProgramID, name.c_str());
+	}
+
+	auto it = uniformCache.find(name);
+	if (it == uniformCache.end())
+	{
+		UniformSlot slot;
+		slot.location = glGetUniformLocation(ProgramID, name.c_str());
+		it = uniformCache.emplace(name, slot).first;
+	}
+	UniformSlot& slot = it->second;
+
+	// Inactive uniform, the GL call would be a no-op anyway
+	if (slot.location == -1)
+	{
+		FrameStats.inactive++;
+		return -1;
+	}
+	if (slot.size == size && std::memcmp(slot.value, value, size) == 0)
+	{
+		FrameStats.skipped++;
+		return -1;
+	}
+
+	std::memcpy(slot.value, value, size);
+	slot.size = size;
+	FrameStats.issued++;
+	return slot.location;
 }
 
 void Shader::SetBool(const std::string & name, bool value) const
 {
-	glUniform1i(glGetUniformLocation(ProgramID, name.c_str()), static_cast<int>(value));
+	SetInt(name, static_cast<int>(value));
 }
 
 void Shader::SetInt(const std::string & name, int value) const
 {
-	glUniform1i(glGetUniformLocation(ProgramID, name.c_str()), value);
+	int location = CacheUniform(name, &value, sizeof(value));
+	if (location != -1)
+		glUniform1i(location, value);
 }
 
 void Shader::SetFloat(const std::string & name, float value) const
 {
-	glUniform1f(glGetUniformLocation(ProgramID, name.c_str()), value);
+	int location = CacheUniform(name, &value, sizeof(value));
+	if (location != -1)
+		glUniform1f(location, value);
 }
 
 void Shader::SetMat4(const std::string & name, glm::mat4 value) const 
 {
-	glUniformMatrix4fv(glGetUniformLocation(ProgramID, name.c_str()), 1, GL_FALSE, glm::value_ptr(value));
+	int location = CacheUniform(name, glm::value_ptr(value), sizeof(value));
+	if (location != -1)
+		glUniformMatrix4fv(location, 1, GL_FALSE, glm::value_ptr(value));
 }
 
 void Shader::SetVec3(const std::string & name, float x, float y, float z) const
 {
-	glUniform3f(glGetUniformLocation(ProgramID, name.c_str()), x, y, z);
+	SetVec3(name, glm::vec3(x, y, z));
 }
 
 void Shader::SetVec3(const std::string & name, glm::vec3 value) const
 {
-	glUniform3fv(glGetUniformLocation(ProgramID, name.c_str()), 1, glm::value_ptr(value));
-}
-
-void Shader::SetPointLight(const std::string & name, PointLight light)
-{
-	this->SetVec3(name + ".position", light.position);
-	this->SetFloat(name + ".constant", light.constant);
-	this->SetFloat(name + ".linear", light.linear);
-	this->SetFloat(name + ".quadtratic", light.quadratic);
-	this->SetVec3(name + ".ambient", light.ambient);
-	this->SetVec3(name + ".diffuse", light.diffuse);
-	this->SetVec3(name + ".specular", light.specular);
+	int location = CacheUniform(name, glm::value_ptr(value), sizeof(value));
+	if (location != -1)
+		glUniform3fv(location, 1, glm::value_ptr(value));
 }
 
-void Shader::SetDirectionalLight(const std::string & name, DirectionalLight light)
+void Shader::SetVec4(const std::string & name, glm::vec4 value) const
 {
-	this->SetVec3(name + ".direction", light.direction);
-	this->SetVec3(name + ".ambient", light.ambient);
-	this->SetVec3(name + ".diffuse", light.diffuse);
-	this->SetVec3(name + ".specular", light.specular);
+	int location = CacheUniform(name, glm::value_ptr(value), sizeof(value));
+	if (location != -1)
+		glUniform4fv(location, 1, glm::value_ptr(value));
 }
-
-void Shader::SetSpotLight(const std::string & name, SpotLight light)
-{
-	this->SetVec3(name + ".position", light.position);
-	this->SetVec3(name + ".direction", light.direction);
-	this->SetFloat(name + ".innerCutOff", light.innerCutOff);
-	this->SetFloat(name + ".outerCutOff", light.outerCutOff);
-	this->SetVec3(name + ".ambient", light.ambient);
-	this->SetVec3(name + ".diffuse", light.diffuse);
-	this->SetVec3(name + ".specular", light.specular);
-	this->SetFloat(name + ".constant", light.constant);
-	this->SetFloat(name + ".linear", light.linear);
-	this->SetFloat(name + ".quadratic", light.quadratic);
-}
\ No newline at end of file
@@ -7,27 +7,35 @@
 #include <glm/gtc/type_ptr.hpp>
 
 #include <string>
+#include <unordered_map>
 #include <fstream>
 #include <sstream>
 #include <iostream>
 
-#include "..\Objects\Lights\Lights.h"
+#include "UniformBuffer.h"
+#include "RenderState.h"
 
 class Shader
 {
 public:
 	unsigned int ProgramID;
 
-	// Constructor reads and builds the shader
-	Shader(const char * vertexPath, const char * fragmentPath, const char * geometryPath = "");
+	// Constructor reads and builds the shader. Defines, e.g. "#define DEPTH_ONLY\n",
+	// are inserted after the #version line of every stage to build variants.
+	Shader(const char * vertexPath, const char * fragmentPath, const char * geometryPath = "", const char * defines = "");
 	Shader() {}
 	~Shader();
 
-	void Init(const char * vertexPath, const char * fragmentPath, const char * geometryPath = "");
-	void LoadAndCompile(const char * vertexPath, const char * fragmentPath, const char * geometryPath = "");
+	void Init(const char * vertexPath, const char * fragmentPath, const char * geometryPath = "", const char * defines = "");
+	void LoadAndCompile(const char * vertexPath, const char * fragmentPath, const char * geometryPath = "", const char * defines = "");
 
 	// Use/Activate the shader
-	void Use();
+	void Use() const;
+	// Binds through state, only g_renderState counts as binding for the uniform cache
+	void Use(RenderState & state) const;
+
+	// Attaches a uniform block to one of the shared binding points, no-op if the block is unused
+	void BindUniformBlock(const char * blockName, UniformBlockBinding binding) const;
 
 	// Utility Functions
 	void SetBool(const std::string & name, bool value) const;
@@ -36,10 +44,33 @@ public:
 	void SetMat4(const std::string & name, glm::mat4 value) const;
 	void SetVec3(const std::string & name, float x, float y, float z) const;
 	void SetVec3(const std::string & name, glm::vec3 value) const;
+	void SetVec4(const std::string & name, glm::vec4 value) const;
+
+	// Uniform upload statistics, reset once per frame
+	struct UniformStats
+	{
+		unsigned int issued = 0;
+		unsigned int skipped = 0;   // value unchanged since the last upload
+		unsigned int inactive = 0;  // name has no location in the program
+	};
+	static UniformStats FrameStats;
+	static void ResetFrameStats();
+
+private:
+	// Shadow copy of the last value written to a uniform of this program
+	struct UniformSlot
+	{
+		int location = -1;
+		unsigned int size = 0;
+		unsigned char value[sizeof(glm::mat4)];
+	};
+	mutable std::unordered_map<std::string, UniformSlot> uniformCache;
+
+	// Program last bound through Use(), uploads to any other program bypass the cache
+	static unsigned int s_boundProgram;
 
-	void SetPointLight(const std::string & name, PointLight light);
-	void SetDirectionalLight(const std::string & name, DirectionalLight light);
-	void SetSpotLight(const std::string & name, SpotLight light);
+	// Returns the uniform location if the upload must be issued, -1 if it can be skipped
+	int CacheUniform(const std::string & name, const void * value, unsigned int size) const;
 };
 
 #endif
\ No newline at end of file
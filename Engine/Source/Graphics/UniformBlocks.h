@@ -0,0 +1,107 @@
+#pragma once
+#include <glm/glm.hpp>
+
+#include "..\Objects\Lights\Lights.h"
+
+// CPU mirrors of the std140 uniform blocks declared in the shaders.
+// A vec3 followed by a float packs into one 16 byte slot, every block
+// is padded to a multiple of 16 bytes.
+
+// binding = FRAME_BLOCK_BINDING
+struct FrameBlock
+{
+	glm::mat4 projection;
+	glm::mat4 view;
+	glm::vec3 viewPos;
+	float time;
+};
+
+// binding = PASS_BLOCK_BINDING
+struct PassBlock
+{
+	glm::mat4 lightSpaceMatrix;
+};
+
+// binding = PASS_BLOCK_BINDING, post process pass only
+struct PostProcessBlock
+{
+	float filmgrainEnabled;
+	float grainStrength;
+	float vignetteEnabled;
+	float vignetteInnerRadius;
+	float vignetteOuterRadius;
+	float vignetteOpacity;
+	float nearPlane;
+	float farPlane;
+};
+
+// binding = PASS_BLOCK_BINDING, deferred lighting pass only
+struct DeferredBlock
+{
+	glm::mat4 inverseViewProjection;
+};
+
+// binding = MATERIAL_BLOCK_BINDING
+// Per material parameters are fetched from g_materials' buffer, see Materials.h
+struct MaterialBlock
+{
+	float heightScale;
+	float padding[3];
+};
+
+// binding = OBJECT_BLOCK_BINDING
+struct ObjectBlock
+{
+	glm::mat4 model;
+	// Material ID in x, see Materials.h
+	glm::uvec4 material;
+};
+
+// binding = TEXTURE_BLOCK_BINDING, bindless material textures only
+struct MaterialTextureBlock
+{
+	static const unsigned int MAX_ARRAYS = 64;
+	glm::uvec4 arrayHandles[MAX_ARRAYS];  // 64 bit handle in xy
+};
+
+struct GPUDirectionalLight
+{
+	glm::vec3 direction;
+	float padding0;
+	glm::vec3 ambient;
+	float padding1;
+	glm::vec3 diffuse;
+	float padding2;
+	glm::vec3 specular;
+	float padding3;
+
+	GPUDirectionalLight() {}
+	GPUDirectionalLight(const DirectionalLight & light)
+		: direction(light.direction), padding0(0.0f), ambient(light.ambient), padding1(0.0f),
+		diffuse(light.diffuse), padding2(0.0f), specular(light.specular), padding3(0.0f) {}
+};
+
+// binding = LIGHT_BLOCK_BINDING
+// Point and spot lights are fetched from LightManager's texture buffers
+struct LightBlock
+{
+	GPUDirectionalLight dirLight;
+	int numPointLights;
+	int numSpotLights;
+	int padding[2];
+	// Clustered variant only, see LightClusters.h
+	glm::vec4 clusterGrid;       // tiles x, tiles y, depth slices, attenuation cutoff
+	glm::vec4 clusterDepth;      // near plane, far plane, slice scale, slice bias
+	glm::vec4 clusterTileScale;  // tiles per pixel in x and y
+	// Directional light shadows, see ShadowCascades.h
+	glm::mat4 cascadeMatrices[4];
+	glm::vec4 cascadeSplits;     // view depth where each cascade ends
+	glm::vec4 cascadeParams;     // cascade count, cascade tint on/off
+};
+
+static_assert(sizeof(FrameBlock) % 16 == 0, "FrameBlock must match std140 layout");
+static_assert(sizeof(PostProcessBlock) % 16 == 0, "PostProcessBlock must match std140 layout");
+static_assert(sizeof(MaterialBlock) % 16 == 0, "MaterialBlock must match std140 layout");
+static_assert(sizeof(ObjectBlock) % 16 == 0, "ObjectBlock must match std140 layout");
+static_assert(sizeof(GPUDirectionalLight) == 64, "GPUDirectionalLight must match std140 layout");
+static_assert(sizeof(LightBlock) % 16 == 0, "LightBlock must match std140 layout");
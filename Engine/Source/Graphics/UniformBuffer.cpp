@@ -0,0 +1,68 @@
+#include "UniformBuffer.h"
+
+#include <cstring>
+
+void UniformRingBuffer::Init(unsigned int bytesPerFrame, RenderState & submitState)
+{
+	state = &submitState;
+	int offsetAlignment = 256;
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &offsetAlignment);
+	buffer.Init(GL_UNIFORM_BUFFER, bytesPerFrame, static_cast<unsigned int>(offsetAlignment), submitState);
+}
+
+void UniformRingBuffer::Destroy()
+{
+	buffer.Destroy();
+}
+
+void UniformRingBuffer::BeginFrame()
+{
+	buffer.BeginFrame();
+	FenceWaitMs = buffer.FenceWaitMs;
+	blockCount = 0;
+}
+
+void UniformRingBuffer::EndFrame()
+{
+	buffer.EndFrame();
+	BytesUsed = buffer.BytesUsed;
+	BlocksPushed = blockCount;
+}
+
+UniformAllocation UniformRingBuffer::Push(const void * data, unsigned int size)
+{
+	UniformAllocation allocation;
+	allocation.offset = buffer.Write(data, size);
+	allocation.buffer = buffer.GetBufferID();
+	allocation.size = size;
+	blockCount++;
+	return allocation;
+}
+
+UniformArrayAllocation UniformRingBuffer::PushArray(const void * data, unsigned int size, unsigned int count)
+{
+	UniformArrayAllocation allocation;
+	if (count == 0)
+		return allocation;
+
+	unsigned int alignment = buffer.GetAlignment();
+	unsigned int stride = (size + alignment - 1) / alignment * alignment;
+	arrayScratch.resize(stride * count);
+	const unsigned char * source = static_cast<const unsigned char *>(data);
+	for (unsigned int i = 0; i < count; i++)
+		std::memcpy(arrayScratch.data() + i * stride, source + i * size, size);
+
+	allocation.offset = buffer.Write(arrayScratch.data(), stride * count);
+	allocation.buffer = buffer.GetBufferID();
+	allocation.size = size;
+	allocation.stride = stride;
+	blockCount += count;
+	return allocation;
+}
+
+void UniformRingBuffer::Bind(UniformBlockBinding binding, const UniformAllocation & allocation)
+{
+	if (buffer.HasPendingWrites())
+		buffer.Flush();
+	state->GL().BindBufferRange(GL_UNIFORM_BUFFER, binding, allocation.buffer, allocation.offset, allocation.size);
+}
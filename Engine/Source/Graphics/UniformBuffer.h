@@ -0,0 +1,83 @@
+#pragma once
+#include <glad/glad.h>
+
+#include <vector>
+
+#include "DynamicBuffer.h"
+
+// Binding points shared by every shader, see Shader::LoadAndCompile
+enum UniformBlockBinding
+{
+	FRAME_BLOCK_BINDING = 0,
+	PASS_BLOCK_BINDING = 1,
+	MATERIAL_BLOCK_BINDING = 2,
+	OBJECT_BLOCK_BINDING = 3,
+	LIGHT_BLOCK_BINDING = 4,
+	TEXTURE_BLOCK_BINDING = 5
+};
+
+struct UniformAllocation
+{
+	unsigned int buffer = 0;
+	unsigned int offset = 0;
+	unsigned int size = 0;
+};
+
+// Blocks written together by PushArray, each on its own aligned offset
+struct UniformArrayAllocation
+{
+	unsigned int buffer = 0;
+	unsigned int offset = 0;
+	unsigned int size = 0;
+	unsigned int stride = 0;
+
+	UniformAllocation operator[](unsigned int index) const
+	{
+		UniformAllocation allocation;
+		allocation.buffer = buffer;
+		allocation.offset = offset + index * stride;
+		allocation.size = size;
+		return allocation;
+	}
+};
+
+// Streams std140 uniform blocks through a DynamicBuffer, aligned to the
+// driver's uniform buffer offset alignment so every block can be bound with
+// glBindBufferRange. A frame pushing more than its region grows the buffer,
+// each allocation keeps the buffer it was written to so blocks pushed before
+// stay bindable. Pushes are uploaded together by the next Bind, so a pass
+// should push its blocks before binding any of them.
+class UniformRingBuffer
+{
+public:
+	UniformRingBuffer() {}
+	// Binds and uploads go through state
+	void Init(unsigned int bytesPerFrame, RenderState & state = g_renderState);
+	void Destroy();
+
+	void BeginFrame();
+	void EndFrame();
+
+	UniformAllocation Push(const void * data, unsigned int size);
+	template<typename T>
+	UniformAllocation Push(const T & block) { return Push(&block, sizeof(T)); }
+	// Writes count blocks of size bytes each with one Write, padding every
+	// block out to the offset alignment
+	UniformArrayAllocation PushArray(const void * data, unsigned int size, unsigned int count);
+	template<typename T>
+	UniformArrayAllocation PushArray(const T * blocks, unsigned int count) { return PushArray(blocks, sizeof(T), count); }
+
+	// Flushes pending pushes first
+	void Bind(UniformBlockBinding binding, const UniformAllocation & allocation);
+
+	// Statistics for the last completed frame
+	unsigned int BytesUsed = 0;
+	unsigned int BlocksPushed = 0;
+	double FenceWaitMs = 0.0;
+
+private:
+	DynamicBuffer buffer;
+	RenderState * state = &g_renderState;
+	unsigned int blockCount = 0;
+	std::vector<unsigned char> arrayScratch;
+};
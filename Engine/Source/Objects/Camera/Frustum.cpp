@@ -0,0 +1,162 @@
+#include "Frustum.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <emmintrin.h>
+
+void AABBArray::Clear()
+{
+	centerX.clear(); centerY.clear(); centerZ.clear();
+	extentX.clear(); extentY.clear(); extentZ.clear();
+}
+
+void AABBArray::Add(const AABB& box)
+{
+	glm::vec3 center = box.Center();
+	glm::vec3 extents = box.Extents();
+	centerX.push_back(center.x); centerY.push_back(center.y); centerZ.push_back(center.z);
+	extentX.push_back(extents.x); extentY.push_back(extents.y); extentZ.push_back(extents.z);
+}
+
+void AABBArray::Append(const AABBArray& other)
+{
+	centerX.insert(centerX.end(), other.centerX.begin(), other.centerX.end());
+	centerY.insert(centerY.end(), other.centerY.begin(), other.centerY.end());
+	centerZ.insert(centerZ.end(), other.centerZ.begin(), other.centerZ.end());
+	extentX.insert(extentX.end(), other.extentX.begin(), other.extentX.end());
+	extentY.insert(extentY.end(), other.extentY.begin(), other.extentY.end());
+	extentZ.insert(extentZ.end(), other.extentZ.begin(), other.extentZ.end());
+}
+
+void Frustum::Extract(const glm::mat4& viewProjection)
+{
+	// Rows of the matrix, glm is column major
+	glm::vec4 row0(viewProjection[0][0], viewProjection[1][0], viewProjection[2][0], viewProjection[3][0]);
+	glm::vec4 row1(viewProjection[0][1], viewProjection[1][1], viewProjection[2][1], viewProjection[3][1]);
+	glm::vec4 row2(viewProjection[0][2], viewProjection[1][2], viewProjection[2][2], viewProjection[3][2]);
+	glm::vec4 row3(viewProjection[0][3], viewProjection[1][3], viewProjection[2][3], viewProjection[3][3]);
+
+	planes[LEFT_PLANE] = row3 + row0;
+	planes[RIGHT_PLANE] = row3 - row0;
+	planes[BOTTOM_PLANE] = row3 + row1;
+	planes[TOP_PLANE] = row3 - row1;
+	planes[NEAR_PLANE] = row3 + row2;
+	planes[FAR_PLANE] = row3 - row2;
+
+	for (glm::vec4& plane : planes)
+		plane /= glm::length(glm::vec3(plane));
+}
+
+bool Frustum::TestSphere(const BoundingSphere& sphere) const
+{
+	for (const glm::vec4& plane : planes)
+	{
+		if (glm::dot(glm::vec3(plane), sphere.center) + plane.w < -sphere.radius)
+			return false;
+	}
+	return true;
+}
+
+bool Frustum::TestAABB(const AABB& box) const
+{
+	glm::vec3 center = box.Center();
+	glm::vec3 extents = box.Extents();
+	for (const glm::vec4& plane : planes)
+	{
+		float distance = glm::dot(glm::vec3(plane), center) + plane.w;
+		float radius = glm::dot(glm::abs(glm::vec3(plane)), extents);
+		if (distance < -radius)
+			return false;
+	}
+	return true;
+}
+
+unsigned int Frustum::CullAABBs(const AABBArray& boxes, std::vector<unsigned char>& visible) const
+{
+	unsigned int count = boxes.Size();
+	visible.resize(count);
+
+	// Planes splatted once, absolute normals give the box's projected radius
+	__m128 nx[6], ny[6], nz[6], nw[6], ax[6], ay[6], az[6];
+	for (unsigned int p = 0; p < 6; p++)
+	{
+		nx[p] = _mm_set1_ps(planes[p].x);
+		ny[p] = _mm_set1_ps(planes[p].y);
+		nz[p] = _mm_set1_ps(planes[p].z);
+		nw[p] = _mm_set1_ps(planes[p].w);
+		ax[p] = _mm_set1_ps(std::fabs(planes[p].x));
+		ay[p] = _mm_set1_ps(std::fabs(planes[p].y));
+		az[p] = _mm_set1_ps(std::fabs(planes[p].z));
+	}
+
+	unsigned int visibleCount = 0;
+	unsigned int i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 cx = _mm_loadu_ps(&boxes.centerX[i]);
+		__m128 cy = _mm_loadu_ps(&boxes.centerY[i]);
+		__m128 cz = _mm_loadu_ps(&boxes.centerZ[i]);
+		__m128 ex = _mm_loadu_ps(&boxes.extentX[i]);
+		__m128 ey = _mm_loadu_ps(&boxes.extentY[i]);
+		__m128 ez = _mm_loadu_ps(&boxes.extentZ[i]);
+
+		// Inside while distance + radius >= 0 for every plane
+		__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+		for (unsigned int p = 0; p < 6; p++)
+		{
+			__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx[p], cx), _mm_mul_ps(ny[p], cy)),
+				_mm_add_ps(_mm_mul_ps(nz[p], cz), nw[p]));
+			__m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax[p], ex), _mm_mul_ps(ay[p], ey)), _mm_mul_ps(az[p], ez));
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(distance, radius), _mm_setzero_ps()));
+		}
+
+		int mask = _mm_movemask_ps(inside);
+		for (unsigned int lane = 0; lane < 4; lane++)
+		{
+			visible[i + lane] = (mask >> lane) & 1;
+			visibleCount += visible[i + lane];
+		}
+	}
+
+	for (; i < count; i++)
+	{
+		AABB box;
+		glm::vec3 center(boxes.centerX[i], boxes.centerY[i], boxes.centerZ[i]);
+		glm::vec3 extents(boxes.extentX[i], boxes.extentY[i], boxes.extentZ[i]);
+		box.min = center - extents;
+		box.max = center + extents;
+		visible[i] = TestAABB(box) ? 1 : 0;
+		visibleCount += visible[i];
+	}
+	return visibleCount;
+}
+
+double Frustum::BenchmarkCull(unsigned int count, unsigned int& visibleCount)
+{
+	std::mt19937 random(1234);
+	std::uniform_real_distribution<float> positions(-200.0f, 200.0f);
+	std::uniform_real_distribution<float> sizes(0.1f, 2.0f);
+
+	AABBArray boxes;
+	for (unsigned int i = 0; i < count; i++)
+	{
+		glm::vec3 center(positions(random), positions(random), positions(random));
+		glm::vec3 extents(sizes(random));
+		AABB box;
+		box.min = center - extents;
+		box.max = center + extents;
+		boxes.Add(box);
+	}
+
+	glm::mat4 projection = glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.1f, 100.0f);
+	glm::mat4 view = glm::lookAt(glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+	Frustum frustum(projection * view);
+	std::vector<unsigned char> visible;
+
+	auto start = std::chrono::high_resolution_clock::now();
+	visibleCount = frustum.CullAABBs(boxes, visible);
+	return std::chrono::duration<double, std::micro>(std::chrono::high_resolution_clock::now() - start).count();
+}
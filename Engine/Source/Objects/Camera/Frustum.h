@@ -0,0 +1,41 @@
+#pragma once
+#include <glm/glm.hpp>
+
+#include <vector>
+
+#include "..\Geometry\Bounds.h"
+
+// World space boxes as separate center and extent channels, the layout the
+// batch cull reads four boxes at a time.
+struct AABBArray
+{
+	std::vector<float> centerX, centerY, centerZ;
+	std::vector<float> extentX, extentY, extentZ;
+
+	void Clear();
+	void Add(const AABB& box);
+	void Append(const AABBArray& other);
+	unsigned int Size() const { return static_cast<unsigned int>(centerX.size()); }
+};
+
+// Six planes extracted from a view-projection matrix (Gribb/Hartmann), normals
+// point inwards so a point is inside when every plane distance is positive.
+class Frustum
+{
+public:
+	enum Plane { LEFT_PLANE = 0, RIGHT_PLANE, BOTTOM_PLANE, TOP_PLANE, NEAR_PLANE, FAR_PLANE };
+	glm::vec4 planes[6];
+
+	Frustum() {}
+	explicit Frustum(const glm::mat4& viewProjection) { Extract(viewProjection); }
+	void Extract(const glm::mat4& viewProjection);
+
+	bool TestSphere(const BoundingSphere& sphere) const;
+	bool TestAABB(const AABB& box) const;
+
+	// Writes 1 for boxes touching the frustum and 0 otherwise, returns the visible count
+	unsigned int CullAABBs(const AABBArray& boxes, std::vector<unsigned char>& visible) const;
+
+	// Culls count random boxes through CullAABBs, returns microseconds
+	static double BenchmarkCull(unsigned int count, unsigned int& visibleCount);
+};
@@ -0,0 +1,60 @@
+#include "Bounds.h"
+
+#include <algorithm>
+#include <cmath>
+
+AABB AABB::FromVertices(const std::vector<Vertex>& vertices)
+{
+	AABB box;
+	if (vertices.empty())
+		return box;
+
+	box.min = box.max = vertices[0].Position;
+	for (const Vertex& vertex : vertices)
+	{
+		box.min = glm::min(box.min, vertex.Position);
+		box.max = glm::max(box.max, vertex.Position);
+	}
+	return box;
+}
+
+AABB AABB::Transform(const glm::mat4& transform) const
+{
+	// Arvo: transform the center, extents through the absolute rotation/scale
+	glm::vec3 center = glm::vec3(transform * glm::vec4(Center(), 1.0f));
+	glm::vec3 extents = Extents();
+	glm::vec3 worldExtents =
+		glm::abs(glm::vec3(transform[0])) * extents.x +
+		glm::abs(glm::vec3(transform[1])) * extents.y +
+		glm::abs(glm::vec3(transform[2])) * extents.z;
+
+	AABB box;
+	box.min = center - worldExtents;
+	box.max = center + worldExtents;
+	return box;
+}
+
+BoundingSphere BoundingSphere::FromVertices(const std::vector<Vertex>& vertices, const AABB& box)
+{
+	BoundingSphere sphere;
+	sphere.center = box.Center();
+	float radiusSquared = 0.0f;
+	for (const Vertex& vertex : vertices)
+	{
+		glm::vec3 offset = vertex.Position - sphere.center;
+		radiusSquared = std::max(radiusSquared, glm::dot(offset, offset));
+	}
+	sphere.radius = std::sqrt(radiusSquared);
+	return sphere;
+}
+
+BoundingSphere BoundingSphere::Transform(const glm::mat4& transform) const
+{
+	float scale = std::max(glm::length(glm::vec3(transform[0])),
+		std::max(glm::length(glm::vec3(transform[1])), glm::length(glm::vec3(transform[2]))));
+
+	BoundingSphere sphere;
+	sphere.center = glm::vec3(transform * glm::vec4(center, 1.0f));
+	sphere.radius = radius * scale;
+	return sphere;
+}
@@ -0,0 +1,30 @@
+#pragma once
+#include <glm/glm.hpp>
+
+#include <vector>
+
+#include "..\..\Graphics\Vertex.h"
+
+struct AABB
+{
+	glm::vec3 min = glm::vec3(0.0f);
+	glm::vec3 max = glm::vec3(0.0f);
+
+	glm::vec3 Center() const { return (min + max) * 0.5f; }
+	glm::vec3 Extents() const { return (max - min) * 0.5f; }
+
+	static AABB FromVertices(const std::vector<Vertex>& vertices);
+	// Smallest box around the transformed box
+	AABB Transform(const glm::mat4& transform) const;
+};
+
+struct BoundingSphere
+{
+	glm::vec3 center = glm::vec3(0.0f);
+	float radius = 0.0f;
+
+	// Centered on the box, radius reaches the farthest vertex
+	static BoundingSphere FromVertices(const std::vector<Vertex>& vertices, const AABB& box);
+	// Scales the radius by the largest axis scale
+	BoundingSphere Transform(const glm::mat4& transform) const;
+};
@@ -1,21 +1,30 @@
 #include "Mesh.h"
 
 Mesh::Mesh(std::vector<Vertex> verticies, std::vector<unsigned int> indicies, std::vector<Texture> textures)
+	: Mesh(verticies, indicies, textures, g_materials.FromTextures(textures))
+{
+}
+
+Mesh::Mesh(std::vector<Vertex> verticies, std::vector<unsigned int> indicies, std::vector<Texture> textures, unsigned short materialID)
 {
 	this->verticies = verticies;
 	this->indicies = indicies;
 	this->textures = textures;
+	this->materialID = materialID;
 
 	SetupMesh();
 }
 
 void Mesh::SetupMesh()
 {
+	bounds = AABB::FromVertices(verticies);
+	boundingSphere = BoundingSphere::FromVertices(verticies, bounds);
+
 	glGenVertexArrays(1, &VAO);
 	glGenBuffers(1, &VBO);
 	glGenBuffers(1, &EBO);
 
-	glBindVertexArray(VAO);
+	g_renderState.BindVertexArray(VAO);
 	glBindBuffer(GL_ARRAY_BUFFER, VBO);
 
 	glBufferData(GL_ARRAY_BUFFER, verticies.size() * sizeof(Vertex), &verticies[0], GL_STATIC_DRAW);
@@ -36,43 +45,59 @@ void Mesh::SetupMesh()
 	glEnableVertexAttribArray(3);
 	glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
 
-	glBindVertexArray(0);
+	// Also copy into the shared buffers for multi draw indirect
+	if (g_geometryPool.IsEnabled())
+		poolRange = g_geometryPool.Add(verticies, indicies);
+}
 
+void Mesh::Draw() const
+{
+	Draw(g_renderState);
 }
 
-void Mesh::Draw(const Shader& shader)
+void Mesh::Draw(RenderState & state) const
 {
-	// Set texture uniforms
-	unsigned int diffuseNr = 1;
-	unsigned int specularNr = 1;
-	unsigned int normalrNr = 1;
-	for (unsigned int i = 0; i < textures.size(); i++)
+	// Textures come from the material arrays, selected by the material in ObjectData
+	state.BindVertexArray(VAO);
+	state.GL().DrawElements(GL_TRIANGLES, indicies.size(), GL_UNSIGNED_INT, 0);
+}
+
+void Mesh::DrawInstanced(RenderState & state, unsigned int instanceBuffer, unsigned int offset, unsigned int count) const
+{
+	const GLFunctionTable & gl = state.GL();
+	state.BindVertexArray(VAO);
+
+	// GL 3.3 has no base instance, so the matrix columns are pointed at this batch's range
+	gl.BindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+	for (unsigned int column = 0; column < 4; column++)
 	{
-		glActiveTexture(GL_TEXTURE0 + i);
-		std::string number;
-		std::string name = textures[i].type;
-		if (name == "texture_diffuse")
-			number = std::to_string(diffuseNr++);
-		else if (name == "texture_specular")
-			number = std::to_string(specularNr++);
-		else if (name == "texture_normal")
-			number = std::to_string(normalrNr++);
-
-		shader.SetInt(("material." + name + number).c_str(), i);
-		glBindTexture(GL_TEXTURE_2D, textures[i].id);
+		unsigned int location = INSTANCE_ATTRIBUTE + column;
+		gl.EnableVertexAttribArray(location);
+		gl.VertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(offset + column * sizeof(glm::vec4)));
+		gl.VertexAttribDivisor(location, 1);
 	}
-	shader.SetFloat("material.shininess", 32.0f);
 
-	// Draw
-	glBindVertexArray(VAO);
-	glDrawElements(GL_TRIANGLES, indicies.size(), GL_UNSIGNED_INT, 0);
-	glBindVertexArray(0);
+	gl.DrawElementsInstanced(GL_TRIANGLES, indicies.size(), GL_UNSIGNED_INT, 0, count);
 
-	glActiveTexture(GL_TEXTURE0);
+	// Leave the VAO drawing non-instanced again
+	for (unsigned int column = 0; column < 4; column++)
+		gl.DisableVertexAttribArray(INSTANCE_ATTRIBUTE + column);
+	ResetInstanceAttribute(state);
+}
+
+void Mesh::ResetInstanceAttribute(RenderState & state)
+{
+	// Current attribute values are context state, a disabled array reads these
+	const GLFunctionTable & gl = state.GL();
+	gl.VertexAttrib4f(INSTANCE_ATTRIBUTE + 0, 1.0f, 0.0f, 0.0f, 0.0f);
+	gl.VertexAttrib4f(INSTANCE_ATTRIBUTE + 1, 0.0f, 1.0f, 0.0f, 0.0f);
+	gl.VertexAttrib4f(INSTANCE_ATTRIBUTE + 2, 0.0f, 0.0f, 1.0f, 0.0f);
+	gl.VertexAttrib4f(INSTANCE_ATTRIBUTE + 3, 0.0f, 0.0f, 0.0f, 1.0f);
 }
 
 void Mesh::Destroy()
 {
+	g_renderState.OnVertexArrayDeleted(VAO);
 	glDeleteVertexArrays(1, &VAO);
 	glDeleteBuffers(1, &VBO);
 	glDeleteBuffers(1, &EBO);
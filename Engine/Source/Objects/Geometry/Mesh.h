@@ -3,6 +3,9 @@
 #include "..\..\Graphics\Texture.h"
 #include "..\..\Graphics\Shaders.h"
 #include "..\..\Graphics\Vertex.h"
+#include "..\..\Graphics\GeometryPool.h"
+#include "..\..\Graphics\Materials.h"
+#include "Bounds.h"
 
 class Mesh
 {
@@ -11,12 +14,39 @@ public:
 	std::vector<unsigned int> indicies;
 	std::vector<Texture> textures;
 
+	// Gets a material with default parameters for the textures
 	Mesh(std::vector<Vertex> verticies, std::vector<unsigned int> indicies, std::vector<Texture> textures);
-	void Draw(const Shader& shader);
+	Mesh(std::vector<Vertex> verticies, std::vector<unsigned int> indicies, std::vector<Texture> textures, unsigned short materialID);
+	Mesh() {}
+	void Draw() const;
+	void Draw(RenderState & state) const;
+	// Draws count instances whose model matrices start at offset bytes into instanceBuffer
+	void DrawInstanced(RenderState & state, unsigned int instanceBuffer, unsigned int offset, unsigned int count) const;
 	void Destroy();
 
+	unsigned int GetVAO() const { return VAO; }
+	// Material in g_materials, also the material field of draw sort keys
+	unsigned short GetMaterialID() const { return materialID; }
+
+	// Where the mesh lives in g_geometryPool, index count is 0 when it is not pooled
+	const GeometryRange& GetPoolRange() const { return poolRange; }
+	bool IsPooled() const { return poolRange.indexCount != 0; }
+
+	// Object space bounds computed when the mesh is set up
+	const AABB& GetBounds() const { return bounds; }
+	const BoundingSphere& GetBoundingSphere() const { return boundingSphere; }
+
+	// The instance matrix occupies four vec4 attribute slots starting here
+	static const unsigned int INSTANCE_ATTRIBUTE = 4;
+	// Sets the instance matrix to identity for draws without an instance array
+	static void ResetInstanceAttribute(RenderState & state);
+
 private:
-	unsigned int VAO, VBO, EBO;
+	unsigned int VAO = 0, VBO = 0, EBO = 0;
+	GeometryRange poolRange;
+	AABB bounds;
+	BoundingSphere boundingSphere;
+	unsigned short materialID = MaterialLibrary::DEFAULT_MATERIAL;
 	void SetupMesh();
 
 };
\ No newline at end of file
@@ -10,12 +10,6 @@ void Model::Init(const std::string& path)
 	LoadModel(path);
 }
 
-void Model::Draw(const Shader& shader)
-{
-	for (unsigned int i = 0; i < meshes.size(); i++)
-		meshes[i].Draw(shader);
-}
-
 void Model::LoadModel(std::string path)
 {
 	Assimp::Importer importer;
@@ -30,19 +24,29 @@ void Model::LoadModel(std::string path)
 		return;
 	}
 	directory = path.substr(0, path.find_last_of('/'));
-	ProcessNode(scene->mRootNode, scene);
+	ProcessNode(scene->mRootNode, scene, TransformHierarchy::NO_PARENT);
+	nodes.Update();
 }
 
-void Model::ProcessNode(aiNode * node, const aiScene * scene)
+void Model::ProcessNode(aiNode * node, const aiScene * scene, unsigned int parent)
 {
+	// Assimp matrices are row major, glm takes columns
+	const aiMatrix4x4& m = node->mTransformation;
+	glm::mat4 local(m.a1, m.b1, m.c1, m.d1,
+		m.a2, m.b2, m.c2, m.d2,
+		m.a3, m.b3, m.c3, m.d3,
+		m.a4, m.b4, m.c4, m.d4);
+	unsigned int nodeIndex = nodes.Add(parent, local);
+
 	for (unsigned int i = 0; i < node->mNumMeshes; i++)
 	{
 		aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
 		meshes.push_back(ProcessMesh(mesh, scene));
+		meshNodes.push_back(nodeIndex);
 	}
 	for (unsigned int i = 0; i < node->mNumChildren; i++)
 	{
-		ProcessNode(node->mChildren[i], scene);
+		ProcessNode(node->mChildren[i], scene, nodeIndex);
 	}
 }
 
@@ -95,17 +99,15 @@ Mesh Model::ProcessMesh(aiMesh * mesh, const aiScene * scene)
 		}
 	}
 
-	if (mesh->mMaterialIndex >= 0)
-	{
-		aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
-		std::vector<Texture> diffuseMaps = LoadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse");
-		textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
-		std::vector<Texture> specularMaps = LoadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular");
-		textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
-		std::vector<Texture> normalMaps = LoadMaterialTextures(material, aiTextureType_HEIGHT, "texture_normal");
-		textures.insert(textures.end(), normalMaps.begin(), normalMaps.end());
-	}
-	return Mesh(verticies, indices, textures);
+	// Assimp always assigns a material, a default one when the file has none
+	aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
+	std::vector<Texture> diffuseMaps = LoadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse");
+	textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
+	std::vector<Texture> specularMaps = LoadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular");
+	textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
+	std::vector<Texture> normalMaps = LoadMaterialTextures(material, aiTextureType_HEIGHT, "texture_normal");
+	textures.insert(textures.end(), normalMaps.begin(), normalMaps.end());
+	return Mesh(verticies, indices, textures, g_materials.Import(*material, textures));
 }
 
 std::vector<Texture> Model::LoadMaterialTextures(aiMaterial * mat, aiTextureType type, std::string typeName)
@@ -128,7 +130,8 @@ std::vector<Texture> Model::LoadMaterialTextures(aiMaterial * mat, aiTextureType
 		if (!skip)
 		{
 			Texture texture;
-			texture.id = Texture::TextureFromFile(str.C_Str(), directory, true);
+			// Shared with other models loading the same file
+			texture.id = g_materials.LoadTexture(str.C_Str(), directory, true);
 			texture.type = typeName;
 			texture.path = str.C_Str();
 			textures.push_back(texture);
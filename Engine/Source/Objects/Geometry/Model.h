@@ -1,5 +1,6 @@
 #pragma once
 #include "Mesh.h"
+#include "..\..\Scene\TransformHierarchy.h"
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
@@ -11,15 +12,28 @@ public:
 	Model() {}
 	void Init(const std::string& path);
 	
-	void Draw(const Shader& shader);
 	void Destroy();
 
+	const std::vector<Mesh>& GetMeshes() const { return meshes; }
+	// World matrix of the node a mesh hangs from, relative to the model
+	const glm::mat4& GetMeshTransform(unsigned int mesh) const { return nodes.GetWorld(meshNodes[mesh]); }
+
+	// Nodes follow the aiNode tree depth first, node 0 is the root. Entities
+	// placed from the model pick changes up through UpdateModelTransforms.
+	unsigned int GetNodeCount() const { return nodes.GetCount(); }
+	const glm::mat4& GetNodeTransform(unsigned int node) const { return nodes.GetLocal(node); }
+	void SetNodeTransform(unsigned int node, const glm::mat4& local) { nodes.SetLocal(node, local); }
+	// Returns the number of node world matrices recomputed
+	unsigned int UpdateTransforms() { return nodes.Update(); }
+
 private:
 	std::vector<Mesh> meshes;
+	std::vector<unsigned int> meshNodes;
+	TransformHierarchy nodes;
 	std::vector<Texture> textures_loaded;
 	std::string directory;
 	void LoadModel(std::string path);
-	void ProcessNode(aiNode* node, const aiScene* scene);
+	void ProcessNode(aiNode* node, const aiScene* scene, unsigned int parent);
 	Mesh ProcessMesh(aiMesh* mesh, const aiScene* scene);
 	std::vector<Texture> LoadMaterialTextures(aiMaterial* mat, aiTextureType type, std::string typeName);
 
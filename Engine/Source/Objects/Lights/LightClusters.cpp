@@ -0,0 +1,340 @@
+#include "LightClusters.h"
+#include "..\..\Core\JobSystem.h"
+#include "..\..\Graphics\RenderState.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <random>
+
+#if defined(_M_X64) || defined(__SSE2__)
+#include <xmmintrin.h>
+#define LIGHTS_USE_SSE
+#endif
+
+static_assert(LightClusters::TILES_X % 4 == 0, "Tiles are tested four at a time");
+static_assert(LightClusters::DEPTH_SLICES < 256, "Slice ranges are stored in bytes");
+
+LightClusters::LightClusters()
+{
+	clusterLights.resize(CLUSTER_COUNT * MAX_LIGHTS_PER_CLUSTER);
+	clusterCounts.resize(CLUSTER_COUNT, 0);
+	overflowPerSlice.resize(DEPTH_SLICES, 0);
+	SetProjection(glm::radians(45.0f), 16.0f / 9.0f, 0.1f, 100.0f);
+}
+
+void LightClusters::Init()
+{
+	glGenBuffers(1, &clusterBufferID);
+	glGenTextures(1, &clusterTextureID);
+	glGenBuffers(1, &indexBufferID);
+	glGenTextures(1, &indexTextureID);
+
+	// Every cluster starts out empty
+	Pack(0);
+	Upload();
+	glBindTexture(GL_TEXTURE_BUFFER, clusterTextureID);
+	glTexBuffer(GL_TEXTURE_BUFFER, GL_RG32UI, clusterBufferID);
+	glBindTexture(GL_TEXTURE_BUFFER, indexTextureID);
+	glTexBuffer(GL_TEXTURE_BUFFER, GL_R32UI, indexBufferID);
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+}
+
+void LightClusters::Destroy()
+{
+	g_renderState.OnTextureDeleted(clusterTextureID);
+	g_renderState.OnTextureDeleted(indexTextureID);
+	glDeleteTextures(1, &clusterTextureID);
+	glDeleteTextures(1, &indexTextureID);
+	glDeleteBuffers(1, &clusterBufferID);
+	glDeleteBuffers(1, &indexBufferID);
+	clusterTextureID = indexTextureID = clusterBufferID = indexBufferID = 0;
+}
+
+void LightClusters::SetProjection(float newFovY, float newAspect, float newNear, float newFar)
+{
+	if (newFovY == fovY && newAspect == aspect && newNear == nearPlane && newFar == farPlane)
+		return;
+	fovY = newFovY;
+	aspect = newAspect;
+	nearPlane = newNear;
+	farPlane = newFar;
+
+	float logRatio = std::log(farPlane / nearPlane);
+	sliceScale = DEPTH_SLICES / logRatio;
+	sliceBias = DEPTH_SLICES * std::log(nearPlane) / logRatio;
+
+	float tanY = std::tan(fovY * 0.5f);
+	float tanX = tanY * aspect;
+	for (unsigned int k = 0; k < DEPTH_SLICES; k++)
+	{
+		sliceNear[k] = k == 0 ? nearPlane : sliceFar[k - 1];
+		sliceFar[k] = k + 1 == DEPTH_SLICES ? farPlane : nearPlane * std::pow(farPlane / nearPlane, (k + 1) / float(DEPTH_SLICES));
+
+		// A tile's side planes pass through the eye, so each bound is widest
+		// at whichever end of the slice lies further out
+		for (unsigned int x = 0; x < TILES_X; x++)
+		{
+			float left = -1.0f + 2.0f * x / TILES_X;
+			float right = -1.0f + 2.0f * (x + 1) / TILES_X;
+			tileMinX[k][x] = tanX * left * (left < 0.0f ? sliceFar[k] : sliceNear[k]);
+			tileMaxX[k][x] = tanX * right * (right > 0.0f ? sliceFar[k] : sliceNear[k]);
+		}
+		for (unsigned int y = 0; y < TILES_Y; y++)
+		{
+			float bottom = -1.0f + 2.0f * y / TILES_Y;
+			float top = -1.0f + 2.0f * (y + 1) / TILES_Y;
+			tileMinY[k][y] = tanY * bottom * (bottom < 0.0f ? sliceFar[k] : sliceNear[k]);
+			tileMaxY[k][y] = tanY * top * (top > 0.0f ? sliceFar[k] : sliceNear[k]);
+		}
+	}
+}
+
+unsigned int LightClusters::SliceOf(float depth) const
+{
+	if (depth <= nearPlane)
+		return 0;
+	float slice = std::floor(std::log(depth) * sliceScale - sliceBias);
+	return static_cast<unsigned int>(std::min(std::max(slice, 0.0f), float(DEPTH_SLICES - 1)));
+}
+
+void LightClusters::Build(const glm::mat4 & view, const std::vector<glm::vec4> & spheres, unsigned int pointLightCount, bool parallel)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	unsigned int count = static_cast<unsigned int>(spheres.size());
+	viewSpheres.resize(count);
+	firstSlice.resize(count);
+	lastSlice.resize(count);
+
+	auto transform = [&](unsigned int begin, unsigned int end)
+	{
+		for (unsigned int i = begin; i < end; i++)
+		{
+			glm::vec4 center = view * glm::vec4(glm::vec3(spheres[i]), 1.0f);
+			float radius = spheres[i].w;
+			viewSpheres[i] = glm::vec4(center.x, center.y, -center.z, radius);
+			if (radius <= 0.0f)
+			{
+				// Lights with no reach are never binned
+				firstSlice[i] = 1;
+				lastSlice[i] = 0;
+				continue;
+			}
+			// One slice of slack either way covers rounding in SliceOf, the exact test is per slice
+			unsigned int first = SliceOf(-center.z - radius);
+			unsigned int last = SliceOf(-center.z + radius);
+			firstSlice[i] = static_cast<unsigned char>(first > 0 ? first - 1 : 0);
+			lastSlice[i] = static_cast<unsigned char>(std::min(last + 1, DEPTH_SLICES - 1));
+		}
+	};
+	// Every slice is binned by one job, so no two jobs write the same cluster
+	auto bin = [&](unsigned int begin, unsigned int end)
+	{
+		for (unsigned int slice = begin; slice < end; slice++)
+			BinSlice(slice);
+	};
+	if (parallel)
+	{
+		g_jobSystem.ParallelFor(count, g_jobSystem.BatchSizeFor(count, 256), transform);
+		g_jobSystem.ParallelFor(DEPTH_SLICES, 1, bin);
+	}
+	else
+	{
+		transform(0, count);
+		bin(0, DEPTH_SLICES);
+	}
+
+	Pack(pointLightCount);
+	BinMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+void LightClusters::BinSlice(unsigned int slice)
+{
+	unsigned int firstCluster = ClusterIndex(0, 0, slice);
+	unsigned int * counts = &clusterCounts[firstCluster];
+	unsigned int * lights = &clusterLights[firstCluster * MAX_LIGHTS_PER_CLUSTER];
+	std::fill(counts, counts + TILES_X * TILES_Y, 0u);
+	unsigned int overflow = 0;
+
+	auto append = [&](unsigned int tile, unsigned int light)
+	{
+		if (counts[tile] < MAX_LIGHTS_PER_CLUSTER)
+			lights[tile * MAX_LIGHTS_PER_CLUSTER + counts[tile]++] = light;
+		else
+			overflow++;
+	};
+
+	// Squared distance from the sphere center to the box is a sum of one
+	// term per axis; z is shared by the slice, y by a row, x by a column
+	unsigned int count = static_cast<unsigned int>(viewSpheres.size());
+	for (unsigned int i = 0; i < count; i++)
+	{
+		if (slice < firstSlice[i] || slice > lastSlice[i])
+			continue;
+		const glm::vec4 & sphere = viewSpheres[i];
+		float dz = std::max(0.0f, std::max(sliceNear[slice] - sphere.z, sphere.z - sliceFar[slice]));
+		float remainingZ = sphere.w * sphere.w - dz * dz;
+		if (remainingZ < 0.0f)
+			continue;
+
+#ifdef LIGHTS_USE_SSE
+		__m128 zero = _mm_setzero_ps();
+		__m128 centerX = _mm_set1_ps(sphere.x);
+		__m128 dx2[TILES_X / 4];
+		for (unsigned int q = 0; q < TILES_X / 4; q++)
+		{
+			__m128 dx = _mm_max_ps(zero, _mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&tileMinX[slice][q * 4]), centerX),
+				_mm_sub_ps(centerX, _mm_loadu_ps(&tileMaxX[slice][q * 4]))));
+			dx2[q] = _mm_mul_ps(dx, dx);
+		}
+#else
+		float dx2[TILES_X];
+		for (unsigned int x = 0; x < TILES_X; x++)
+		{
+			float dx = std::max(0.0f, std::max(tileMinX[slice][x] - sphere.x, sphere.x - tileMaxX[slice][x]));
+			dx2[x] = dx * dx;
+		}
+#endif
+
+		for (unsigned int y = 0; y < TILES_Y; y++)
+		{
+			float dy = std::max(0.0f, std::max(tileMinY[slice][y] - sphere.y, sphere.y - tileMaxY[slice][y]));
+			float remaining = remainingZ - dy * dy;
+			if (remaining < 0.0f)
+				continue;
+#ifdef LIGHTS_USE_SSE
+			__m128 limit = _mm_set1_ps(remaining);
+			for (unsigned int q = 0; q < TILES_X / 4; q++)
+			{
+				int mask = _mm_movemask_ps(_mm_cmple_ps(dx2[q], limit));
+				for (unsigned int lane = 0; mask != 0; lane++, mask >>= 1)
+				{
+					if (mask & 1)
+						append(y * TILES_X + q * 4 + lane, i);
+				}
+			}
+#else
+			for (unsigned int x = 0; x < TILES_X; x++)
+			{
+				if (dx2[x] <= remaining)
+					append(y * TILES_X + x, i);
+			}
+#endif
+		}
+	}
+	overflowPerSlice[slice] = overflow;
+}
+
+void LightClusters::Pack(unsigned int pointLightCount)
+{
+	packedClusters.resize(CLUSTER_COUNT * 2);
+	packedIndices.clear();
+	MaxClusterLights = 0;
+	for (unsigned int c = 0; c < CLUSTER_COUNT; c++)
+	{
+		unsigned int count = clusterCounts[c];
+		const unsigned int * lights = &clusterLights[c * MAX_LIGHTS_PER_CLUSTER];
+		// Lights were appended in index order, so point lights come first
+		unsigned int points = static_cast<unsigned int>(std::lower_bound(lights, lights + count, pointLightCount) - lights);
+		packedClusters[c * 2] = static_cast<unsigned int>(packedIndices.size());
+		packedClusters[c * 2 + 1] = points | (count - points) << 16;
+		packedIndices.insert(packedIndices.end(), lights, lights + count);
+		MaxClusterLights = std::max(MaxClusterLights, count);
+	}
+	IndexCount = static_cast<unsigned int>(packedIndices.size());
+
+	Overflowed = 0;
+	for (unsigned int overflow : overflowPerSlice)
+		Overflowed += overflow;
+	// Always keep at least one texel so the texture buffer stays valid
+	if (packedIndices.empty())
+		packedIndices.push_back(0);
+}
+
+void LightClusters::Upload()
+{
+	// Respecified every frame, the driver orphans the storage draws still read
+	glBindBuffer(GL_TEXTURE_BUFFER, clusterBufferID);
+	glBufferData(GL_TEXTURE_BUFFER, packedClusters.size() * sizeof(unsigned int), packedClusters.data(), GL_STREAM_DRAW);
+	glBindBuffer(GL_TEXTURE_BUFFER, indexBufferID);
+	glBufferData(GL_TEXTURE_BUFFER, packedIndices.size() * sizeof(unsigned int), packedIndices.data(), GL_STREAM_DRAW);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+void LightClusters::Bind(unsigned int clusterUnit, unsigned int indexUnit) const
+{
+	g_renderState.BindTexture(clusterUnit, GL_TEXTURE_BUFFER, clusterTextureID);
+	g_renderState.BindTexture(indexUnit, GL_TEXTURE_BUFFER, indexTextureID);
+}
+
+const unsigned int * LightClusters::GetClusterLights(unsigned int cluster, unsigned int & count) const
+{
+	count = clusterCounts[cluster];
+	return &clusterLights[cluster * MAX_LIGHTS_PER_CLUSTER];
+}
+
+LightClusters::BenchmarkResult LightClusters::Benchmark(unsigned int lightCount)
+{
+	const unsigned int RUNS = 10;
+	BenchmarkResult result = {};
+	result.lights = lightCount;
+	result.threads = g_jobSystem.GetWorkerCount();
+
+	// A quarter of the lights are spot lights so the index split is exercised
+	std::mt19937 random(1337);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	std::vector<glm::vec4> spheres(lightCount);
+	for (glm::vec4 & sphere : spheres)
+		sphere = glm::vec4(-60.0f + 120.0f * unit(random), -5.0f + 15.0f * unit(random), 5.0f - 110.0f * unit(random), 0.5f + 3.5f * unit(random));
+	unsigned int pointLightCount = lightCount - lightCount / 4;
+
+	LightClusters clusters;
+	clusters.SetProjection(glm::radians(45.0f), 16.0f / 9.0f, 0.1f, 100.0f);
+	glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 2.0f, 5.0f), glm::vec3(0.0f, 0.0f, -50.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+
+	auto start = std::chrono::high_resolution_clock::now();
+	for (unsigned int run = 0; run < RUNS; run++)
+		clusters.Build(view, spheres, pointLightCount, false);
+	result.serialMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count() / RUNS;
+
+	start = std::chrono::high_resolution_clock::now();
+	for (unsigned int run = 0; run < RUNS; run++)
+		clusters.Build(view, spheres, pointLightCount, true);
+	result.parallelMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count() / RUNS;
+	result.averageClusterLights = clusters.IndexCount / double(CLUSTER_COUNT);
+	result.maxClusterLights = clusters.MaxClusterLights;
+
+	// Every light against every cluster, with the same arithmetic so boundary cases agree
+	std::vector<unsigned int> expected;
+	for (unsigned int slice = 0; slice < DEPTH_SLICES; slice++)
+	{
+		for (unsigned int y = 0; y < TILES_Y; y++)
+		{
+			for (unsigned int x = 0; x < TILES_X; x++)
+			{
+				expected.clear();
+				for (unsigned int i = 0; i < lightCount; i++)
+				{
+					const glm::vec4 & sphere = clusters.viewSpheres[i];
+					if (sphere.w <= 0.0f)
+						continue;
+					float dz = std::max(0.0f, std::max(clusters.sliceNear[slice] - sphere.z, sphere.z - clusters.sliceFar[slice]));
+					float dy = std::max(0.0f, std::max(clusters.tileMinY[slice][y] - sphere.y, sphere.y - clusters.tileMaxY[slice][y]));
+					float dx = std::max(0.0f, std::max(clusters.tileMinX[slice][x] - sphere.x, sphere.x - clusters.tileMaxX[slice][x]));
+					if (dx * dx <= sphere.w * sphere.w - dz * dz - dy * dy)
+						expected.push_back(i);
+				}
+				if (expected.size() > MAX_LIGHTS_PER_CLUSTER)
+					expected.resize(MAX_LIGHTS_PER_CLUSTER);
+
+				unsigned int count = 0;
+				const unsigned int * lights = clusters.GetClusterLights(ClusterIndex(x, y, slice), count);
+				if (count != expected.size() || !std::equal(expected.begin(), expected.end(), lights))
+					result.mismatches++;
+			}
+		}
+	}
+	return result;
+}
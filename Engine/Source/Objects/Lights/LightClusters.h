@@ -0,0 +1,112 @@
+#pragma once
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <vector>
+
+// Light lists for a grid of clusters over the view frustum: TILES_X by
+// TILES_Y screen tiles times DEPTH_SLICES depth slices, each slice thicker
+// than the last so clusters stay roughly cubic with distance.
+//
+// Lights are bounding spheres, binned on the CPU against the view space
+// box of every cluster. Slices are binned in parallel on the job system,
+// a light is tested against four tiles of a row at a time. The result is
+// packed into two texture buffers for the lighting shader:
+//   clusters: RG32UI [first index, point count | spot count << 16]
+//   indices:  R32UI light index, point lights first, spot lights offset by the point light count
+//
+// Binning needs no GL context, only Init, Destroy, Upload and Bind do.
+class LightClusters
+{
+public:
+	static const unsigned int TILES_X = 16;
+	static const unsigned int TILES_Y = 9;
+	static const unsigned int DEPTH_SLICES = 24;
+	static const unsigned int CLUSTER_COUNT = TILES_X * TILES_Y * DEPTH_SLICES;
+	// Lights past this many in one cluster are dropped and counted in Overflowed
+	static const unsigned int MAX_LIGHTS_PER_CLUSTER = 512;
+
+	LightClusters();
+	void Init();
+	void Destroy();
+
+	// Cluster bounds for a symmetric perspective projection, only
+	// recomputed when a value changed
+	void SetProjection(float fovY, float aspect, float nearPlane, float farPlane);
+
+	// Bins world space spheres, radius in w, the first pointLightCount of
+	// which are point lights
+	void Build(const glm::mat4 & view, const std::vector<glm::vec4> & spheres, unsigned int pointLightCount, bool parallel = true);
+	void Upload();
+	void Bind(unsigned int clusterUnit, unsigned int indexUnit) const;
+
+	static unsigned int ClusterIndex(unsigned int tileX, unsigned int tileY, unsigned int slice)
+	{
+		return (slice * TILES_Y + tileY) * TILES_X + tileX;
+	}
+	// Depth along the view direction to slice, clamped to the grid
+	unsigned int SliceOf(float depth) const;
+	// slice = log(depth) * scale - bias, for the shader
+	float GetSliceScale() const { return sliceScale; }
+	float GetSliceBias() const { return sliceBias; }
+
+	// Light indices binned into a cluster by the last Build, ascending
+	const unsigned int * GetClusterLights(unsigned int cluster, unsigned int & count) const;
+
+	// Statistics for the last Build
+	double BinMs = 0.0;
+	unsigned int IndexCount = 0;
+	unsigned int MaxClusterLights = 0;
+	unsigned int Overflowed = 0;
+
+	struct BenchmarkResult
+	{
+		unsigned int lights;
+		unsigned int threads;
+		double serialMs;            // Build on the calling thread
+		double parallelMs;          // Build on all job system workers
+		double averageClusterLights;
+		unsigned int maxClusterLights;
+		unsigned int mismatches;    // clusters whose lights differ from a brute force test of every light
+	};
+	// Random lights in front of a 16:9 camera, no GL context required
+	static BenchmarkResult Benchmark(unsigned int lightCount);
+
+private:
+	float fovY = 0.0f;
+	float aspect = 0.0f;
+	float nearPlane = 0.0f;
+	float farPlane = 0.0f;
+	float sliceScale = 0.0f;
+	float sliceBias = 0.0f;
+
+	// View space cluster bounds. Depth is the distance along -z; x bounds only
+	// depend on the column and y bounds on the row, both per slice.
+	float sliceNear[DEPTH_SLICES];
+	float sliceFar[DEPTH_SLICES];
+	float tileMinX[DEPTH_SLICES][TILES_X];
+	float tileMaxX[DEPTH_SLICES][TILES_X];
+	float tileMinY[DEPTH_SLICES][TILES_Y];
+	float tileMaxY[DEPTH_SLICES][TILES_Y];
+
+	// Lights transformed by Build, one entry per sphere
+	std::vector<glm::vec4> viewSpheres;
+	std::vector<unsigned char> firstSlice;
+	std::vector<unsigned char> lastSlice;
+
+	// MAX_LIGHTS_PER_CLUSTER slots per cluster, every cluster is written by a single job
+	std::vector<unsigned int> clusterLights;
+	std::vector<unsigned int> clusterCounts;
+	std::vector<unsigned int> overflowPerSlice;
+
+	std::vector<unsigned int> packedClusters;
+	std::vector<unsigned int> packedIndices;
+
+	unsigned int clusterBufferID = 0;
+	unsigned int clusterTextureID = 0;
+	unsigned int indexBufferID = 0;
+	unsigned int indexTextureID = 0;
+
+	void BinSlice(unsigned int slice);
+	void Pack(unsigned int pointLightCount);
+};
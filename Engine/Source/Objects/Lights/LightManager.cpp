@@ -0,0 +1,273 @@
+#include "LightManager.h"
+#include "..\..\Graphics\RenderState.h"
+
+#include <algorithm>
+#include <chrono>
+
+#if defined(_M_X64) || defined(__SSE2__)
+#include <xmmintrin.h>
+#define LIGHTS_USE_SSE
+#endif
+
+void LightManager::Init()
+{
+	pointLights.channelCount = POINT_LIGHT_TEXELS * 4;
+	spotLights.channelCount = SPOT_LIGHT_TEXELS * 4;
+
+	LightChannels * sets[] = { &pointLights, &spotLights };
+	for (LightChannels * set : sets)
+	{
+		glGenBuffers(1, &set->bufferID);
+		glGenTextures(1, &set->textureID);
+		glBindBuffer(GL_TEXTURE_BUFFER, set->bufferID);
+		glBufferData(GL_TEXTURE_BUFFER, 4 * sizeof(float), NULL, GL_STREAM_DRAW);
+		glBindTexture(GL_TEXTURE_BUFFER, set->textureID);
+		glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, set->bufferID);
+		set->dirty = true;
+	}
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+void LightManager::Destroy()
+{
+	LightChannels * sets[] = { &pointLights, &spotLights };
+	for (LightChannels * set : sets)
+	{
+		g_renderState.OnTextureDeleted(set->textureID);
+		glDeleteTextures(1, &set->textureID);
+		glDeleteBuffers(1, &set->bufferID);
+		set->textureID = set->bufferID = 0;
+	}
+}
+
+unsigned int LightManager::AddPointLight(const PointLight & light)
+{
+	unsigned int index = pointLights.Add();
+	SetPointLight(index, light);
+	return index;
+}
+
+void LightManager::SetPointLight(unsigned int index, const PointLight & light)
+{
+	pointLights.Set(index, 0, light.position, light.constant);
+	pointLights.Set(index, 1, light.ambient, light.linear);
+	pointLights.Set(index, 2, light.diffuse, light.quadratic);
+	pointLights.Set(index, 3, light.specular, 0.0f);
+}
+
+void LightManager::SetPointLightPosition(unsigned int index, glm::vec3 position)
+{
+	pointLights.channels[0][index] = position.x;
+	pointLights.channels[1][index] = position.y;
+	pointLights.channels[2][index] = position.z;
+	pointLights.dirty = true;
+}
+
+PointLight LightManager::GetPointLight(unsigned int index) const
+{
+	PointLight light;
+	glm::vec4 texel = pointLights.Get(index, 0);
+	light.position = glm::vec3(texel);
+	light.constant = texel.w;
+	texel = pointLights.Get(index, 1);
+	light.ambient = glm::vec3(texel);
+	light.linear = texel.w;
+	texel = pointLights.Get(index, 2);
+	light.diffuse = glm::vec3(texel);
+	light.quadratic = texel.w;
+	light.specular = glm::vec3(pointLights.Get(index, 3));
+	return light;
+}
+
+void LightManager::RemovePointLight(unsigned int index)
+{
+	pointLights.Remove(index);
+}
+
+unsigned int LightManager::AddSpotLight(const SpotLight & light)
+{
+	unsigned int index = spotLights.Add();
+	SetSpotLight(index, light);
+	return index;
+}
+
+void LightManager::SetSpotLight(unsigned int index, const SpotLight & light)
+{
+	spotLights.Set(index, 0, light.position, light.innerCutOff);
+	spotLights.Set(index, 1, light.direction, light.outerCutOff);
+	spotLights.Set(index, 2, light.ambient, light.constant);
+	spotLights.Set(index, 3, light.diffuse, light.linear);
+	spotLights.Set(index, 4, light.specular, light.quadratic);
+}
+
+SpotLight LightManager::GetSpotLight(unsigned int index) const
+{
+	SpotLight light;
+	glm::vec4 texel = spotLights.Get(index, 0);
+	light.position = glm::vec3(texel);
+	light.innerCutOff = texel.w;
+	texel = spotLights.Get(index, 1);
+	light.direction = glm::vec3(texel);
+	light.outerCutOff = texel.w;
+	texel = spotLights.Get(index, 2);
+	light.ambient = glm::vec3(texel);
+	light.constant = texel.w;
+	texel = spotLights.Get(index, 3);
+	light.diffuse = glm::vec3(texel);
+	light.linear = texel.w;
+	texel = spotLights.Get(index, 4);
+	light.specular = glm::vec3(texel);
+	light.quadratic = texel.w;
+	return light;
+}
+
+void LightManager::RemoveSpotLight(unsigned int index)
+{
+	spotLights.Remove(index);
+}
+
+void LightManager::Clear()
+{
+	pointLights.count = 0;
+	spotLights.count = 0;
+	pointLights.dirty = true;
+	spotLights.dirty = true;
+}
+
+void LightManager::GetBoundingSpheres(float cutoff, std::vector<glm::vec4> & spheres) const
+{
+	spheres.resize(pointLights.count + spotLights.count);
+	const std::vector<float> * point = pointLights.channels;
+	for (unsigned int i = 0; i < pointLights.count; i++)
+	{
+		// ambient, diffuse and specular are texels 1 to 3
+		float intensity = 0.0f;
+		for (unsigned int c = 0; c < 3; c++)
+			intensity = std::max(intensity, point[4 + c][i] + point[8 + c][i] + point[12 + c][i]);
+		float radius = AttenuationRadius(point[3][i], point[7][i], point[11][i], intensity, cutoff);
+		spheres[i] = glm::vec4(point[0][i], point[1][i], point[2][i], radius);
+	}
+
+	const std::vector<float> * spot = spotLights.channels;
+	for (unsigned int i = 0; i < spotLights.count; i++)
+	{
+		// ambient, diffuse and specular are texels 2 to 4, the cone is ignored
+		float intensity = 0.0f;
+		for (unsigned int c = 0; c < 3; c++)
+			intensity = std::max(intensity, spot[8 + c][i] + spot[12 + c][i] + spot[16 + c][i]);
+		float radius = AttenuationRadius(spot[11][i], spot[15][i], spot[19][i], intensity, cutoff);
+		spheres[pointLights.count + i] = glm::vec4(spot[0][i], spot[1][i], spot[2][i], radius);
+	}
+}
+
+void LightManager::Upload()
+{
+	if (!pointLights.dirty && !spotLights.dirty)
+		return;
+
+	auto start = std::chrono::high_resolution_clock::now();
+	if (pointLights.dirty)
+		pointLights.Pack();
+	if (spotLights.dirty)
+		spotLights.Pack();
+	PackTimeUs = std::chrono::duration<double, std::micro>(std::chrono::high_resolution_clock::now() - start).count();
+
+	if (pointLights.dirty)
+		pointLights.Upload();
+	if (spotLights.dirty)
+		spotLights.Upload();
+}
+
+void LightManager::Bind(unsigned int pointLightUnit, unsigned int spotLightUnit) const
+{
+	g_renderState.BindTexture(pointLightUnit, GL_TEXTURE_BUFFER, pointLights.textureID);
+	g_renderState.BindTexture(spotLightUnit, GL_TEXTURE_BUFFER, spotLights.textureID);
+}
+
+unsigned int LightManager::LightChannels::Add()
+{
+	unsigned int index = count++;
+	unsigned int paddedCount = (count + 3) & ~3u;
+	if (channels[0].size() < paddedCount)
+	{
+		for (unsigned int i = 0; i < channelCount; i++)
+			channels[i].resize(paddedCount, 0.0f);
+	}
+	dirty = true;
+	return index;
+}
+
+void LightManager::LightChannels::Set(unsigned int index, unsigned int texel, glm::vec3 value, float w)
+{
+	channels[texel * 4 + 0][index] = value.x;
+	channels[texel * 4 + 1][index] = value.y;
+	channels[texel * 4 + 2][index] = value.z;
+	channels[texel * 4 + 3][index] = w;
+	dirty = true;
+}
+
+glm::vec4 LightManager::LightChannels::Get(unsigned int index, unsigned int texel) const
+{
+	return glm::vec4(channels[texel * 4 + 0][index], channels[texel * 4 + 1][index],
+		channels[texel * 4 + 2][index], channels[texel * 4 + 3][index]);
+}
+
+void LightManager::LightChannels::Remove(unsigned int index)
+{
+	// Swap with the last light, indices of other lights are not stable across removals
+	unsigned int last = count - 1;
+	for (unsigned int i = 0; i < channelCount; i++)
+	{
+		channels[i][index] = channels[i][last];
+		channels[i][last] = 0.0f;
+	}
+	count--;
+	dirty = true;
+}
+
+void LightManager::LightChannels::Pack()
+{
+	// Transpose the channels into one interleaved record per light
+	unsigned int paddedCount = (count + 3) & ~3u;
+	unsigned int texels = channelCount / 4;
+	packed.resize(std::max(paddedCount, 1u) * channelCount);
+	float * out = packed.data();
+
+#ifdef LIGHTS_USE_SSE
+	for (unsigned int i = 0; i < paddedCount; i += 4)
+	{
+		for (unsigned int t = 0; t < texels; t++)
+		{
+			__m128 row0 = _mm_loadu_ps(&channels[t * 4 + 0][i]);
+			__m128 row1 = _mm_loadu_ps(&channels[t * 4 + 1][i]);
+			__m128 row2 = _mm_loadu_ps(&channels[t * 4 + 2][i]);
+			__m128 row3 = _mm_loadu_ps(&channels[t * 4 + 3][i]);
+			_MM_TRANSPOSE4_PS(row0, row1, row2, row3);
+			_mm_storeu_ps(out + (i + 0) * channelCount + t * 4, row0);
+			_mm_storeu_ps(out + (i + 1) * channelCount + t * 4, row1);
+			_mm_storeu_ps(out + (i + 2) * channelCount + t * 4, row2);
+			_mm_storeu_ps(out + (i + 3) * channelCount + t * 4, row3);
+		}
+	}
+#else
+	for (unsigned int i = 0; i < count; i++)
+	{
+		for (unsigned int c = 0; c < channelCount; c++)
+			out[i * channelCount + c] = channels[c][i];
+	}
+#endif
+}
+
+void LightManager::LightChannels::Upload()
+{
+	// Always keep at least one texel so the texture buffer stays valid
+	unsigned int size = std::max(count, 1u) * channelCount * sizeof(float);
+	bufferCapacity = std::max(size, bufferCapacity);
+	glBindBuffer(GL_TEXTURE_BUFFER, bufferID);
+	// Orphan the old storage instead of waiting for draws still reading it
+	glBufferData(GL_TEXTURE_BUFFER, bufferCapacity, NULL, GL_STREAM_DRAW);
+	glBufferSubData(GL_TEXTURE_BUFFER, 0, size, packed.data());
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+	dirty = false;
+}
@@ -0,0 +1,78 @@
+#pragma once
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <vector>
+
+#include "Lights.h"
+
+// Point and spot lights live in structure-of-arrays channels on the CPU and
+// are packed into RGBA32F texture buffers for the lighting shader, so the
+// light count is a runtime value instead of a shader constant.
+//
+// Every channel group of four maps to one texel:
+//   point light: [position, constant] [ambient, linear] [diffuse, quadratic] [specular, -]
+//   spot light:  [position, innerCutOff] [direction, outerCutOff] [ambient, constant] [diffuse, linear] [specular, quadratic]
+class LightManager
+{
+public:
+	static const unsigned int POINT_LIGHT_TEXELS = 4;
+	static const unsigned int SPOT_LIGHT_TEXELS = 5;
+
+	DirectionalLight DirLight;
+
+	LightManager() {}
+	void Init();
+	void Destroy();
+
+	unsigned int AddPointLight(const PointLight & light);
+	void SetPointLight(unsigned int index, const PointLight & light);
+	void SetPointLightPosition(unsigned int index, glm::vec3 position);
+	PointLight GetPointLight(unsigned int index) const;
+	void RemovePointLight(unsigned int index);
+
+	unsigned int AddSpotLight(const SpotLight & light);
+	void SetSpotLight(unsigned int index, const SpotLight & light);
+	SpotLight GetSpotLight(unsigned int index) const;
+	void RemoveSpotLight(unsigned int index);
+
+	void Clear();
+
+	unsigned int GetPointLightCount() const { return pointLights.count; }
+	unsigned int GetSpotLightCount() const { return spotLights.count; }
+
+	// World space bounding sphere of every light, radius in w, point lights
+	// first then spot lights. The radius is where the light's attenuated
+	// intensity falls to cutoff, see AttenuationRadius.
+	void GetBoundingSpheres(float cutoff, std::vector<glm::vec4> & spheres) const;
+
+	// Packs and uploads any light set that changed since the last call
+	void Upload();
+	void Bind(unsigned int pointLightUnit, unsigned int spotLightUnit) const;
+
+	// Time spent packing the last upload
+	double PackTimeUs = 0.0;
+
+private:
+	// One float per light per channel, padded to a multiple of four lights
+	struct LightChannels
+	{
+		std::vector<float> channels[SPOT_LIGHT_TEXELS * 4];
+		std::vector<float> packed;
+		unsigned int channelCount = 0;
+		unsigned int count = 0;
+		bool dirty = true;
+		unsigned int bufferID = 0;
+		unsigned int textureID = 0;
+		unsigned int bufferCapacity = 0;
+
+		unsigned int Add();
+		void Set(unsigned int index, unsigned int channel, glm::vec3 value, float w);
+		glm::vec4 Get(unsigned int index, unsigned int texel) const;
+		void Remove(unsigned int index);
+		void Pack();
+		void Upload();
+	};
+	LightChannels pointLights;
+	LightChannels spotLights;
+};
@@ -1,6 +1,9 @@
 #pragma once
 #include <glm/glm.hpp>
 
+#include <cmath>
+#include <limits>
+
 struct SpotLight
 {
 	glm::vec3 position = glm::vec3(0.0f);
@@ -37,4 +40,19 @@ struct DirectionalLight
 	glm::vec3 ambient = glm::vec3(0.05f);
 	glm::vec3 diffuse = glm::vec3(0.4f);
 	glm::vec3 specular = glm::vec3(0.5f);
-};
\ No newline at end of file
+};
+
+// Distance at which a light of the given peak intensity, i.e. the largest
+// component of ambient + diffuse + specular, attenuates to cutoff.
+// Solves intensity / (constant + linear * d + quadratic * d^2) = cutoff.
+inline float AttenuationRadius(float constant, float linear, float quadratic, float intensity, float cutoff)
+{
+	float reach = intensity / cutoff - constant;
+	if (reach <= 0.0f)
+		return 0.0f;
+	if (quadratic > 0.0f)
+		return (-linear + std::sqrt(linear * linear + 4.0f * quadratic * reach)) / (2.0f * quadratic);
+	if (linear > 0.0f)
+		return reach / linear;
+	return std::numeric_limits<float>::max();
+}
@@ -0,0 +1,96 @@
+#include "ShadowCascades.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+void ShadowCascades::Update(const glm::mat4 & view, float fovY, float aspect, float nearPlane, float farPlane,
+	glm::vec3 lightDirection, const AABB & casterBounds)
+{
+	if (CascadeCount > MAX_CASCADES)
+		CascadeCount = MAX_CASCADES;
+	if (CascadeCount == 0)
+		CascadeCount = 1;
+
+	splits[0] = nearPlane;
+	for (unsigned int i = 1; i <= CascadeCount; i++)
+	{
+		float fraction = static_cast<float>(i) / CascadeCount;
+		float logarithmic = nearPlane * std::pow(farPlane / nearPlane, fraction);
+		float uniform = nearPlane + (farPlane - nearPlane) * fraction;
+		splits[i] = SplitLambda * logarithmic + (1.0f - SplitLambda) * uniform;
+	}
+
+	// One light space for all cascades, rotation only so texel snapping is
+	// independent of where the camera is
+	// A zero direction, e.g. mid edit in ImGui, falls back to straight down
+	direction = glm::dot(lightDirection, lightDirection) > 0.0f ? glm::normalize(lightDirection) : glm::vec3(0.0f, -1.0f, 0.0f);
+	glm::vec3 up = std::abs(direction.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+	glm::mat4 lightView = glm::lookAt(glm::vec3(0.0f), direction, up);
+	glm::mat4 viewToLight = lightView * glm::inverse(view);
+
+	// The light looks down -z, the caster closest to the light has the largest z
+	float casterMaxZ = -std::numeric_limits<float>::max();
+	for (unsigned int corner = 0; corner < 8; corner++)
+	{
+		glm::vec3 point((corner & 1) ? casterBounds.max.x : casterBounds.min.x,
+			(corner & 2) ? casterBounds.max.y : casterBounds.min.y,
+			(corner & 4) ? casterBounds.max.z : casterBounds.min.z);
+		casterMaxZ = std::max(casterMaxZ, (lightView * glm::vec4(point, 1.0f)).z);
+	}
+
+	float tanY = std::tan(fovY * 0.5f);
+	float tanX = tanY * aspect;
+	for (unsigned int cascade = 0; cascade < CascadeCount; cascade++)
+	{
+		glm::vec3 corners[8];
+		glm::vec3 center(0.0f);
+		for (unsigned int corner = 0; corner < 8; corner++)
+		{
+			float depth = splits[cascade + ((corner & 4) ? 1 : 0)];
+			glm::vec4 viewCorner(((corner & 1) ? tanX : -tanX) * depth, ((corner & 2) ? tanY : -tanY) * depth, -depth, 1.0f);
+			corners[corner] = glm::vec3(viewToLight * viewCorner);
+			center += corners[corner] / 8.0f;
+		}
+
+		glm::vec3 minimum(std::numeric_limits<float>::max());
+		glm::vec3 maximum(-std::numeric_limits<float>::max());
+		for (const glm::vec3 & corner : corners)
+		{
+			minimum = glm::min(minimum, corner);
+			maximum = glm::max(maximum, corner);
+		}
+
+		if (StableFit)
+		{
+			float radius = 0.0f;
+			for (const glm::vec3 & corner : corners)
+				radius = std::max(radius, glm::length(corner - center));
+			// Rounded up so float noise in the corners does not change the size
+			radius = std::ceil(radius * 16.0f) / 16.0f;
+			minimum = glm::vec3(glm::vec2(center) - radius, minimum.z);
+			maximum = glm::vec3(glm::vec2(center) + radius, maximum.z);
+		}
+
+		// Moving the camera moves the projection in whole texels, the size
+		// only changes when the slice itself does
+		glm::vec2 size = glm::vec2(maximum) - glm::vec2(minimum);
+		glm::vec2 texel = size / static_cast<float>(Resolution);
+		glm::vec2 snapped = glm::floor(glm::vec2(minimum) / texel) * texel;
+		texelSizes[cascade] = std::max(texel.x, texel.y);
+
+		float nearZ = std::max(maximum.z, casterMaxZ);
+		glm::mat4 projection = glm::ortho(snapped.x, snapped.x + size.x, snapped.y, snapped.y + size.y, -nearZ, -minimum.z);
+		matrices[cascade] = projection * lightView;
+	}
+}
+
+glm::vec4 ShadowCascades::GetSplits() const
+{
+	glm::vec4 result;
+	for (unsigned int i = 0; i < MAX_CASCADES; i++)
+		result[i] = splits[std::min(i, CascadeCount - 1) + 1];
+	return result;
+}
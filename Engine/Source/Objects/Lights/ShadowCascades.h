@@ -0,0 +1,55 @@
+#pragma once
+#include <glm/glm.hpp>
+
+#include "..\Geometry\Bounds.h"
+#include "..\Camera\Frustum.h"
+
+// Cascaded shadow maps for a directional light. The camera frustum is split
+// into depth slices, each slice gets an orthographic light projection fitted
+// around it and its own layer of one depth texture array. The lighting
+// shader picks the cascade from the fragment's view depth.
+//
+// Split distances blend uniform and logarithmic spacing (the practical split
+// scheme). Projections are snapped to whole shadow map texels in light space
+// so they do not shimmer while the camera moves. Their near plane is pulled
+// back toward the light to the caster bounds, so casters outside the slice
+// still shadow it. That volume is also what casters are culled against, an
+// object outside it cannot shadow anything the cascade covers.
+class ShadowCascades
+{
+public:
+	static const unsigned int MAX_CASCADES = 4;
+
+	unsigned int CascadeCount = MAX_CASCADES;
+	// 0 spaces the splits uniformly, 1 logarithmically
+	float SplitLambda = 0.75f;
+	// Fits a sphere around each slice instead of a box. The projection keeps
+	// its size while the camera turns, so snapping also holds for rotation,
+	// at the cost of texels outside the slice.
+	bool StableFit = true;
+	int Resolution = 2048;
+
+	// view and the projection parameters are the camera's, farPlane is where
+	// shadows end. casterBounds holds everything that can cast a shadow.
+	void Update(const glm::mat4 & view, float fovY, float aspect, float nearPlane, float farPlane,
+		glm::vec3 lightDirection, const AABB & casterBounds);
+
+	// World to light clip space of a cascade
+	const glm::mat4 & GetMatrix(unsigned int cascade) const { return matrices[cascade]; }
+	// Volume of a cascade, from the slice back toward the light to the casters
+	Frustum GetFrustum(unsigned int cascade) const { return Frustum(matrices[cascade]); }
+	// View depth where a cascade ends
+	float GetSplit(unsigned int cascade) const { return splits[cascade + 1]; }
+	// Far split of every cascade, unused ones repeat the last, for LightBlock
+	glm::vec4 GetSplits() const;
+	// World units covered by one shadow map texel
+	float GetTexelSize(unsigned int cascade) const { return texelSizes[cascade]; }
+	// Normalized light direction the matrices were built for
+	const glm::vec3 & GetDirection() const { return direction; }
+
+private:
+	glm::vec3 direction = glm::vec3(0.0f, -1.0f, 0.0f);
+	glm::mat4 matrices[MAX_CASCADES];
+	float splits[MAX_CASCADES + 1] = {};
+	float texelSizes[MAX_CASCADES] = {};
+};
@@ -0,0 +1,437 @@
+#include "BVH.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <random>
+#include <utility>
+
+namespace
+{
+	float SurfaceArea(glm::vec3 min, glm::vec3 max)
+	{
+		glm::vec3 size = glm::max(max - min, glm::vec3(0.0f));
+		return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+	}
+
+	bool Overlaps(const BVHNode& node, const AABB& box)
+	{
+		return node.min.x <= box.max.x && node.max.x >= box.min.x &&
+			node.min.y <= box.max.y && node.max.y >= box.min.y &&
+			node.min.z <= box.max.z && node.max.z >= box.min.z;
+	}
+
+	AABB NodeBox(const BVHNode& node)
+	{
+		AABB box;
+		box.min = node.min;
+		box.max = node.max;
+		return box;
+	}
+
+	// Slab test, returns the entry distance or infinity on a miss
+	float IntersectRay(glm::vec3 min, glm::vec3 max, glm::vec3 origin, glm::vec3 inverseDirection, float maxDistance)
+	{
+		glm::vec3 t0 = (min - origin) * inverseDirection;
+		glm::vec3 t1 = (max - origin) * inverseDirection;
+		glm::vec3 tNear = glm::min(t0, t1);
+		glm::vec3 tFar = glm::max(t0, t1);
+		float enter = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, 0.0f));
+		float exit = std::min(std::min(tFar.x, tFar.y), std::min(tFar.z, maxDistance));
+		return enter <= exit ? enter : std::numeric_limits<float>::infinity();
+	}
+}
+
+void BVH::Clear()
+{
+	items.clear();
+	order.clear();
+	nodes.clear();
+}
+
+unsigned int BVH::Add(const AABB& box, unsigned int userData)
+{
+	Item item;
+	item.box = box;
+	item.centroid = box.Center();
+	item.userData = userData;
+	items.push_back(item);
+	return static_cast<unsigned int>(items.size() - 1);
+}
+
+void BVH::SetBounds(unsigned int item, const AABB& box)
+{
+	items[item].box = box;
+	items[item].centroid = box.Center();
+}
+
+AABB BVH::GetBounds() const
+{
+	AABB box;
+	if (!nodes.empty())
+	{
+		box.min = nodes[0].min;
+		box.max = nodes[0].max;
+	}
+	return box;
+}
+
+void BVH::Build()
+{
+	nodes.clear();
+	order.resize(items.size());
+	for (unsigned int i = 0; i < items.size(); i++)
+		order[i] = i;
+	if (items.empty())
+		return;
+
+	// A binary tree over n items with leaves of at least one item has under 2n nodes
+	nodes.reserve(items.size() * 2);
+	BVHNode root;
+	root.leftOrFirst = 0;
+	root.count = static_cast<unsigned int>(items.size());
+	FitNode(root);
+	nodes.push_back(root);
+
+	// Node index and depth
+	std::vector<std::pair<unsigned int, unsigned int>> stack(1, std::make_pair(0u, 0u));
+	while (!stack.empty())
+	{
+		unsigned int nodeIndex = stack.back().first;
+		unsigned int depth = stack.back().second;
+		stack.pop_back();
+		if (depth == MAX_DEPTH)
+			continue;
+		Subdivide(nodeIndex);
+		if (!nodes[nodeIndex].IsLeaf())
+		{
+			stack.push_back(std::make_pair(nodes[nodeIndex].leftOrFirst, depth + 1));
+			stack.push_back(std::make_pair(nodes[nodeIndex].leftOrFirst + 1, depth + 1));
+		}
+	}
+	builtCost = Cost();
+}
+
+void BVH::FitNode(BVHNode& node) const
+{
+	node.min = glm::vec3(std::numeric_limits<float>::max());
+	node.max = glm::vec3(-std::numeric_limits<float>::max());
+	for (unsigned int i = 0; i < node.count; i++)
+	{
+		const AABB& box = items[order[node.leftOrFirst + i]].box;
+		node.min = glm::min(node.min, box.min);
+		node.max = glm::max(node.max, box.max);
+	}
+}
+
+void BVH::Subdivide(unsigned int nodeIndex)
+{
+	BVHNode node = nodes[nodeIndex];
+	if (node.count <= MAX_LEAF_ITEMS)
+		return;
+
+	glm::vec3 centroidMin(std::numeric_limits<float>::max());
+	glm::vec3 centroidMax(-std::numeric_limits<float>::max());
+	for (unsigned int i = 0; i < node.count; i++)
+	{
+		glm::vec3 centroid = items[order[node.leftOrFirst + i]].centroid;
+		centroidMin = glm::min(centroidMin, centroid);
+		centroidMax = glm::max(centroidMax, centroid);
+	}
+
+	// Binned SAH over all three axes
+	float bestCost = std::numeric_limits<float>::max();
+	int bestAxis = -1;
+	unsigned int bestSplit = 0;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		float extent = centroidMax[axis] - centroidMin[axis];
+		if (extent <= 0.0f)
+			continue;
+
+		struct Bin
+		{
+			glm::vec3 min = glm::vec3(std::numeric_limits<float>::max());
+			glm::vec3 max = glm::vec3(-std::numeric_limits<float>::max());
+			unsigned int count = 0;
+		} bins[SAH_BINS];
+
+		float scale = SAH_BINS / extent;
+		for (unsigned int i = 0; i < node.count; i++)
+		{
+			const Item& item = items[order[node.leftOrFirst + i]];
+			unsigned int bin = std::min(SAH_BINS - 1, static_cast<unsigned int>((item.centroid[axis] - centroidMin[axis]) * scale));
+			bins[bin].min = glm::min(bins[bin].min, item.box.min);
+			bins[bin].max = glm::max(bins[bin].max, item.box.max);
+			bins[bin].count++;
+		}
+
+		// Sweep from both sides to get area times count for every split plane
+		float leftCost[SAH_BINS - 1];
+		glm::vec3 sweepMin(std::numeric_limits<float>::max()), sweepMax(-std::numeric_limits<float>::max());
+		unsigned int sweepCount = 0;
+		for (unsigned int i = 0; i < SAH_BINS - 1; i++)
+		{
+			sweepMin = glm::min(sweepMin, bins[i].min);
+			sweepMax = glm::max(sweepMax, bins[i].max);
+			sweepCount += bins[i].count;
+			leftCost[i] = sweepCount ? SurfaceArea(sweepMin, sweepMax) * sweepCount : 0.0f;
+		}
+		sweepMin = glm::vec3(std::numeric_limits<float>::max());
+		sweepMax = glm::vec3(-std::numeric_limits<float>::max());
+		sweepCount = 0;
+		for (unsigned int i = SAH_BINS - 1; i > 0; i--)
+		{
+			sweepMin = glm::min(sweepMin, bins[i].min);
+			sweepMax = glm::max(sweepMax, bins[i].max);
+			sweepCount += bins[i].count;
+			float cost = leftCost[i - 1] + (sweepCount ? SurfaceArea(sweepMin, sweepMax) * sweepCount : 0.0f);
+			if (cost < bestCost)
+			{
+				bestCost = cost;
+				bestAxis = axis;
+				bestSplit = i;
+			}
+		}
+	}
+
+	// Splitting must beat testing every item of the node
+	float leafCost = SurfaceArea(node.min, node.max) * node.count;
+	if (bestAxis < 0 || bestCost >= leafCost)
+		return;
+
+	float extent = centroidMax[bestAxis] - centroidMin[bestAxis];
+	float scale = SAH_BINS / extent;
+	unsigned int* first = &order[node.leftOrFirst];
+	unsigned int* middle = std::partition(first, first + node.count, [&](unsigned int index)
+	{
+		unsigned int bin = std::min(SAH_BINS - 1, static_cast<unsigned int>((items[index].centroid[bestAxis] - centroidMin[bestAxis]) * scale));
+		return bin < bestSplit;
+	});
+	unsigned int leftCount = static_cast<unsigned int>(middle - first);
+	if (leftCount == 0 || leftCount == node.count)
+		return;
+
+	BVHNode left, right;
+	left.leftOrFirst = node.leftOrFirst;
+	left.count = leftCount;
+	right.leftOrFirst = node.leftOrFirst + leftCount;
+	right.count = node.count - leftCount;
+	FitNode(left);
+	FitNode(right);
+
+	unsigned int leftIndex = static_cast<unsigned int>(nodes.size());
+	nodes.push_back(left);
+	nodes.push_back(right);
+	nodes[nodeIndex].leftOrFirst = leftIndex;
+	nodes[nodeIndex].count = 0;
+}
+
+float BVH::Cost() const
+{
+	// SAH cost relative to the root, a stable measure of tree quality
+	if (nodes.empty())
+		return 0.0f;
+
+	float cost = 0.0f;
+	for (const BVHNode& node : nodes)
+		cost += SurfaceArea(node.min, node.max) * (node.IsLeaf() ? node.count : 1);
+	return cost / std::max(SurfaceArea(nodes[0].min, nodes[0].max), 1e-6f);
+}
+
+void BVH::Refit()
+{
+	if (nodes.empty() || order.size() != items.size())
+	{
+		Build();
+		return;
+	}
+
+	// Children are always stored after their parent
+	for (unsigned int i = static_cast<unsigned int>(nodes.size()); i-- > 0;)
+	{
+		BVHNode& node = nodes[i];
+		if (node.IsLeaf())
+		{
+			FitNode(node);
+			continue;
+		}
+		const BVHNode& left = nodes[node.leftOrFirst];
+		const BVHNode& right = nodes[node.leftOrFirst + 1];
+		node.min = glm::min(left.min, right.min);
+		node.max = glm::max(left.max, right.max);
+	}
+
+	if (Cost() > REBUILD_THRESHOLD * builtCost)
+	{
+		Build();
+		Rebuilds++;
+	}
+}
+
+void BVH::QueryFrustum(const Frustum& frustum, std::vector<unsigned int>& results) const
+{
+	if (nodes.empty())
+		return;
+
+	// Each level leaves at most one sibling behind, see MAX_DEPTH
+	unsigned int stack[MAX_DEPTH + 1];
+	unsigned int depth = 0;
+	stack[depth++] = 0;
+	while (depth > 0)
+	{
+		const BVHNode& node = nodes[stack[--depth]];
+		if (!frustum.TestAABB(NodeBox(node)))
+			continue;
+
+		if (node.IsLeaf())
+		{
+			for (unsigned int i = 0; i < node.count; i++)
+			{
+				const Item& item = items[order[node.leftOrFirst + i]];
+				if (node.count == 1 || frustum.TestAABB(item.box))
+					results.push_back(item.userData);
+			}
+			continue;
+		}
+		stack[depth++] = node.leftOrFirst;
+		stack[depth++] = node.leftOrFirst + 1;
+	}
+}
+
+void BVH::QueryAABB(const AABB& box, std::vector<unsigned int>& results) const
+{
+	if (nodes.empty())
+		return;
+
+	unsigned int stack[MAX_DEPTH + 1];
+	unsigned int depth = 0;
+	stack[depth++] = 0;
+	while (depth > 0)
+	{
+		const BVHNode& node = nodes[stack[--depth]];
+		if (!Overlaps(node, box))
+			continue;
+
+		if (node.IsLeaf())
+		{
+			for (unsigned int i = 0; i < node.count; i++)
+			{
+				const Item& item = items[order[node.leftOrFirst + i]];
+				BVHNode itemNode = { item.box.min, 0, item.box.max, 1 };
+				if (Overlaps(itemNode, box))
+					results.push_back(item.userData);
+			}
+			continue;
+		}
+		stack[depth++] = node.leftOrFirst;
+		stack[depth++] = node.leftOrFirst + 1;
+	}
+}
+
+bool BVH::Raycast(glm::vec3 origin, glm::vec3 direction, float& distance, unsigned int& userData) const
+{
+	if (nodes.empty())
+		return false;
+
+	glm::vec3 inverseDirection = 1.0f / direction;
+	float nearest = std::numeric_limits<float>::infinity();
+	bool hit = false;
+
+	unsigned int stack[MAX_DEPTH + 1];
+	unsigned int depth = 0;
+	stack[depth++] = 0;
+	while (depth > 0)
+	{
+		const BVHNode& node = nodes[stack[--depth]];
+		if (IntersectRay(node.min, node.max, origin, inverseDirection, nearest) == std::numeric_limits<float>::infinity())
+			continue;
+
+		if (node.IsLeaf())
+		{
+			for (unsigned int i = 0; i < node.count; i++)
+			{
+				const Item& item = items[order[node.leftOrFirst + i]];
+				float t = IntersectRay(item.box.min, item.box.max, origin, inverseDirection, nearest);
+				if (t < nearest)
+				{
+					nearest = t;
+					userData = item.userData;
+					hit = true;
+				}
+			}
+			continue;
+		}
+
+		// Visit the nearer child first so far subtrees get clipped by the hit
+		unsigned int first = node.leftOrFirst, second = node.leftOrFirst + 1;
+		float firstDistance = IntersectRay(nodes[first].min, nodes[first].max, origin, inverseDirection, nearest);
+		float secondDistance = IntersectRay(nodes[second].min, nodes[second].max, origin, inverseDirection, nearest);
+		if (firstDistance < secondDistance)
+			std::swap(first, second);
+		stack[depth++] = first;
+		stack[depth++] = second;
+	}
+
+	distance = nearest;
+	return hit;
+}
+
+BVH::BenchmarkResult BVH::Benchmark(unsigned int count)
+{
+	std::mt19937 random(1234);
+	std::uniform_real_distribution<float> positions(-500.0f, 500.0f);
+	std::uniform_real_distribution<float> sizes(0.1f, 2.0f);
+	std::uniform_real_distribution<float> offsets(-0.5f, 0.5f);
+
+	BVH bvh;
+	std::vector<AABB> boxes(count);
+	for (unsigned int i = 0; i < count; i++)
+	{
+		glm::vec3 center(positions(random), positions(random) * 0.1f, positions(random));
+		boxes[i].min = center - glm::vec3(sizes(random));
+		boxes[i].max = center + glm::vec3(sizes(random));
+		bvh.Add(boxes[i], i);
+	}
+
+	BenchmarkResult result;
+	auto start = std::chrono::high_resolution_clock::now();
+	bvh.Build();
+	result.buildMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+	for (unsigned int i = 0; i < count; i++)
+	{
+		glm::vec3 offset(offsets(random), offsets(random), offsets(random));
+		boxes[i].min += offset;
+		boxes[i].max += offset;
+		bvh.SetBounds(i, boxes[i]);
+	}
+	start = std::chrono::high_resolution_clock::now();
+	bvh.Refit();
+	result.refitMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+	// The linear pass tests the same moved boxes as the refit tree
+	AABBArray linear;
+	for (const AABB& box : boxes)
+		linear.Add(box);
+
+	glm::mat4 projection = glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.1f, 100.0f);
+	glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 2.0f, 0.0f), glm::vec3(0.0f, 2.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+	Frustum frustum(projection * view);
+
+	std::vector<unsigned int> results;
+	results.reserve(count);
+	start = std::chrono::high_resolution_clock::now();
+	bvh.QueryFrustum(frustum, results);
+	result.queryUs = std::chrono::duration<double, std::micro>(std::chrono::high_resolution_clock::now() - start).count();
+	result.visible = static_cast<unsigned int>(results.size());
+
+	std::vector<unsigned char> visible;
+	start = std::chrono::high_resolution_clock::now();
+	result.linearVisible = frustum.CullAABBs(linear, visible);
+	result.linearQueryUs = std::chrono::duration<double, std::micro>(std::chrono::high_resolution_clock::now() - start).count();
+	return result;
+}
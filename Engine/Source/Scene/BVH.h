@@ -0,0 +1,86 @@
+#pragma once
+#include <glm/glm.hpp>
+
+#include <vector>
+
+#include "..\Objects\Geometry\Bounds.h"
+#include "..\Objects\Camera\Frustum.h"
+
+// Flattened node, 32 bytes so two share a cache line. Internal nodes store the
+// index of their left child, the right child always follows it. Leaves store
+// the first entry of their range in the item order array.
+struct BVHNode
+{
+	glm::vec3 min;
+	unsigned int leftOrFirst;
+	glm::vec3 max;
+	unsigned int count;  // 0 for internal nodes
+
+	bool IsLeaf() const { return count != 0; }
+};
+
+// Bounding volume hierarchy over item boxes. Static items are built once with
+// binned SAH. Moving items live in their own tree, update their boxes and call
+// Refit each frame, which rebuilds once refitting has degraded the tree.
+class BVH
+{
+public:
+	static const unsigned int MAX_LEAF_ITEMS = 4;
+	static const unsigned int SAH_BINS = 12;
+	// Skewed inputs can split one item off per level, nodes this deep stay
+	// leaves so the traversal stacks below are always large enough
+	static const unsigned int MAX_DEPTH = 48;
+
+	void Clear();
+	// Returns the item handle, the tree is stale until the next Build
+	unsigned int Add(const AABB& box, unsigned int userData);
+	void SetBounds(unsigned int item, const AABB& box);
+
+	void Build();
+	// Recomputes node bounds bottom up, rebuilds if the SAH cost grew past
+	// REBUILD_THRESHOLD times the cost right after the last build
+	void Refit();
+	static constexpr float REBUILD_THRESHOLD = 1.5f;
+
+	// Query results are item user data
+	void QueryFrustum(const Frustum& frustum, std::vector<unsigned int>& results) const;
+	void QueryAABB(const AABB& box, std::vector<unsigned int>& results) const;
+	// Nearest item box hit by the ray, false if nothing is hit
+	bool Raycast(glm::vec3 origin, glm::vec3 direction, float& distance, unsigned int& userData) const;
+
+	// Box around every item as of the last Build or Refit, empty without items
+	AABB GetBounds() const;
+
+	unsigned int GetItemCount() const { return static_cast<unsigned int>(items.size()); }
+	unsigned int GetNodeCount() const { return static_cast<unsigned int>(nodes.size()); }
+	unsigned int Rebuilds = 0;
+
+	struct BenchmarkResult
+	{
+		double buildMs;
+		double refitMs;
+		double queryUs;
+		double linearQueryUs;
+		unsigned int visible;
+		unsigned int linearVisible;  // equal to visible unless the tree query is wrong
+	};
+	// Random boxes: SAH build, refit after moving every box, frustum query
+	// against the tree and against a linear pass over all boxes
+	static BenchmarkResult Benchmark(unsigned int count);
+
+private:
+	struct Item
+	{
+		AABB box;
+		glm::vec3 centroid;
+		unsigned int userData;
+	};
+	std::vector<Item> items;
+	std::vector<unsigned int> order;  // leaf ranges index into this
+	std::vector<BVHNode> nodes;
+	float builtCost = 0.0f;
+
+	void Subdivide(unsigned int nodeIndex);
+	void FitNode(BVHNode& node) const;
+	float Cost() const;
+};
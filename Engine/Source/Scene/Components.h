@@ -0,0 +1,70 @@
+#pragma once
+#include <glm/glm.hpp>
+
+#include "..\Objects\Camera\Camera.h"
+#include "..\Objects\Geometry\Bounds.h"
+#include "..\Objects\Lights\Lights.h"
+
+class Mesh;
+class Model;
+
+struct TransformComponent
+{
+	glm::mat4 world = glm::mat4(1.0f);
+};
+
+struct MeshRendererComponent
+{
+	const Mesh* mesh = nullptr;
+	bool occluder = false;  // rasterized by the occlusion culler
+};
+
+// Entity placed from one of a model's meshes, UpdateModelTransforms keeps its
+// world matrix at placement times the mesh's node world matrix
+struct ModelNodeComponent
+{
+	const Model* model = nullptr;
+	unsigned int mesh = 0;
+	glm::mat4 placement = glm::mat4(1.0f);
+};
+
+// World space box of a mesh renderer, refreshed by UpdateSceneBounds
+struct BoundsComponent
+{
+	AABB world;
+};
+
+// Item handle of an entity in the scene BVH, refits go through it since pool
+// order changes when entities are removed
+struct BVHItemComponent
+{
+	unsigned int item = 0;
+};
+
+// Lights keep their slot in the LightManager, lights flagged dirty are copied
+// into it by SyncLights
+struct PointLightComponent
+{
+	PointLight light;
+	unsigned int slot = 0;
+	bool dirty = true;
+};
+
+struct SpotLightComponent
+{
+	SpotLight light;
+	unsigned int slot = 0;
+	bool dirty = true;
+	bool followCamera = false;
+};
+
+struct DirectionalLightComponent
+{
+	DirectionalLight light;
+};
+
+struct CameraComponent
+{
+	Camera camera;
+	bool active = true;
+};
@@ -0,0 +1,193 @@
+#include "OcclusionCuller.h"
+#include "..\Objects\Geometry\Mesh.h"
+#include "..\Core\JobSystem.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <xmmintrin.h>
+
+OcclusionCuller::OcclusionCuller()
+	: depth(WIDTH * HEIGHT, 1.0f), tileMaxDepth(TILES_X * TILES_Y, 1.0f)
+{
+}
+
+void OcclusionCuller::BeginFrame(const glm::mat4& viewProjection)
+{
+	this->viewProjection = viewProjection;
+	triangles.clear();
+	OccluderTriangles = 0;
+}
+
+bool OcclusionCuller::ProjectToScreen(const glm::vec4& clip, glm::vec3& screen) const
+{
+	if (clip.w <= 1e-4f)
+		return false;
+
+	glm::vec3 ndc = glm::vec3(clip) / clip.w;
+	screen.x = (ndc.x * 0.5f + 0.5f) * WIDTH;
+	screen.y = (ndc.y * 0.5f + 0.5f) * HEIGHT;
+	screen.z = ndc.z * 0.5f + 0.5f;
+	return true;
+}
+
+void OcclusionCuller::AddOccluder(const Mesh& mesh, const glm::mat4& transform)
+{
+	glm::mat4 toClip = viewProjection * transform;
+	std::vector<glm::vec3> screen(mesh.verticies.size());
+	std::vector<unsigned char> valid(mesh.verticies.size());
+	for (unsigned int i = 0; i < mesh.verticies.size(); i++)
+		valid[i] = ProjectToScreen(toClip * glm::vec4(mesh.verticies[i].Position, 1.0f), screen[i]);
+
+	for (unsigned int i = 0; i + 2 < mesh.indicies.size(); i += 3)
+	{
+		unsigned int a = mesh.indicies[i], b = mesh.indicies[i + 1], c = mesh.indicies[i + 2];
+		if (!valid[a] || !valid[b] || !valid[c])
+			continue;
+
+		ScreenTriangle triangle;
+		triangle.v[0] = screen[a];
+		triangle.v[1] = screen[b];
+		triangle.v[2] = screen[c];
+		triangles.push_back(triangle);
+	}
+	OccluderTriangles = static_cast<unsigned int>(triangles.size());
+}
+
+void OcclusionCuller::Rasterize()
+{
+	auto start = std::chrono::high_resolution_clock::now();
+
+	// Bands are whole tile rows so every job also owns its tiles
+	ThreadCount = std::max(1u, std::min(g_jobSystem.GetWorkerCount(), static_cast<unsigned int>(TILES_Y)));
+	int tileRowsPerBand = (TILES_Y + ThreadCount - 1) / ThreadCount;
+	unsigned int bands = (TILES_Y + tileRowsPerBand - 1) / tileRowsPerBand;
+	g_jobSystem.ParallelFor(bands, 1, [&](unsigned int first, unsigned int last)
+	{
+		for (unsigned int band = first; band < last; band++)
+		{
+			int firstRow = band * tileRowsPerBand * TILE_SIZE;
+			RasterizeBand(firstRow, std::min(HEIGHT, firstRow + tileRowsPerBand * TILE_SIZE));
+		}
+	});
+
+	RasterizeMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+void OcclusionCuller::RasterizeBand(int firstRow, int lastRow)
+{
+	std::fill(depth.begin() + firstRow * WIDTH, depth.begin() + lastRow * WIDTH, 1.0f);
+
+	const __m128 laneOffsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+	for (const ScreenTriangle& triangle : triangles)
+	{
+		glm::vec3 v0 = triangle.v[0], v1 = triangle.v[1], v2 = triangle.v[2];
+		float area = (v1.x - v0.x) * (v2.y - v0.y) - (v1.y - v0.y) * (v2.x - v0.x);
+		if (std::fabs(area) < 1e-6f)
+			continue;
+		// Either winding occludes, flip to counter clockwise
+		if (area < 0.0f)
+		{
+			std::swap(v1, v2);
+			area = -area;
+		}
+
+		int minX = std::max(0, static_cast<int>(std::floor(std::min(v0.x, std::min(v1.x, v2.x)))));
+		int maxX = std::min(WIDTH - 1, static_cast<int>(std::ceil(std::max(v0.x, std::max(v1.x, v2.x)))));
+		int minY = std::max(firstRow, static_cast<int>(std::floor(std::min(v0.y, std::min(v1.y, v2.y)))));
+		int maxY = std::min(lastRow - 1, static_cast<int>(std::ceil(std::max(v0.y, std::max(v1.y, v2.y)))));
+		if (minX > maxX || minY > maxY)
+			continue;
+		minX &= ~3;
+
+		// Edge functions E(x, y) = A x + B y + C, positive inside
+		float A0 = v1.y - v2.y, B0 = v2.x - v1.x, C0 = v1.x * v2.y - v1.y * v2.x;
+		float A1 = v2.y - v0.y, B1 = v0.x - v2.x, C1 = v2.x * v0.y - v2.y * v0.x;
+		float A2 = v0.y - v1.y, B2 = v1.x - v0.x, C2 = v0.x * v1.y - v0.y * v1.x;
+
+		// Depth is linear in screen space: z = zx x + zy y + zc
+		float inverseArea = 1.0f / area;
+		float zx = (A0 * v0.z + A1 * v1.z + A2 * v2.z) * inverseArea;
+		float zy = (B0 * v0.z + B1 * v1.z + B2 * v2.z) * inverseArea;
+		float zc = (C0 * v0.z + C1 * v1.z + C2 * v2.z) * inverseArea;
+
+		__m128 a0 = _mm_set1_ps(A0), a1 = _mm_set1_ps(A1), a2 = _mm_set1_ps(A2), dzx = _mm_set1_ps(zx);
+		for (int y = minY; y <= maxY; y++)
+		{
+			float pixelY = y + 0.5f;
+			__m128 rowE0 = _mm_set1_ps(B0 * pixelY + C0);
+			__m128 rowE1 = _mm_set1_ps(B1 * pixelY + C1);
+			__m128 rowE2 = _mm_set1_ps(B2 * pixelY + C2);
+			__m128 rowZ = _mm_set1_ps(zy * pixelY + zc);
+			float* row = &depth[y * WIDTH];
+
+			for (int x = minX; x <= maxX; x += 4)
+			{
+				__m128 pixelX = _mm_add_ps(_mm_set1_ps(static_cast<float>(x)), laneOffsets);
+				__m128 e0 = _mm_add_ps(_mm_mul_ps(a0, pixelX), rowE0);
+				__m128 e1 = _mm_add_ps(_mm_mul_ps(a1, pixelX), rowE1);
+				__m128 e2 = _mm_add_ps(_mm_mul_ps(a2, pixelX), rowE2);
+				__m128 inside = _mm_cmpge_ps(_mm_min_ps(e0, _mm_min_ps(e1, e2)), _mm_setzero_ps());
+				if (_mm_movemask_ps(inside) == 0)
+					continue;
+
+				__m128 z = _mm_add_ps(_mm_mul_ps(dzx, pixelX), rowZ);
+				__m128 current = _mm_loadu_ps(row + x);
+				__m128 nearer = _mm_min_ps(current, z);
+				_mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearer), _mm_andnot_ps(inside, current)));
+			}
+		}
+	}
+
+	// Farthest depth per tile, an object must be behind it to be hidden
+	for (int tileY = firstRow / TILE_SIZE; tileY < lastRow / TILE_SIZE; tileY++)
+	{
+		for (int tileX = 0; tileX < TILES_X; tileX++)
+		{
+			__m128 farthest = _mm_setzero_ps();
+			for (int y = 0; y < TILE_SIZE; y++)
+			{
+				const float* row = &depth[(tileY * TILE_SIZE + y) * WIDTH + tileX * TILE_SIZE];
+				farthest = _mm_max_ps(farthest, _mm_max_ps(_mm_loadu_ps(row), _mm_loadu_ps(row + 4)));
+			}
+			float lanes[4];
+			_mm_storeu_ps(lanes, farthest);
+			tileMaxDepth[tileY * TILES_X + tileX] = std::max(std::max(lanes[0], lanes[1]), std::max(lanes[2], lanes[3]));
+		}
+	}
+}
+
+bool OcclusionCuller::IsVisible(const AABB& box) const
+{
+	glm::vec2 screenMin(static_cast<float>(WIDTH), static_cast<float>(HEIGHT));
+	glm::vec2 screenMax(0.0f);
+	float nearest = 1.0f;
+	for (int i = 0; i < 8; i++)
+	{
+		glm::vec3 corner((i & 1) ? box.max.x : box.min.x, (i & 2) ? box.max.y : box.min.y, (i & 4) ? box.max.z : box.min.z);
+		glm::vec3 screen;
+		// Boxes reaching behind the camera are never culled
+		if (!ProjectToScreen(viewProjection * glm::vec4(corner, 1.0f), screen))
+			return true;
+		screenMin = glm::min(screenMin, glm::vec2(screen));
+		screenMax = glm::max(screenMax, glm::vec2(screen));
+		nearest = std::min(nearest, screen.z);
+	}
+
+	int firstTileX = std::max(0, static_cast<int>(screenMin.x) / TILE_SIZE);
+	int lastTileX = std::min(TILES_X - 1, static_cast<int>(screenMax.x) / TILE_SIZE);
+	int firstTileY = std::max(0, static_cast<int>(screenMin.y) / TILE_SIZE);
+	int lastTileY = std::min(TILES_Y - 1, static_cast<int>(screenMax.y) / TILE_SIZE);
+	if (firstTileX > lastTileX || firstTileY > lastTileY)
+		return true;
+
+	for (int tileY = firstTileY; tileY <= lastTileY; tileY++)
+	{
+		for (int tileX = firstTileX; tileX <= lastTileX; tileX++)
+		{
+			if (nearest <= tileMaxDepth[tileY * TILES_X + tileX])
+				return true;
+		}
+	}
+	return false;
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include <glm/glm.hpp>
+
+#include <vector>
+
+#include "..\Objects\Geometry\Bounds.h"
+
+class Mesh;
+
+// Software occlusion culling. Selected occluder meshes are rasterized into a
+// low resolution depth buffer on the CPU, the farthest depth of each tile
+// forms a one level hierarchy, and object boxes whose nearest point lies
+// behind every tile they cover are reported hidden. Rows are split into bands
+// rasterized on separate threads. Depth is NDC z remapped to [0, 1], pixels
+// no occluder touched stay at 1 so they never hide anything.
+class OcclusionCuller
+{
+public:
+	static const int WIDTH = 256;
+	static const int HEIGHT = 128;
+	static const int TILE_SIZE = 8;
+	static const int TILES_X = WIDTH / TILE_SIZE;
+	static const int TILES_Y = HEIGHT / TILE_SIZE;
+
+	OcclusionCuller();
+
+	void BeginFrame(const glm::mat4& viewProjection);
+	// Triangles crossing the near plane are dropped, which only makes the culler more conservative
+	void AddOccluder(const Mesh& mesh, const glm::mat4& transform);
+	void Rasterize();
+
+	bool IsVisible(const AABB& box) const;
+
+	// Nearest occluder depth per pixel, row 0 at the bottom
+	const std::vector<float>& GetDepthBuffer() const { return depth; }
+
+	// Row bands rasterized as separate jobs
+	unsigned int ThreadCount = 1;
+	unsigned int OccluderTriangles = 0;
+	double RasterizeMs = 0.0;
+
+private:
+	struct ScreenTriangle
+	{
+		glm::vec3 v[3];  // pixel x, pixel y, depth
+	};
+
+	glm::mat4 viewProjection;
+	std::vector<ScreenTriangle> triangles;
+	std::vector<float> depth;
+	std::vector<float> tileMaxDepth;
+
+	void RasterizeBand(int firstRow, int lastRow);
+	bool ProjectToScreen(const glm::vec4& clip, glm::vec3& screen) const;
+};
@@ -0,0 +1,52 @@
+#include "Registry.h"
+
+unsigned int Registry::NextTypeId()
+{
+	static unsigned int next = 0;
+	return next++;
+}
+
+Entity Registry::Create()
+{
+	aliveCount++;
+	if (!freeIndices.empty())
+	{
+		unsigned int index = freeIndices.back();
+		freeIndices.pop_back();
+		return EntityId::Make(index, versions[index]);
+	}
+
+	versions.push_back(0);
+	return EntityId::Make(static_cast<unsigned int>(versions.size() - 1), 0);
+}
+
+void Registry::Destroy(Entity entity)
+{
+	if (!IsAlive(entity))
+		return;
+
+	for (std::unique_ptr<ComponentPoolBase>& pool : pools)
+	{
+		if (pool)
+			pool->Remove(entity);
+	}
+
+	unsigned int index = EntityId::Index(entity);
+	versions[index] = (versions[index] + 1) & ((1u << (32 - EntityId::INDEX_BITS)) - 1);
+	freeIndices.push_back(index);
+	aliveCount--;
+}
+
+bool Registry::IsAlive(Entity entity) const
+{
+	unsigned int index = EntityId::Index(entity);
+	return entity != NULL_ENTITY && index < versions.size() && versions[index] == EntityId::Version(entity);
+}
+
+void Registry::Clear()
+{
+	pools.clear();
+	versions.clear();
+	freeIndices.clear();
+	aliveCount = 0;
+}
@@ -0,0 +1,179 @@
+#pragma once
+#include <memory>
+#include <vector>
+
+// Entities are an index in the low 20 bits and a version in the high 12, so a
+// destroyed entity's id stops matching once its index is reused.
+typedef unsigned int Entity;
+const Entity NULL_ENTITY = 0xFFFFFFFF;
+
+namespace EntityId
+{
+	const unsigned int INDEX_BITS = 20;
+	const unsigned int INDEX_MASK = (1u << INDEX_BITS) - 1;
+
+	inline unsigned int Index(Entity entity) { return entity & INDEX_MASK; }
+	inline unsigned int Version(Entity entity) { return entity >> INDEX_BITS; }
+	inline Entity Make(unsigned int index, unsigned int version) { return (version << INDEX_BITS) | index; }
+}
+
+class ComponentPoolBase
+{
+public:
+	virtual ~ComponentPoolBase() {}
+	virtual bool Has(Entity entity) const = 0;
+	virtual void Remove(Entity entity) = 0;
+};
+
+// Sparse set: components live packed in a dense array, a sparse array maps
+// entity indices to dense slots. Removal swaps the last component into the
+// hole, so iteration order is not stable across removals.
+template<typename T>
+class ComponentPool : public ComponentPoolBase
+{
+public:
+	T& Add(Entity entity, const T& component)
+	{
+		unsigned int index = EntityId::Index(entity);
+		if (Has(entity))
+			return components[sparse[index]] = component;
+
+		if (index >= sparse.size())
+			sparse.resize(index + 1, INVALID);
+		sparse[index] = static_cast<unsigned int>(entities.size());
+		entities.push_back(entity);
+		components.push_back(component);
+		return components.back();
+	}
+
+	bool Has(Entity entity) const override
+	{
+		unsigned int index = EntityId::Index(entity);
+		return index < sparse.size() && sparse[index] != INVALID && entities[sparse[index]] == entity;
+	}
+
+	T& Get(Entity entity) { return components[sparse[EntityId::Index(entity)]]; }
+	const T& Get(Entity entity) const { return components[sparse[EntityId::Index(entity)]]; }
+
+	void Remove(Entity entity) override
+	{
+		if (!Has(entity))
+			return;
+
+		unsigned int slot = sparse[EntityId::Index(entity)];
+		unsigned int last = static_cast<unsigned int>(entities.size() - 1);
+		if (slot != last)
+		{
+			entities[slot] = entities[last];
+			components[slot] = components[last];
+			sparse[EntityId::Index(entities[slot])] = slot;
+		}
+		entities.pop_back();
+		components.pop_back();
+		sparse[EntityId::Index(entity)] = INVALID;
+	}
+
+	unsigned int Size() const { return static_cast<unsigned int>(entities.size()); }
+	// Dense arrays, index i of one belongs to index i of the other
+	const std::vector<Entity>& GetEntities() const { return entities; }
+	std::vector<T>& GetComponents() { return components; }
+	const std::vector<T>& GetComponents() const { return components; }
+
+private:
+	static const unsigned int INVALID = 0xFFFFFFFF;
+	std::vector<unsigned int> sparse;
+	std::vector<Entity> entities;
+	std::vector<T> components;
+};
+
+template<typename T>
+const unsigned int ComponentPool<T>::INVALID;
+
+// Owns entities and one component pool per component type. Systems iterate
+// the dense arrays directly or through Each. Adding or removing components of
+// an iterated type inside Each is not allowed.
+class Registry
+{
+public:
+	Entity Create();
+	void Destroy(Entity entity);
+	bool IsAlive(Entity entity) const;
+	void Clear();
+
+	unsigned int GetEntityCount() const { return aliveCount; }
+	// One past the largest entity index ever handed out, for per entity side tables
+	unsigned int GetIndexCapacity() const { return static_cast<unsigned int>(versions.size()); }
+
+	template<typename T>
+	ComponentPool<T>& Pool()
+	{
+		unsigned int type = TypeId<T>();
+		if (type >= pools.size())
+			pools.resize(type + 1);
+		if (!pools[type])
+			pools[type].reset(new ComponentPool<T>());
+		return *static_cast<ComponentPool<T>*>(pools[type].get());
+	}
+
+	template<typename T>
+	T& Add(Entity entity, const T& component = T()) { return Pool<T>().Add(entity, component); }
+	template<typename T>
+	T& Get(Entity entity) { return Pool<T>().Get(entity); }
+	template<typename T>
+	bool Has(Entity entity) { return Pool<T>().Has(entity); }
+	template<typename T>
+	void Remove(Entity entity) { Pool<T>().Remove(entity); }
+
+	// f(Entity, T&) for every entity with a T
+	template<typename T, typename Func>
+	void Each(Func f)
+	{
+		ComponentPool<T>& pool = Pool<T>();
+		const std::vector<Entity>& entities = pool.GetEntities();
+		std::vector<T>& components = pool.GetComponents();
+		for (unsigned int i = 0; i < entities.size(); i++)
+			f(entities[i], components[i]);
+	}
+
+	// f(Entity, A&, B&) for every entity with both, walking the smaller pool
+	template<typename A, typename B, typename Func>
+	void Each(Func f)
+	{
+		ComponentPool<A>& poolA = Pool<A>();
+		ComponentPool<B>& poolB = Pool<B>();
+		if (poolA.Size() <= poolB.Size())
+		{
+			const std::vector<Entity>& entities = poolA.GetEntities();
+			std::vector<A>& components = poolA.GetComponents();
+			for (unsigned int i = 0; i < entities.size(); i++)
+			{
+				if (poolB.Has(entities[i]))
+					f(entities[i], components[i], poolB.Get(entities[i]));
+			}
+		}
+		else
+		{
+			const std::vector<Entity>& entities = poolB.GetEntities();
+			std::vector<B>& components = poolB.GetComponents();
+			for (unsigned int i = 0; i < entities.size(); i++)
+			{
+				if (poolA.Has(entities[i]))
+					f(entities[i], poolA.Get(entities[i]), components[i]);
+			}
+		}
+	}
+
+private:
+	std::vector<unsigned int> versions;
+	std::vector<unsigned int> freeIndices;
+	unsigned int aliveCount = 0;
+	std::vector<std::unique_ptr<ComponentPoolBase>> pools;
+
+	static unsigned int NextTypeId();
+	template<typename T>
+	static unsigned int TypeId()
+	{
+		static unsigned int id = NextTypeId();
+		return id;
+	}
+};
@@ -0,0 +1,185 @@
+#include "SceneSystems.h"
+#include "..\Objects\Geometry\Mesh.h"
+#include "..\Objects\Geometry\Model.h"
+#include "..\Objects\Lights\LightManager.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <random>
+
+Entity CreatePointLight(Registry& registry, LightManager& lights, const PointLight& light)
+{
+	Entity entity = registry.Create();
+	PointLightComponent component;
+	component.light = light;
+	component.slot = lights.AddPointLight(light);
+	component.dirty = false;
+	registry.Add(entity, component);
+	return entity;
+}
+
+Entity CreateSpotLight(Registry& registry, LightManager& lights, const SpotLight& light, bool followCamera)
+{
+	Entity entity = registry.Create();
+	SpotLightComponent component;
+	component.light = light;
+	component.slot = lights.AddSpotLight(light);
+	component.dirty = false;
+	component.followCamera = followCamera;
+	registry.Add(entity, component);
+	return entity;
+}
+
+void CreateRandomPointLights(Registry& registry, LightManager& lights, unsigned int count, unsigned int seed, std::vector<Entity>& out)
+{
+	AABB area;
+	area.min = glm::vec3(-5.0f, 0.0f, -5.0f);
+	area.max = glm::vec3(5.0f, 3.0f, 5.0f);
+	bool first = true;
+	registry.Each<BoundsComponent>([&](Entity, BoundsComponent& bounds)
+	{
+		area.min = first ? bounds.world.min : glm::min(area.min, bounds.world.min);
+		area.max = first ? bounds.world.max : glm::max(area.max, bounds.world.max);
+		first = false;
+	});
+
+	std::mt19937 random(seed);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	for (unsigned int i = 0; i < count; i++)
+	{
+		PointLight light;
+		light.position = area.min + (area.max - area.min) * glm::vec3(unit(random), unit(random), unit(random));
+		glm::vec3 color(unit(random), unit(random), unit(random));
+		light.ambient = color * 0.01f;
+		light.diffuse = color;
+		light.specular = color;
+		// Attenuation falls to 1% at about seven units
+		light.constant = 1.0f;
+		light.linear = 0.7f;
+		light.quadratic = 1.8f;
+		out.push_back(CreatePointLight(registry, lights, light));
+	}
+}
+
+void DestroyLight(Registry& registry, LightManager& lights, Entity entity)
+{
+	// The manager swap-removes, whichever light held the last slot now holds the freed one
+	if (registry.Has<PointLightComponent>(entity))
+	{
+		unsigned int slot = registry.Get<PointLightComponent>(entity).slot;
+		unsigned int last = lights.GetPointLightCount() - 1;
+		lights.RemovePointLight(slot);
+		registry.Each<PointLightComponent>([&](Entity, PointLightComponent& other)
+		{
+			if (other.slot == last)
+				other.slot = slot;
+		});
+	}
+	if (registry.Has<SpotLightComponent>(entity))
+	{
+		unsigned int slot = registry.Get<SpotLightComponent>(entity).slot;
+		unsigned int last = lights.GetSpotLightCount() - 1;
+		lights.RemoveSpotLight(slot);
+		registry.Each<SpotLightComponent>([&](Entity, SpotLightComponent& other)
+		{
+			if (other.slot == last)
+				other.slot = slot;
+		});
+	}
+	registry.Destroy(entity);
+}
+
+void SyncLights(Registry& registry, LightManager& lights, const Camera& camera)
+{
+	registry.Each<PointLightComponent>([&](Entity, PointLightComponent& point)
+	{
+		if (!point.dirty)
+			return;
+		lights.SetPointLight(point.slot, point.light);
+		point.dirty = false;
+	});
+
+	registry.Each<SpotLightComponent>([&](Entity, SpotLightComponent& spot)
+	{
+		if (spot.followCamera)
+		{
+			spot.light.position = camera.Position;
+			spot.light.direction = camera.Front;
+			spot.dirty = true;
+		}
+		if (!spot.dirty)
+			return;
+		lights.SetSpotLight(spot.slot, spot.light);
+		spot.dirty = false;
+	});
+
+	registry.Each<DirectionalLightComponent>([&](Entity, DirectionalLightComponent& directional)
+	{
+		lights.DirLight = directional.light;
+	});
+}
+
+Camera& GetActiveCamera(Registry& registry)
+{
+	ComponentPool<CameraComponent>& cameras = registry.Pool<CameraComponent>();
+	std::vector<CameraComponent>& components = cameras.GetComponents();
+	for (CameraComponent& component : components)
+	{
+		if (component.active)
+			return component.camera;
+	}
+	return components.front().camera;
+}
+
+void UpdateModelTransforms(Registry& registry)
+{
+	registry.Each<ModelNodeComponent, TransformComponent>([&](Entity, ModelNodeComponent& node, TransformComponent& transform)
+	{
+		transform.world = node.placement * node.model->GetMeshTransform(node.mesh);
+	});
+}
+
+void UpdateSceneBounds(Registry& registry)
+{
+	registry.Each<MeshRendererComponent, TransformComponent>([&](Entity entity, MeshRendererComponent& renderer, TransformComponent& transform)
+	{
+		registry.Add(entity, BoundsComponent{ renderer.mesh->GetBounds().Transform(transform.world) });
+	});
+}
+
+SceneBenchmarkResult BenchmarkSceneIteration(unsigned int entityCount)
+{
+	Registry registry;
+	std::vector<Entity> entities(entityCount);
+	for (unsigned int i = 0; i < entityCount; i++)
+	{
+		entities[i] = registry.Create();
+		TransformComponent transform;
+		transform.world[3] = glm::vec4(static_cast<float>(i), 0.0f, 0.0f, 1.0f);
+		registry.Add(entities[i], transform);
+		if (i % 2 == 0)
+			registry.Add(entities[i], MeshRendererComponent());
+	}
+
+	SceneBenchmarkResult result;
+	float sum = 0.0f;
+	auto start = std::chrono::high_resolution_clock::now();
+	registry.Each<TransformComponent>([&](Entity, TransformComponent& transform) { sum += transform.world[3].x; });
+	result.singleMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+	start = std::chrono::high_resolution_clock::now();
+	registry.Each<MeshRendererComponent, TransformComponent>([&](Entity, MeshRendererComponent&, TransformComponent& transform) { sum += transform.world[3].x; });
+	result.joinMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+	std::shuffle(entities.begin(), entities.end(), std::mt19937(1234));
+	start = std::chrono::high_resolution_clock::now();
+	for (Entity entity : entities)
+		sum += registry.Get<TransformComponent>(entity).world[3].x;
+	result.lookupMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+	// Keeps the loops from being optimized away
+	if (sum < 0.0f)
+		std::cout << sum << "\n";
+	return result;
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include "Registry.h"
+#include "Components.h"
+
+class LightManager;
+
+// Light entities own a slot in the LightManager for their lifetime
+Entity CreatePointLight(Registry& registry, LightManager& lights, const PointLight& light);
+Entity CreateSpotLight(Registry& registry, LightManager& lights, const SpotLight& light, bool followCamera = false);
+void DestroyLight(Registry& registry, LightManager& lights, Entity entity);
+// Scatters count small colored point lights over the union of the mesh
+// bounds, for light count benchmarks. Appends the new entities to out.
+void CreateRandomPointLights(Registry& registry, LightManager& lights, unsigned int count, unsigned int seed, std::vector<Entity>& out);
+// Moves camera following spot lights and copies dirty lights into the manager
+void SyncLights(Registry& registry, LightManager& lights, const Camera& camera);
+
+// The first active camera, the registry must hold one
+Camera& GetActiveCamera(Registry& registry);
+
+// Copies model node world matrices into the transforms of entities placed from them
+void UpdateModelTransforms(Registry& registry);
+// Recomputes world boxes from transforms and mesh bounds
+void UpdateSceneBounds(Registry& registry);
+
+struct SceneBenchmarkResult
+{
+	double singleMs;  // Each over transforms
+	double joinMs;    // Each over transform and mesh renderer, half the entities have both
+	double lookupMs;  // Get in random entity order
+};
+SceneBenchmarkResult BenchmarkSceneIteration(unsigned int entityCount);
@@ -0,0 +1,162 @@
+#include "TransformHierarchy.h"
+#include "..\Core\JobSystem.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <random>
+
+void TransformHierarchy::Clear()
+{
+	parent.clear();
+	local.clear();
+	world.clear();
+	dirty.clear();
+	roots.clear();
+	subtreesContiguous = true;
+	anyDirty = false;
+}
+
+void TransformHierarchy::Reserve(unsigned int count)
+{
+	parent.reserve(count);
+	local.reserve(count);
+	world.reserve(count);
+	dirty.reserve(count);
+}
+
+unsigned int TransformHierarchy::Add(unsigned int parentNode, const glm::mat4& localTransform)
+{
+	unsigned int node = GetCount();
+	if (parentNode == NO_PARENT)
+		roots.push_back(node);
+	else if (roots.empty() || parentNode < roots.back())
+		subtreesContiguous = false;
+
+	parent.push_back(parentNode);
+	local.push_back(localTransform);
+	world.push_back(localTransform);
+	dirty.push_back(1);
+	anyDirty = true;
+	return node;
+}
+
+void TransformHierarchy::SetLocal(unsigned int node, const glm::mat4& localTransform)
+{
+	local[node] = localTransform;
+	dirty[node] = 1;
+	anyDirty = true;
+}
+
+unsigned int TransformHierarchy::UpdateRange(unsigned int first, unsigned int last)
+{
+	unsigned int updated = 0;
+	for (unsigned int i = first; i < last; i++)
+	{
+		unsigned int p = parent[i];
+		// Parents come first, so their flag already says whether they moved this pass
+		if (p != NO_PARENT && dirty[p])
+			dirty[i] = 1;
+		if (!dirty[i])
+			continue;
+
+		world[i] = (p == NO_PARENT) ? local[i] : world[p] * local[i];
+		updated++;
+	}
+	return updated;
+}
+
+unsigned int TransformHierarchy::Update()
+{
+	if (!anyDirty)
+		return 0;
+
+	unsigned int updated = UpdateRange(0, GetCount());
+	std::fill(dirty.begin(), dirty.end(), 0);
+	anyDirty = false;
+	return updated;
+}
+
+unsigned int TransformHierarchy::UpdateParallel()
+{
+	if (!anyDirty)
+		return 0;
+	unsigned int workers = g_jobSystem.GetWorkerCount();
+	if (!subtreesContiguous || workers < 2 || roots.size() < 2)
+		return Update();
+
+	// Split at root boundaries into roughly equal node ranges, a few per
+	// worker so stealing evens out uneven subtrees
+	std::vector<unsigned int> splits(1, 0u);
+	unsigned int ranges = workers * 4;
+	unsigned int target = (GetCount() + ranges - 1) / ranges;
+	for (unsigned int root : roots)
+	{
+		if (root - splits.back() >= target)
+			splits.push_back(root);
+	}
+	splits.push_back(GetCount());
+
+	std::atomic<unsigned int> updated(0);
+	g_jobSystem.ParallelFor(static_cast<unsigned int>(splits.size() - 1), 1, [&](unsigned int first, unsigned int last)
+	{
+		for (unsigned int i = first; i < last; i++)
+			updated += UpdateRange(splits[i], splits[i + 1]);
+	});
+
+	std::fill(dirty.begin(), dirty.end(), 0);
+	anyDirty = false;
+	return updated;
+}
+
+TransformHierarchy::BenchmarkResult TransformHierarchy::Benchmark(unsigned int nodeCount)
+{
+	std::mt19937 random(1234);
+	std::uniform_real_distribution<float> offsets(-1.0f, 1.0f);
+	std::uniform_int_distribution<int> childCounts(0, 3);
+
+	// Depth first random trees, each root gets a fresh subtree
+	TransformHierarchy hierarchy;
+	hierarchy.Reserve(nodeCount);
+	std::vector<std::pair<unsigned int, int>> stack;
+	while (hierarchy.GetCount() < nodeCount)
+	{
+		if (stack.empty())
+			stack.push_back({ hierarchy.Add(NO_PARENT, glm::mat4(1.0f)), 0 });
+
+		std::pair<unsigned int, int> top = stack.back();
+		stack.pop_back();
+		if (top.second >= 8)
+			continue;
+		for (int child = childCounts(random); child > 0 && hierarchy.GetCount() < nodeCount; child--)
+		{
+			glm::mat4 childLocal = glm::translate(glm::mat4(1.0f), glm::vec3(offsets(random), offsets(random), offsets(random)));
+			stack.push_back({ hierarchy.Add(top.first, childLocal), top.second + 1 });
+		}
+	}
+	hierarchy.Update();
+
+	BenchmarkResult result;
+	result.threads = g_jobSystem.GetWorkerCount();
+
+	std::fill(hierarchy.dirty.begin(), hierarchy.dirty.end(), 1);
+	hierarchy.anyDirty = true;
+	auto start = std::chrono::high_resolution_clock::now();
+	hierarchy.Update();
+	result.fullMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+	std::fill(hierarchy.dirty.begin(), hierarchy.dirty.end(), 1);
+	hierarchy.anyDirty = true;
+	start = std::chrono::high_resolution_clock::now();
+	hierarchy.UpdateParallel();
+	result.parallelMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+	for (unsigned int i = 0; i < hierarchy.roots.size(); i += 100)
+		hierarchy.SetLocal(hierarchy.roots[i], glm::translate(glm::mat4(1.0f), glm::vec3(1.0f, 0.0f, 0.0f)));
+	start = std::chrono::high_resolution_clock::now();
+	hierarchy.Update();
+	result.partialMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	return result;
+}
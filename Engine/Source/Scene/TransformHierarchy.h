@@ -0,0 +1,55 @@
+#pragma once
+#include <glm/glm.hpp>
+
+#include <vector>
+
+// Node transforms stored as parallel arrays in topological order: a parent
+// is always added before its children, so one forward pass sees every parent
+// before its children. Only nodes whose local matrix changed, or whose
+// parent's world matrix changed, are recomputed.
+//
+// Subtrees added depth first (each root followed by all of its descendants)
+// occupy contiguous ranges and are updated as separate jobs by
+// UpdateParallel. Adding to an earlier root's subtree later breaks that and
+// falls back to the serial pass.
+class TransformHierarchy
+{
+public:
+	static const unsigned int NO_PARENT = 0xFFFFFFFF;
+
+	void Clear();
+	void Reserve(unsigned int count);
+	unsigned int Add(unsigned int parent, const glm::mat4& local);
+
+	void SetLocal(unsigned int node, const glm::mat4& local);
+	const glm::mat4& GetLocal(unsigned int node) const { return local[node]; }
+	const glm::mat4& GetWorld(unsigned int node) const { return world[node]; }
+	unsigned int GetParent(unsigned int node) const { return parent[node]; }
+	unsigned int GetCount() const { return static_cast<unsigned int>(parent.size()); }
+
+	// Returns the number of world matrices recomputed
+	unsigned int Update();
+	unsigned int UpdateParallel();
+
+	struct BenchmarkResult
+	{
+		double fullMs;      // every node dirty, one thread
+		double parallelMs;  // every node dirty, all job system workers
+		double partialMs;   // one percent of the roots dirty, one thread
+		unsigned int threads;
+	};
+	// Random forest of nodeCount nodes, depth first with up to 8 levels
+	static BenchmarkResult Benchmark(unsigned int nodeCount);
+
+private:
+	std::vector<unsigned int> parent;
+	std::vector<glm::mat4> local;
+	std::vector<glm::mat4> world;
+	std::vector<unsigned char> dirty;
+
+	std::vector<unsigned int> roots;
+	bool subtreesContiguous = true;
+	bool anyDirty = false;
+
+	unsigned int UpdateRange(unsigned int first, unsigned int last);
+};
@@ -7,9 +7,31 @@
 #include <imgui/imgui_impl_glfw.h>
 #include <imgui/imgui_impl_opengl3.h>
 
+#include <chrono>
+
+#include "Core/JobSystem.h"
 #include "Objects/Geometry/Model.h"
 #include "Objects/Camera/Camera.h"
+#include "Objects/Camera/Frustum.h"
+#include "Scene/BVH.h"
+#include "Scene/OcclusionCuller.h"
+#include "Scene/SceneSystems.h"
 #include "Objects/Lights/Lights.h"
+#include "Objects/Lights/LightManager.h"
+#include "Objects/Lights/LightClusters.h"
+#include "Objects/Lights/ShadowCascades.h"
+#include "Graphics/GLExtensions.h"
+#include "Graphics/RenderState.h"
+#include "Graphics/RenderGraph.h"
+#include "Graphics/DrawBucket.h"
+#include "Graphics/InstanceBuffer.h"
+#include "Graphics/GeometryPool.h"
+#include "Graphics/GpuProfiler.h"
+#include "Graphics/MaterialTextures.h"
+#include "Graphics/Materials.h"
+#include "Graphics/OcclusionQueries.h"
+#include "Graphics/UniformBuffer.h"
+#include "Graphics/UniformBlocks.h"
 
 #define ThrowError(x) throw std::runtime_error(x)
 
@@ -24,6 +46,12 @@
 
 int g_windowWidth = 1600;
 int g_windowHeight = 900;
+// Render targets are sized to the window once it has kept its size for
+// RESIZE_SETTLE_FRAMES frames, so dragging the window edge does not create
+// a set of targets per frame. Until then the last image is stretched.
+int g_renderWidth = g_windowWidth;
+int g_renderHeight = g_windowHeight;
+const int RESIZE_SETTLE_FRAMES = 10;
 int g_msaaSamples = 4;
 
 float skyboxVertices[] = {
@@ -96,25 +124,130 @@ float planeVertices[] = {
 
 // Lights
 //-------
-PointLight pointLight;
-SpotLight spotLight;
-DirectionalLight dirLight;
-
-// Objects
-//--------
-Camera camera(glm::vec3(0.0f, 0.0f, 3.0f));
+LightManager lightManager;
+Entity pointLightEntity = NULL_ENTITY;
+Entity flashlightEntity = NULL_ENTITY;
+bool flashlightEnabled = false;
+// Copies of fileModel submitted each frame, more than one exercises instancing
+int modelCopies = 1;
+
+// Assets
+//-------
 Model fileModel;
+Mesh floorMesh;
+
+// Scene
+//------
+// Camera, lights and every mesh placed in the world are entities, the BVH
+// stores the entities of mesh renderers
+Registry scene;
+BVH sceneBVH;
+int sceneModelCopies = 0;
+std::vector<Entity> visibleItems;
+// Command lists recorded as parallel jobs, a list is only used per RECORD_BATCH visible items
+int recordLists = 1;
+const unsigned int RECORD_BATCH = 512;
+
+// Culling and recording of one RenderScene call. Only the camera's color or
+// G-buffer pass reports them, shadow and pre-pass calls would overwrite it.
+struct SceneStats
+{
+	unsigned int visible = 0;
+	double queryUs = 0.0;
+	unsigned int occlusionTested = 0;
+	unsigned int occlusionHidden = 0;
+	double occlusionTestUs = 0.0;
+	double recordUs = 0.0;
+};
+SceneStats cameraSceneStats;
+
+OcclusionCuller occlusionCuller;
+OcclusionQueries occlusionQueries;
+
+// Shading benchmark
+//------------------
+// Renders FRAMES frames per light count and shading path and averages the
+// GPU time of the shading passes. Driven by the frame loop because GPU
+// timings come back a few frames late, WARMUP_FRAMES covers that latency.
+struct ShadingBenchmark
+{
+	static const unsigned int FRAMES = 60;
+	static const unsigned int WARMUP_FRAMES = 10;
+
+	enum Path { FORWARD, CLUSTERED, DEFERRED, PATH_COUNT };
+
+	struct Result
+	{
+		unsigned int lights;
+		double forwardMs;
+		double clusteredMs;
+		double deferredMs;
+	};
+
+	std::vector<unsigned int> lightCounts = { 1, 16, 64, 256, 1024 };
+	std::vector<Result> results;
+	std::vector<Entity> lights;
+	int step = -1;  // light count index * PATH_COUNT + path, -1 when idle
+	unsigned int frame = 0;
+	double totalMs = 0.0;
+
+	bool IsRunning() const { return step >= 0; }
+	Path GetPath() const { return static_cast<Path>(step % PATH_COUNT); }
+	unsigned int GetLightCount() const { return lightCounts[step / PATH_COUNT]; }
+	void Start();
+	// Spawns the lights of the current step
+	void BeginFrame();
+	void EndFrame(double shadingMs);
+};
+ShadingBenchmark shadingBenchmark;
+
+void ShadingBenchmark::Start()
+{
+	results.clear();
+	for (unsigned int count : lightCounts)
+		results.push_back(Result{ count, 0.0, 0.0, 0.0 });
+	step = 0;
+	frame = 0;
+	totalMs = 0.0;
+}
+
+void ShadingBenchmark::BeginFrame()
+{
+	unsigned int target = GetLightCount();
+	if (frame == 0 && lights.size() < target)
+		CreateRandomPointLights(scene, lightManager, target - static_cast<unsigned int>(lights.size()), target, lights);
+}
+
+void ShadingBenchmark::EndFrame(double shadingMs)
+{
+	if (frame >= WARMUP_FRAMES)
+		totalMs += shadingMs;
+	if (++frame < FRAMES)
+		return;
+
+	double averageMs = totalMs / (FRAMES - WARMUP_FRAMES);
+	Result& result = results[step / PATH_COUNT];
+	if (GetPath() == DEFERRED)
+		result.deferredMs = averageMs;
+	else if (GetPath() == CLUSTERED)
+		result.clusteredMs = averageMs;
+	else
+		result.forwardMs = averageMs;
+	frame = 0;
+	totalMs = 0.0;
+	if (++step < static_cast<int>(lightCounts.size() * PATH_COUNT))
+		return;
+
+	for (Entity light : lights)
+		DestroyLight(scene, lightManager, light);
+	lights.clear();
+	step = -1;
+}
 
 // Buffers and Textures
 //---------------------
 unsigned int planeVAO, planeVBO;
-unsigned int floorDiffTextureGammaCorrected;
-unsigned int floorSpecTextureGammaCorrected;
-unsigned int floorNormTextureGammaCorrected;
-unsigned int brickDiffTextureGammaCorrected;
-unsigned int brickNormalTextureGammaCorrected;
-unsigned int brickDepthTextureGammaCorrected;
-unsigned int cubemapTexture;
+UniformRingBuffer g_uniformRing;
 
 // Mouse
 //------
@@ -136,19 +269,28 @@ void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
 unsigned int loadTexture(char const * path, bool gammaCorrection);
 unsigned int loadCubeMap(std::vector<std::string> faces);
 void ProcessInput(GLFWwindow* pWindow);
-void RenderScene(const Shader& shader);
+void BuildScene();
+// Submits the items inside frustum, or every item when it is null. Items the
+// occlusion culler reports hidden are skipped when one is given, items the
+// query scheduler holds back are drawn by it after the bucket.
+void RenderScene(DrawBucket& bucket, const Shader& shader, const Frustum* frustum = nullptr,
+	const OcclusionCuller* occlusion = nullptr, OcclusionQueries* queries = nullptr, SceneStats* stats = nullptr);
 void renderCube();
-void renderFloorQuad();
+Mesh CreateFloorMesh(unsigned int diffuseTexture, unsigned int specularTexture, unsigned int normalTexture);
 void CleanUp();
 
 int main()
 {
+	g_jobSystem.Init();
+	recordLists = static_cast<int>(g_jobSystem.GetWorkerCount());
 	glfwInit();
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
 	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 	glfwWindowHint(GLFW_RESIZABLE, GL_TRUE);
-	glfwWindowHint(GLFW_SAMPLES, g_msaaSamples);
+	// The scene is multisampled in its own targets and resolved into the window,
+	// blits into a multisampled default framebuffer are invalid
+	glfwWindowHint(GLFW_SAMPLES, 0);
 
 	GLFWwindow* pWindow = glfwCreateWindow(g_windowWidth, g_windowHeight, "OpenGL Engine!", NULL, NULL);
 	if (pWindow == nullptr)
@@ -178,6 +320,16 @@ int main()
 		ThrowError("Failed to initialize GLAD!");
 		return -1;
 	}
+	GLExtensions::Load((GLADloadproc)glfwGetProcAddress);
+	g_renderState.Init(GLFunctionTable::FromGlad());
+	g_uniformRing.Init(1 << 20);
+	g_instanceBuffer.Init(16384);
+	g_materialTextures.Init();
+	g_materials.Init();
+	Mesh::ResetInstanceAttribute(g_renderState);
+	if (GLExtensions::MultiDrawIndirect)
+		g_geometryPool.Init(g_instanceBuffer.GetBufferID());
+	occlusionQueries.Init();
 	glEnable(GL_MULTISAMPLE);
 
 	glViewport(0, 0, g_windowWidth, g_windowHeight);
@@ -218,67 +370,17 @@ int main()
 	glEnableVertexAttribArray(1);
 	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)(2 * sizeof(float)));
 
-	// Create msaa buffer
-	unsigned int frameBuffer;
-	glGenFramebuffers(1, &frameBuffer);
-	glBindFramebuffer(GL_FRAMEBUFFER, frameBuffer);
-	// Create the texture color buffer
-	unsigned int textureColorBufferMultiSampled;
-	glGenTextures(1, &textureColorBufferMultiSampled);
-	glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, textureColorBufferMultiSampled);
-	glTexImage2DMultisample(GL_TEXTURE_2D_MULTISAMPLE, g_msaaSamples, GL_RGB, g_windowWidth, g_windowHeight, GL_TRUE);
-	glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, 0);
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D_MULTISAMPLE, textureColorBufferMultiSampled, 0);
-	// Create render buffer
-	unsigned int rbo;
-	glGenRenderbuffers(1, &rbo);
-	glBindRenderbuffer(GL_RENDERBUFFER, rbo);
-	glRenderbufferStorageMultisample(GL_RENDERBUFFER, g_msaaSamples, GL_DEPTH24_STENCIL8, g_windowWidth, g_windowHeight);
-	glBindRenderbuffer(GL_RENDERBUFFER, 0);
-	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, rbo);
-	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
-		ThrowError("ERROR::FRAMEBUFFER::Framebuffer is not complete!");
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
-	// Create post process screen buffer; We need to create a regular texture to ba able to apply it to the screen quad in the shader
-	unsigned int intermediateFBO;
-	glGenFramebuffers(1, &intermediateFBO);
-	glBindFramebuffer(GL_FRAMEBUFFER, intermediateFBO);
-	unsigned int screenTexture;
-	glGenTextures(1, &screenTexture);
-	glBindTexture(GL_TEXTURE_2D, screenTexture);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, g_windowWidth, g_windowHeight, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, screenTexture, 0);
-	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
-		std::cout << "ERROR::FRAMEBUFFER:: Intermediate framebuffer is not complete!\n";
-	}
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
 	Shader screenShader("Shaders/ScreenQuadPostProcess.vert", "Shaders/ScreenQuadPostProcess.frag");
+	screenShader.Use();
 	screenShader.SetInt("screenTexture", 0);
 
-	// Generate shadow map frame buffer
-	const unsigned int SHADOW_WIDTH = 1024, SHADOW_HEIGHT = 1024;
-	unsigned int depthMapFBO;
-	glGenFramebuffers(1, &depthMapFBO);
-	// create depth texture
-	unsigned int shadowMap;
-	glGenTextures(1, &shadowMap);
-	glBindTexture(GL_TEXTURE_2D, shadowMap);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, SHADOW_WIDTH, SHADOW_HEIGHT, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
-	float borderColor[] = { 1.0f, 1.0f, 1.0f, 1.0f };
-	glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, borderColor);
-	// attach depth texture as FBO's depth buffer
-	glBindFramebuffer(GL_FRAMEBUFFER, depthMapFBO);
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, shadowMap, 0);
-	glDrawBuffer(GL_NONE);
-	glReadBuffer(GL_NONE);
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	// Render targets are created by the frame graph
+	RenderTargetPool renderTargets;
+	RenderGraph renderGraph(renderTargets);
+	renderGraph.SetProfiler(&g_gpuProfiler);
+	int settledFrames = 0;
+	int lastWindowWidth = g_windowWidth;
+	int lastWindowHeight = g_windowHeight;
 	Shader lightingDepthShader("Shaders/lightDepthPass.vert", "Shaders/lightDepthPass.frag");
 
 	// Create cube map
@@ -290,45 +392,82 @@ int main()
 		"../Assets//Skyboxes/Lake/front.jpg",
 		"../Assets//Skyboxes/Lake/back.jpg",
 	};
-	cubemapTexture = loadCubeMap(faces);
+	unsigned int cubemapTexture = loadCubeMap(faces);
 
 	// Compile shaders
-	Shader lightingShader("Shaders/VertexShader.vert", "Shaders/FragmentShader.frag");
+	// Every variant samples material textures from arrays, through bindless handles when available
+	std::string textureDefines = g_materialTextures.GetShaderDefines();
+	Shader lightingShader("Shaders/VertexShader.vert", "Shaders/FragmentShader.frag", "", textureDefines.c_str());
+	// Depth pre-pass variants, the pre-pass applies the parallax discard so the equal tested color pass can skip it
+	Shader depthPrePassShader("Shaders/VertexShader.vert", "Shaders/FragmentShader.frag", "", (textureDefines + "#define DEPTH_ONLY\n").c_str());
+	Shader lightingEqualShader("Shaders/VertexShader.vert", "Shaders/FragmentShader.frag", "", (textureDefines + "#define DEPTH_EQUAL\n").c_str());
+	// Clustered forward variants, each fragment only loops over the lights binned into its cluster
+	Shader lightingClusteredShader("Shaders/VertexShader.vert", "Shaders/FragmentShader.frag", "", (textureDefines + "#define CLUSTERED\n").c_str());
+	Shader lightingEqualClusteredShader("Shaders/VertexShader.vert", "Shaders/FragmentShader.frag", "",
+		(textureDefines + "#define DEPTH_EQUAL\n#define CLUSTERED\n").c_str());
+	// Deferred path, the G-buffer pass shares the forward vertex shader and parallax code
+	Shader gbufferShader("Shaders/VertexShader.vert", "Shaders/FragmentShader.frag", "", (textureDefines + "#define GBUFFER\n").c_str());
+	Shader deferredLightingShader("Shaders/ScreenQuadPostProcess.vert", "Shaders/DeferredLighting.frag");
 	Shader lampShader("Shaders/lamp.vert", "Shaders/lamp.frag");
+	Shader boundingBoxShader("Shaders/boundingBox.vert", "Shaders/lightDepthPass.frag");
 	Shader skyboxShader("Shaders/Skybox.vert", "Shaders/Skybox.frag");
 	Shader geometryShader("Shaders/GPUGeometry.vert", "Shaders/GPUGeometry.frag", "Shaders/GPUGeometry.geom");
 
-	unsigned int ubiLightingShader = glGetUniformBlockIndex(lightingShader.ProgramID, "Matrices");
-	glUniformBlockBinding(lightingShader.ProgramID, ubiLightingShader, 0);
-	unsigned int uboMatrices;
-	glGenBuffers(1, &uboMatrices);
-	glBindBuffer(GL_UNIFORM_BUFFER, uboMatrices);
-	glBufferData(GL_UNIFORM_BUFFER, 2 * sizeof(glm::mat4), NULL, GL_STATIC_DRAW);
-	glBindBuffer(GL_UNIFORM_BUFFER, 0);
-	glBindBufferRange(GL_UNIFORM_BUFFER, 0, uboMatrices, 0, 2 * sizeof(glm::mat4));
-	glm::mat4 projectionMat = glm::perspective(glm::radians(camera.Zoom), (float)g_windowWidth / (float)g_windowHeight, 0.1f, 100.0f);
-	glBindBuffer(GL_UNIFORM_BUFFER, uboMatrices);
-	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(glm::mat4), glm::value_ptr(projectionMat));
-	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	// Sampler units never change, everything else is streamed through uniform blocks
+	for (Shader* shader : { &lightingShader, &depthPrePassShader, &lightingEqualShader, &lightingClusteredShader,
+		&lightingEqualClusteredShader, &gbufferShader })
+	{
+		shader->Use();
+		for (unsigned int slot = 0; slot < MaterialTextures::MAX_BOUND_ARRAYS; slot++)
+			shader->SetInt("materialArrays[" + std::to_string(slot) + "]", MaterialTextures::FIRST_UNIT + slot);
+		shader->SetInt("materialBuffer", 2);
+		shader->SetInt("shadowMap", 3);
+		shader->SetInt("depthMap", 4);
+		shader->SetInt("pointLightBuffer", 5);
+		shader->SetInt("spotLightBuffer", 6);
+		shader->SetInt("clusterBuffer", 7);
+		shader->SetInt("clusterLightBuffer", 8);
+	}
+	skyboxShader.Use();
+	skyboxShader.SetInt("skybox", 0);
+	deferredLightingShader.Use();
+	deferredLightingShader.SetInt("gAlbedo", 0);
+	deferredLightingShader.SetInt("gNormalShininess", 1);
+	deferredLightingShader.SetInt("gDepth", 2);
+	deferredLightingShader.SetInt("skybox", 3);
+	deferredLightingShader.SetInt("shadowMap", 4);
+	deferredLightingShader.SetInt("pointLightBuffer", 5);
+	deferredLightingShader.SetInt("spotLightBuffer", 6);
+	deferredLightingShader.SetInt("gSpecular", 7);
+
+	Entity cameraEntity = scene.Create();
+	scene.Add(cameraEntity, CameraComponent{ Camera(glm::vec3(0.0f, 4.0f, 10.0f)) });
 	
-	floorDiffTextureGammaCorrected = loadTexture("../Assets/Textures/Planks_Diff.png", true);
-	floorNormTextureGammaCorrected = loadTexture("../Assets/Textures/Planks_Norm.png", false);
-	floorSpecTextureGammaCorrected = loadTexture("../Assets/Textures/Planks_Spec.png", true);
-	brickDiffTextureGammaCorrected = loadTexture("../Assets/Textures/bricks2_diff.jpg", true);
-	brickNormalTextureGammaCorrected = loadTexture("../Assets/Textures/bricks2_normal.jpg", false);
-	brickDepthTextureGammaCorrected = loadTexture("../Assets/Textures/bricks2_disp.jpg", false);
+	unsigned int floorSpecTextureGammaCorrected = loadTexture("../Assets/Textures/Planks_Spec.png", true);
+	unsigned int brickDiffTextureGammaCorrected = loadTexture("../Assets/Textures/bricks2_diff.jpg", true);
+	unsigned int brickNormalTextureGammaCorrected = loadTexture("../Assets/Textures/bricks2_normal.jpg", false);
+	unsigned int brickDepthTextureGammaCorrected = loadTexture("../Assets/Textures/bricks2_disp.jpg", false);
 
+	// The floor uses the brick maps with the plank specular map
+	floorMesh = CreateFloorMesh(brickDiffTextureGammaCorrected, floorSpecTextureGammaCorrected, brickNormalTextureGammaCorrected);
 	fileModel.Init("../Assets/Models/Dandelion/Textured_Flower.obj");
 	//fileModel.Init("../Assets/Models/Primatives/Cube.obj");
 	//fileModel.Init("../Assets/Models/nanosuit/nanosuit.obj");
 	//fileModel.Init("../Assets/Models/sponza/sponza.obj");
 	//Model light("../Assets/Models/Primatives/Cube.obj");
 
+	lightManager.Init();
+	LightClusters lightClusters;
+	lightClusters.Init();
+	std::vector<glm::vec4> lightSpheres;
+	PointLight pointLight;
 	pointLight.ambient = glm::vec3(0.05f);
 	pointLight.diffuse = glm::vec3(0.8f);
 	pointLight.specular = glm::vec3(1.0f);
 	pointLight.linear = 0.09f;
 	pointLight.quadratic = 0.032f;
+	pointLightEntity = CreatePointLight(scene, lightManager, pointLight);
+	scene.Add(scene.Create(), DirectionalLightComponent());
 
 	bool postProcessEnabled = true;
 	bool filmGrainEnabled = true;
@@ -338,15 +477,58 @@ int main()
 	float vignetteOuterRadius = 1.0f;
 	float vignetteOpacity = 1.0f;
 
-	float near_plane = 1.0f, far_plane = 27.5f;
-	camera.Position = glm::vec3(0.0f, 4.0f, 10.0f);
-	glm::vec3 lightPos(-2.0f, 4.0f, -1.0f);
+	ShadowCascades shadowCascades;
+	bool sunEnabled = true;
+	// Shadows end here, the cascades split the camera frustum up to it
+	float shadowDistance = 50.0f;
+	bool cascadeTintEnabled = false;
+	bool shadowPreviewEnabled = false;
+	int previewCascade = 0;
+	unsigned int shadowDrawCalls = 0;
+	unsigned int shadowInstancedDrawCalls = 0;
+	bool casterCullingEnabled = true;
+	// Casters recorded and casters drawn per cascade
+	unsigned int shadowCasters = 0;
+	unsigned int cascadeCasters[ShadowCascades::MAX_CASCADES] = {};
+	double casterCullUs = 0.0;
 
 	glEnable(GL_CULL_FACE);
 	glEnable(GL_DEPTH_TEST);
 
 	float parallaxHeightScale = 0.1f;
 
+	DrawBucket shadowBucket(PASS_SHADOW);
+	DrawBucket opaqueBucket(PASS_OPAQUE);
+	DrawBucket depthBucket(PASS_DEPTH);
+	bool depthPrePassEnabled = false;
+	bool deferredEnabled = false;
+	bool clusteredEnabled = false;
+	// Linear intensity at which a light stops counting for its clusters
+	float clusterCutoff = 1.0f / 256.0f;
+	LightClusters::BenchmarkResult clusterBenchmark = {};
+	bool clustersBenchmarked = false;
+	double sortBenchmarkUs = -1.0;
+	bool instancingEnabled = true;
+	bool multiDrawEnabled = true;
+	bool cullingEnabled = true;
+	double cullBenchmarkUs = -1.0;
+	std::vector<DrawBucket::RecordBenchmarkResult> recordBenchmark;
+	unsigned int cullBenchmarkVisible = 0;
+	bool bvhEnabled = true;
+	BVH::BenchmarkResult bvhBenchmark = {};
+	bool bvhBenchmarked = false;
+	TransformHierarchy::BenchmarkResult transformBenchmark = {};
+	bool transformsBenchmarked = false;
+	// Model node turning around its own y axis, -1 for none
+	int spinNode = -1;
+	glm::mat4 spinNodeRest(1.0f);
+	bool occlusionEnabled = true;
+	bool queriesEnabled = false;
+	SceneBenchmarkResult sceneBenchmark = {};
+	JobSystem::BenchmarkResult jobBenchmark = {};
+	bool jobsBenchmarked = false;
+	bool sceneBenchmarked = false;
+
 	while (!glfwWindowShouldClose(pWindow))
 	{
 		float currentTime = static_cast<float>(glfwGetTime());
@@ -354,117 +536,282 @@ int main()
 		g_lastFrame = currentTime;
 
 		ProcessInput(pWindow);
+		Camera& camera = GetActiveCamera(scene);
+
+		Shader::UniformStats uniformStats = Shader::FrameStats;
+		Shader::ResetFrameStats();
+		RenderState::Stats stateStats = g_renderState.FrameStats;
+		g_renderState.ResetFrameStats();
+
+		// Packs the textures and materials of meshes created since the last frame
+		g_materialTextures.Update();
+		g_materials.OnTexturesDeleted(g_materialTextures.GetDeletedTextures());
+		g_materials.Upload();
+		// Loading code and ImGui touch GL state directly, start every frame from a clean slate
+		g_renderState.Invalidate();
+		g_uniformRing.BeginFrame();
+		g_instanceBuffer.BeginFrame();
+		g_geometryPool.BeginFrame();
+		g_gpuProfiler.BeginFrame();
 
 		glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
 		IMGUI_NEW_FRAME;
+
+		ImGui::Begin("Render Stats");
+		{
+			ImGui::Text("Uniform uploads issued: %u", uniformStats.issued);
+			ImGui::Text("Uniform uploads skipped: %u (%u inactive)", uniformStats.skipped, uniformStats.inactive);
+			ImGui::Text("State changes issued: %u", stateStats.issued);
+			ImGui::Text("State changes elided: %u", stateStats.elided);
+			ImGui::Text("Texture binds: %u", stateStats.textureBinds);
+			ImGui::Text("Material texture arrays: %u %s, %u layers, %.1f MB, %u rebuilds", g_materialTextures.GetArrayCount(),
+				g_materialTextures.IsBindless() ? "bindless" : "bound", g_materialTextures.GetLayerCount(),
+				g_materialTextures.GetArrayBytes() / (1024.0f * 1024.0f), g_materialTextures.Rebuilds);
+			ImGui::Text("Materials: %u (%u duplicates merged), %u textures loaded (%u shared)", g_materials.GetCount(),
+				g_materials.Deduplicated, g_materials.TexturesLoaded, g_materials.TextureCacheHits);
+			ImGui::Text("Uniform blocks streamed: %u (%u bytes)", g_uniformRing.BlocksPushed, g_uniformRing.BytesUsed);
+			ImGui::Text("Fence wait: %.3f ms (uniforms %.3f, instances %.3f, indirect %.3f)",
+				g_uniformRing.FenceWaitMs + g_instanceBuffer.FenceWaitMs + g_geometryPool.FenceWaitMs,
+				g_uniformRing.FenceWaitMs, g_instanceBuffer.FenceWaitMs, g_geometryPool.FenceWaitMs);
+			ImGui::Text("Draw packets: %u shadow, %u opaque", shadowBucket.GetPacketCount(), opaqueBucket.GetPacketCount());
+			ImGui::Text("Draw sort: %.1f us", shadowBucket.SortTimeUs + opaqueBucket.SortTimeUs);
+			if (ImGui::Button("Benchmark sort (100k packets)"))
+				sortBenchmarkUs = DrawBucket::BenchmarkSort(100000);
+			if (sortBenchmarkUs >= 0.0)
+				ImGui::Text("100k packet radix sort: %.1f us", sortBenchmarkUs);
+			ImGui::Text("Draw calls: %u shadow, %u opaque (%u instanced)", shadowDrawCalls, opaqueBucket.DrawCalls,
+				shadowInstancedDrawCalls + opaqueBucket.InstancedDrawCalls);
+			ImGui::Text("Instances streamed: %u", g_instanceBuffer.InstancesPushed);
+			ImGui::Text("Frustum culling: %u visible, %u culled (%.1f us)", opaqueBucket.VisibleCount, opaqueBucket.CulledCount, opaqueBucket.CullTimeUs);
+			ImGui::Checkbox("Frustum culling", &cullingEnabled);
+			if (ImGui::Button("Benchmark cull (1M boxes)"))
+				cullBenchmarkUs = Frustum::BenchmarkCull(1000000, cullBenchmarkVisible);
+			if (cullBenchmarkUs >= 0.0)
+				ImGui::Text("1M box cull: %.1f us, %u visible", cullBenchmarkUs, cullBenchmarkVisible);
+			ImGui::Checkbox("Instancing", &instancingEnabled);
+			if (g_geometryPool.IsEnabled())
+			{
+				ImGui::Checkbox("Multi draw indirect", &multiDrawEnabled);
+				ImGui::Text("Indirect commands: %u", g_geometryPool.CommandsPushed);
+			}
+			else
+				ImGui::Text("Multi draw indirect: needs GL 4.3");
+			ImGui::SliderInt("Model copies", &modelCopies, 1, 1024);
+			ImGui::SliderInt("Recording lists", &recordLists, 1, static_cast<int>(g_jobSystem.GetWorkerCount()));
+			ImGui::Text("Command recording: %.1f us in %u lists", cameraSceneStats.recordUs, opaqueBucket.GetCommandListCount());
+			if (ImGui::Button("Benchmark recording (50k draws)"))
+				recordBenchmark = DrawBucket::BenchmarkRecording(lightingShader, fileModel.GetMeshes(), 50000);
+			for (const DrawBucket::RecordBenchmarkResult& result : recordBenchmark)
+				ImGui::Text("%u threads: record %.2f ms, sort %.2f ms, null submit %.2f ms (%u draws, %u state changes)",
+					result.threads, result.recordMs, result.sortMs, result.submitMs, result.drawCalls, result.stateChanges);
+		}
+		ImGui::End();
+
+		if (modelCopies != sceneModelCopies)
+			BuildScene();
+
+		ImGui::Begin("Scene BVH");
+		{
+			ImGui::Checkbox("BVH culling", &bvhEnabled);
+			ImGui::Text("Items: %u, nodes: %u, rebuilds: %u", sceneBVH.GetItemCount(), sceneBVH.GetNodeCount(), sceneBVH.Rebuilds);
+			ImGui::Text("Frustum query: %u visible (%.1f us)", cameraSceneStats.visible, cameraSceneStats.queryUs);
+
+			float hitDistance;
+			unsigned int hitItem;
+			if (sceneBVH.Raycast(camera.Position, camera.Front, hitDistance, hitItem))
+				ImGui::Text("Center ray: entity %u at %.2f", EntityId::Index(hitItem), hitDistance);
+			else
+				ImGui::Text("Center ray: no hit");
+
+			if (ImGui::Button("Benchmark BVH (100k boxes)"))
+			{
+				bvhBenchmark = BVH::Benchmark(100000);
+				bvhBenchmarked = true;
+			}
+			if (bvhBenchmarked)
+			{
+				ImGui::Text("SAH build: %.2f ms, refit: %.2f ms", bvhBenchmark.buildMs, bvhBenchmark.refitMs);
+				ImGui::Text("Frustum query: %.1f us tree, %.1f us linear, %u visible",
+					bvhBenchmark.queryUs, bvhBenchmark.linearQueryUs, bvhBenchmark.visible);
+				if (bvhBenchmark.visible != bvhBenchmark.linearVisible)
+					ImGui::Text("Mismatch: linear pass found %u visible", bvhBenchmark.linearVisible);
+			}
+
+			ImGui::Text("Model nodes: %u", fileModel.GetNodeCount());
+			int spinSelection = spinNode;
+			ImGui::SliderInt("Spin node", &spinSelection, -1, static_cast<int>(fileModel.GetNodeCount()) - 1);
+			if (spinSelection != spinNode)
+			{
+				if (spinNode >= 0)
+					fileModel.SetNodeTransform(spinNode, spinNodeRest);
+				spinNode = spinSelection;
+				if (spinNode >= 0)
+					spinNodeRest = fileModel.GetNodeTransform(spinNode);
+			}
+			ImGui::Text("Entities: %u", scene.GetEntityCount());
+			if (ImGui::Button("Benchmark entity iteration (1M entities)"))
+			{
+				sceneBenchmark = BenchmarkSceneIteration(1000000);
+				sceneBenchmarked = true;
+			}
+			if (sceneBenchmarked)
+				ImGui::Text("Each: %.2f ms, join: %.2f ms, random get: %.2f ms", sceneBenchmark.singleMs, sceneBenchmark.joinMs, sceneBenchmark.lookupMs);
+
+			ImGui::Text("Job system workers: %u", g_jobSystem.GetWorkerCount());
+			if (ImGui::Button("Benchmark job system"))
+			{
+				jobBenchmark = g_jobSystem.Benchmark();
+				jobsBenchmarked = true;
+			}
+			if (jobsBenchmarked)
+			{
+				ImGui::Text("fib(%u): %.2f ms, parallel for: %.2f ms (serial %.2f ms)", JobSystem::FIB_N,
+					jobBenchmark.fibMs, jobBenchmark.parallelForMs, jobBenchmark.serialForMs);
+				ImGui::Text("Tiny jobs: %.1f ns per job, %u failures", jobBenchmark.nsPerJob, jobBenchmark.failures);
+			}
+
+			if (ImGui::Button("Benchmark transforms (1M nodes)"))
+			{
+				transformBenchmark = TransformHierarchy::Benchmark(1000000);
+				transformsBenchmarked = true;
+			}
+			if (transformsBenchmarked)
+			{
+				ImGui::Text("All dirty: %.2f ms, %.2f ms on %u threads", transformBenchmark.fullMs, transformBenchmark.parallelMs, transformBenchmark.threads);
+				ImGui::Text("1%% of roots dirty: %.2f ms", transformBenchmark.partialMs);
+			}
+		}
+		ImGui::End();
+
+		// Node changes move the entities placed from them, their boxes and the BVH
+		if (spinNode >= 0)
+			fileModel.SetNodeTransform(spinNode, glm::rotate(spinNodeRest, currentTime, glm::vec3(0.0f, 1.0f, 0.0f)));
+		if (fileModel.UpdateTransforms() > 0)
+		{
+			UpdateModelTransforms(scene);
+			UpdateSceneBounds(scene);
+			scene.Each<BVHItemComponent, BoundsComponent>([&](Entity, BVHItemComponent& handle, BoundsComponent& bounds)
+			{
+				sceneBVH.SetBounds(handle.item, bounds.world);
+			});
+			sceneBVH.Refit();
+		}
+
+		ImGui::Begin("Occlusion Culling");
+		{
+			ImGui::Checkbox("Software occlusion", &occlusionEnabled);
+			ImGui::Text("Occluder triangles: %u on %u threads", occlusionCuller.OccluderTriangles, occlusionCuller.ThreadCount);
+			ImGui::Text("Occluded: %u / %u (%.1f%%)", cameraSceneStats.occlusionHidden, cameraSceneStats.occlusionTested,
+				cameraSceneStats.occlusionTested ? 100.0f * cameraSceneStats.occlusionHidden / cameraSceneStats.occlusionTested : 0.0f);
+			ImGui::Text("Rasterize: %.3f ms, test: %.1f us", occlusionCuller.RasterizeMs, cameraSceneStats.occlusionTestUs);
+			ImGui::Checkbox("GPU occlusion queries", &queriesEnabled);
+			ImGui::Text("Visible: %u, queried: %u, skipped: %u, occluded: %u",
+				occlusionQueries.Visible, occlusionQueries.Queried, occlusionQueries.Skipped, occlusionQueries.Occluded);
+		}
+		ImGui::End();
 		
-		ImGui::Begin("Light Camera");
+		ImGui::Begin("Shadow Cascades");
 		{
-			ImGui::DragFloat3("Position", &lightPos.x, 0.1f, -100.0f, 100.0f);
-			ImGui::DragFloat("Near Plane", &near_plane, 0.1f, -50.0f, 100.0f);
-			ImGui::DragFloat("Far Plane", &far_plane, 0.1f, -50.0f, 100.0f);
+			ImGui::Checkbox("Directional light", &sunEnabled);
+			ImGui::DragFloat3("Direction", &lightManager.DirLight.direction.x, 0.01f, -1.0f, 1.0f);
+			int cascadeCount = static_cast<int>(shadowCascades.CascadeCount);
+			ImGui::SliderInt("Cascades", &cascadeCount, 1, ShadowCascades::MAX_CASCADES);
+			shadowCascades.CascadeCount = static_cast<unsigned int>(cascadeCount);
+			ImGui::SliderFloat("Split lambda", &shadowCascades.SplitLambda, 0.0f, 1.0f);
+			ImGui::DragFloat("Shadow distance", &shadowDistance, 0.5f, 1.0f, 100.0f);
+			ImGui::Checkbox("Stable fit", &shadowCascades.StableFit);
+			int resolutionLevel = static_cast<int>(std::log2(shadowCascades.Resolution)) - 9;
+			const char* resolutions[] = { "512", "1024", "2048", "4096" };
+			if (ImGui::Combo("Resolution", &resolutionLevel, resolutions, 4))
+				shadowCascades.Resolution = 512 << resolutionLevel;
+			ImGui::Checkbox("Tint cascades", &cascadeTintEnabled);
+			ImGui::Checkbox("Preview cascade", &shadowPreviewEnabled);
+			ImGui::Checkbox("Caster culling", &casterCullingEnabled);
+			ImGui::Text("Shadow draw calls: %u (%u instanced), cull %.1f us", shadowDrawCalls, shadowInstancedDrawCalls, casterCullUs);
+			unsigned int casterDraws = 0;
+			for (unsigned int c = 0; c < shadowCascades.CascadeCount; c++)
+				casterDraws += cascadeCasters[c];
+			ImGui::Text("Caster draws: %u after culling, %u before", casterDraws, shadowCasters * shadowCascades.CascadeCount);
+			for (unsigned int c = 0; c < shadowCascades.CascadeCount; c++)
+				ImGui::Text("Cascade %u: to %.1f, %.3f units per texel, %u of %u casters", c, shadowCascades.GetSplit(c),
+					shadowCascades.GetTexelSize(c), cascadeCasters[c], shadowCasters);
 		}
 		ImGui::End();
-		// Shadow Depth Pre-Pass
-		glm::mat4 lightProjection, lightView;
-		glm::mat4 lightSpaceMatrix;
-		lightProjection = glm::ortho(-10.0f, 10.0f, -10.0f, 10.0f, near_plane, far_plane);
-		lightView = glm::lookAt(lightPos, glm::vec3(0.0f), glm::vec3(0.0, 1.0, 0.0));
-		lightSpaceMatrix = lightProjection * lightView;
-		lightingDepthShader.Use();
-		lightingDepthShader.SetMat4("lightSpaceMatrix", lightSpaceMatrix);
-
-		glViewport(0, 0, SHADOW_WIDTH, SHADOW_HEIGHT);
-		glBindFramebuffer(GL_FRAMEBUFFER, depthMapFBO);
-		glClear(GL_DEPTH_BUFFER_BIT);
-			glDisable(GL_CULL_FACE);
-			RenderScene(lightingDepthShader);
-			glEnable(GL_CULL_FACE);
-		glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
-		ImGui::Begin("Shadow Depth Pass Result");
-		{
-			ImGui::GetWindowDrawList()->AddImage(
-												(void *)shadowMap,
-												ImVec2(ImGui::GetCursorScreenPos()),
-												ImVec2(ImGui::GetCursorScreenPos().x + g_windowWidth / 2,
-														ImGui::GetCursorScreenPos().y + g_windowHeight / 2), ImVec2(0, 1), ImVec2(1, 0));
+
+		// Per frame data
+		FrameBlock frameBlock;
+		// The aspect follows the window even while targets keep their old size
+		float aspect = (float)g_windowWidth / (float)g_windowHeight;
+		frameBlock.projection = glm::perspective(glm::radians(camera.Zoom), aspect, 0.1f, 100.0f);
+		frameBlock.view = camera.GetViewMatrix();
+		frameBlock.viewPos = camera.Position;
+		frameBlock.time = currentTime;
+		g_uniformRing.Bind(FRAME_BLOCK_BINDING, g_uniformRing.Push(frameBlock));
+
+		ImGui::Begin("Lights");
+		{
+			ImGui::Checkbox("Flashlight", &flashlightEnabled);
+			ImGui::Text("Point lights: %u", lightManager.GetPointLightCount());
+			ImGui::Text("Spot lights: %u", lightManager.GetSpotLightCount());
+			ImGui::Text("Pack time: %.2f us", lightManager.PackTimeUs);
 		}
 		ImGui::End();
 
-		// Color pass
-		glBindFramebuffer(GL_FRAMEBUFFER, frameBuffer);
-		glViewport(0, 0, g_windowWidth, g_windowHeight);
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		// The flashlight follows the camera
+		if (flashlightEnabled && flashlightEntity == NULL_ENTITY)
+			flashlightEntity = CreateSpotLight(scene, lightManager, SpotLight(), true);
+		else if (!flashlightEnabled && flashlightEntity != NULL_ENTITY)
+		{
+			DestroyLight(scene, lightManager, flashlightEntity);
+			flashlightEntity = NULL_ENTITY;
+		}
+		if (shadingBenchmark.IsRunning())
+			shadingBenchmark.BeginFrame();
+		SyncLights(scene, lightManager, camera);
+		lightManager.Upload();
+
+		// The benchmark alternates the shading path on its own
+		bool deferred = shadingBenchmark.IsRunning() ? shadingBenchmark.GetPath() == ShadingBenchmark::DEFERRED : deferredEnabled;
+		bool clustered = shadingBenchmark.IsRunning() ? shadingBenchmark.GetPath() == ShadingBenchmark::CLUSTERED : clusteredEnabled && !deferred;
+		if (clustered)
+		{
+			lightManager.GetBoundingSpheres(clusterCutoff, lightSpheres);
+			lightClusters.SetProjection(glm::radians(camera.Zoom), aspect, 0.1f, 100.0f);
+			lightClusters.Build(frameBlock.view, lightSpheres, lightManager.GetPointLightCount());
+			lightClusters.Upload();
+		}
 
-		// View transformations
-		glm::mat4 viewMat = camera.GetViewMatrix();
-		glBindBuffer(GL_UNIFORM_BUFFER, uboMatrices);
-		glBufferSubData(GL_UNIFORM_BUFFER, sizeof(glm::mat4), sizeof(glm::mat4), glm::value_ptr(viewMat));
-		glBindBuffer(GL_UNIFORM_BUFFER, 0);
-			   
-		lightingShader.Use();
-		lightingShader.SetMat4("projection", projectionMat);
-		lightingShader.SetMat4("view", viewMat);
-		lightingShader.SetVec3("viewPos", camera.Position);
-
-		spotLight.position = camera.Position;
-		spotLight.direction = camera.Front;
-
-		lightingShader.SetPointLight("pointLights[0]", pointLight);
-		lightingShader.SetDirectionalLight("dirLight", dirLight);
-		lightingShader.SetSpotLight("spotLight", spotLight);
-		lightingShader.SetMat4("lightSpaceMatrix", lightSpaceMatrix);
+		// Cascades follow the camera, the whole scene may cast into them
+		shadowCascades.Update(frameBlock.view, glm::radians(camera.Zoom), aspect, 0.1f, std::min(shadowDistance, 100.0f),
+			lightManager.DirLight.direction, sceneBVH.GetBounds());
+
+		LightBlock lightBlock;
+		DirectionalLight sun = lightManager.DirLight;
+		if (!sunEnabled)
+			sun.ambient = sun.diffuse = sun.specular = glm::vec3(0.0f);
+		lightBlock.dirLight = sun;
+		lightBlock.numPointLights = lightManager.GetPointLightCount();
+		lightBlock.numSpotLights = lightManager.GetSpotLightCount();
+		lightBlock.clusterGrid = glm::vec4(LightClusters::TILES_X, LightClusters::TILES_Y, LightClusters::DEPTH_SLICES, clusterCutoff);
+		lightBlock.clusterDepth = glm::vec4(0.1f, 100.0f, lightClusters.GetSliceScale(), lightClusters.GetSliceBias());
+		lightBlock.clusterTileScale = glm::vec4(float(LightClusters::TILES_X) / g_renderWidth, float(LightClusters::TILES_Y) / g_renderHeight, 0.0f, 0.0f);
+		for (unsigned int c = 0; c < ShadowCascades::MAX_CASCADES; c++)
+			lightBlock.cascadeMatrices[c] = shadowCascades.GetMatrix(std::min(c, shadowCascades.CascadeCount - 1));
+		lightBlock.cascadeSplits = shadowCascades.GetSplits();
+		lightBlock.cascadeParams = glm::vec4(static_cast<float>(shadowCascades.CascadeCount), cascadeTintEnabled ? 1.0f : 0.0f, 0.0f, 0.0f);
+		g_uniformRing.Bind(LIGHT_BLOCK_BINDING, g_uniformRing.Push(lightBlock));
 
 		ImGui::Begin("Parallax Amount");
 		{
 			ImGui::DragFloat("Amount", &parallaxHeightScale, 0.1, -1.0f, 1.0f);
 		}
 		ImGui::End();
-		lightingShader.SetFloat("height_scale", parallaxHeightScale);
-
-		lightingShader.SetInt("material.texture_diffuse1", 0);
-		lightingShader.SetInt("material.texture_specular1", 1);
-		lightingShader.SetInt("material.texture_normal1", 2);
-		lightingShader.SetInt("shadowMap", 3);
-		lightingShader.SetInt("depthMap", 4);
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, brickDiffTextureGammaCorrected);
-		glActiveTexture(GL_TEXTURE1);
-		glBindTexture(GL_TEXTURE_2D, floorSpecTextureGammaCorrected);
-		glActiveTexture(GL_TEXTURE2);
-		glBindTexture(GL_TEXTURE_2D, brickNormalTextureGammaCorrected);
-		glActiveTexture(GL_TEXTURE3);
-		glBindTexture(GL_TEXTURE_2D, shadowMap);
-		glActiveTexture(GL_TEXTURE4);
-		glBindTexture(GL_TEXTURE_2D, brickDepthTextureGammaCorrected);
-		lightingShader.SetFloat("material.shininess", 32.0f);
-
-		RenderScene(lightingShader);
-		
-		// Draw skybox
-		glDepthFunc(GL_LEQUAL);
-		skyboxShader.Use();
-		glm::mat4 skyBoxViewMat = glm::mat4(glm::mat3(camera.GetViewMatrix()));
-		skyboxShader.SetMat4("projection", projectionMat);
-		skyboxShader.SetMat4("view", skyBoxViewMat);
-		glBindVertexArray(skyboxVAO);
-		glActiveTexture(GL_TEXTURE0);
-		glDrawArrays(GL_TRIANGLES, 0, 36);
-		glBindVertexArray(0);
-		glDepthFunc(GL_LESS);
-
-		// PostProcess pass
-		glBindFramebuffer(GL_READ_FRAMEBUFFER, frameBuffer);
-		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, intermediateFBO);
-		glBlitFramebuffer(0, 0, g_windowWidth, g_windowHeight, 0, 0, g_windowWidth, g_windowHeight, GL_COLOR_BUFFER_BIT, GL_NEAREST);
-		glBindFramebuffer(GL_FRAMEBUFFER, 0);
-		screenShader.Use();
-		screenShader.SetFloat("time", (float)glfwGetTime());
+
 		ImGui::Begin("Post Processing");
 		{
+			ImGui::Checkbox("Post process", &postProcessEnabled);
 			ImGui::Text("Film Grain");
 			ImGui::Checkbox("FG Enabled", &filmGrainEnabled);
 			ImGui::DragFloat("Strength", &filmgrainStrength, 0.1f, 0.0f, 80.0f);
@@ -477,18 +824,446 @@ int main()
 			ImGui::DragFloat("Opacity", &vignetteOpacity, 0.1f, 0.0f, 10.0f);
 		}
 		ImGui::End();
-		screenShader.SetFloat("filmgrainEnabled", filmGrainEnabled);
-		screenShader.SetFloat("grainStrength", filmgrainStrength);
-		screenShader.SetFloat("vignetteEnabled", vignetteEnabled);
-		screenShader.SetFloat("vignetteInnerRadius", vignetteInnerRadius);
-		screenShader.SetFloat("vignetteOuterRadius", vignetteOuterRadius);
-		screenShader.SetFloat("vignetteOpacity", vignetteOpacity);
-		screenShader.SetFloat("near_plane", near_plane);
-		screenShader.SetFloat("far_plane", far_plane);
-		glBindVertexArray(quadVAO);
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, screenTexture);
-		glDrawArrays(GL_TRIANGLES, 0, 6);
+
+		// One light matrix per cascade for the shadow pass, the lighting shaders read them from LightData
+		UniformAllocation cascadeAllocations[ShadowCascades::MAX_CASCADES];
+		for (unsigned int c = 0; c < shadowCascades.CascadeCount; c++)
+		{
+			PassBlock cascadePassBlock;
+			cascadePassBlock.lightSpaceMatrix = shadowCascades.GetMatrix(c);
+			cascadeAllocations[c] = g_uniformRing.Push(cascadePassBlock);
+		}
+
+		if (g_windowWidth != lastWindowWidth || g_windowHeight != lastWindowHeight)
+		{
+			lastWindowWidth = g_windowWidth;
+			lastWindowHeight = g_windowHeight;
+			settledFrames = 0;
+		}
+		if (g_renderWidth != g_windowWidth || g_renderHeight != g_windowHeight)
+		{
+			if (++settledFrames >= RESIZE_SETTLE_FRAMES)
+			{
+				g_renderWidth = g_windowWidth;
+				g_renderHeight = g_windowHeight;
+				settledFrames = 0;
+			}
+		}
+
+		MaterialBlock materialBlock;
+		materialBlock.heightScale = parallaxHeightScale;
+		UniformAllocation materialAllocation = g_uniformRing.Push(materialBlock);
+
+		// Shared by the depth pre-pass and the color pass
+		Frustum cameraFrustum(frameBlock.projection * frameBlock.view);
+		if (occlusionEnabled)
+		{
+			occlusionCuller.BeginFrame(frameBlock.projection * frameBlock.view);
+			scene.Each<MeshRendererComponent, BoundsComponent>([&](Entity entity, MeshRendererComponent& renderer, BoundsComponent& bounds)
+			{
+				if (renderer.occluder && cameraFrustum.TestAABB(bounds.world))
+					occlusionCuller.AddOccluder(*renderer.mesh, scene.Get<TransformComponent>(entity).world);
+			});
+			occlusionCuller.Rasterize();
+		}
+
+		// Frame graph, rebuilt every frame from the current settings
+		renderTargets.BeginFrame();
+		renderGraph.Reset();
+		RenderTextureDesc shadowDesc;
+		shadowDesc.width = shadowCascades.Resolution;
+		shadowDesc.height = shadowCascades.Resolution;
+		shadowDesc.layers = static_cast<int>(shadowCascades.CascadeCount);
+		shadowDesc.internalFormat = GL_DEPTH_COMPONENT24;
+		shadowDesc.filter = GL_NEAREST;
+		shadowDesc.wrap = GL_CLAMP_TO_BORDER;
+		RenderResource shadowMap = renderGraph.CreateTexture("Shadow cascades", shadowDesc);
+		// ImGui only shows 2D textures, the previewed cascade is copied out of the array
+		// and only while the preview window is open
+		RenderResource shadowPreview = RenderGraph::INVALID_RESOURCE;
+		if (shadowPreviewEnabled)
+		{
+			RenderTextureDesc shadowPreviewDesc = shadowDesc;
+			shadowPreviewDesc.layers = 0;
+			shadowPreview = renderGraph.CreateTexture("Shadow cascade preview", shadowPreviewDesc);
+			renderGraph.MarkOutput(shadowPreview);
+		}
+
+		RenderTextureDesc sceneColorDesc;
+		sceneColorDesc.width = g_renderWidth;
+		sceneColorDesc.height = g_renderHeight;
+		sceneColorDesc.internalFormat = GL_RGB8;
+		// The G-buffer is not multisampled, lighting it per sample would cost what deferred saves
+		sceneColorDesc.samples = deferred ? 0 : g_msaaSamples;
+		RenderResource sceneColor = renderGraph.CreateTexture("Scene color", sceneColorDesc);
+		RenderTextureDesc sceneDepthDesc = sceneColorDesc;
+		sceneDepthDesc.internalFormat = GL_DEPTH24_STENCIL8;
+		if (deferred)
+			sceneDepthDesc.filter = GL_NEAREST;
+		RenderResource sceneDepth = renderGraph.CreateTexture("Scene depth", sceneDepthDesc);
+		RenderResource backbuffer = renderGraph.ImportBackbuffer("Backbuffer", g_windowWidth, g_windowHeight);
+
+		renderGraph.AddPass("Shadow", [&](RenderGraph& graph)
+		{
+			lightingDepthShader.Use();
+			// Every layer is attached, this clears all cascades
+			glClear(GL_DEPTH_BUFFER_BIT);
+			g_renderState.SetCullFace(false);
+			glm::vec3 lightDirection = shadowCascades.GetDirection();
+			shadowBucket.Clear();
+			shadowBucket.SetView(camera.Position - lightDirection * shadowDistance, lightDirection, 0.0f, 2.0f * shadowDistance);
+			RenderScene(shadowBucket, lightingDepthShader);
+			shadowBucket.InstancingEnabled = instancingEnabled;
+			shadowBucket.MultiDrawEnabled = multiDrawEnabled;
+			shadowBucket.CullingEnabled = casterCullingEnabled;
+
+			// Recorded once, then culled against each cascade's volume and
+			// submitted into its layer with that cascade's matrix. Without
+			// caster culling one sort serves every cascade.
+			shadowDrawCalls = 0;
+			shadowInstancedDrawCalls = 0;
+			casterCullUs = 0.0;
+			for (unsigned int c = 0; c < shadowCascades.CascadeCount; c++)
+			{
+				if (c == 0 || casterCullingEnabled)
+				{
+					shadowBucket.SetFrustum(shadowCascades.GetFrustum(c));
+					shadowBucket.Sort();
+					casterCullUs += shadowBucket.CullTimeUs;
+				}
+				shadowCasters = shadowBucket.GetPacketCount();
+				cascadeCasters[c] = shadowBucket.VisibleCount;
+				g_renderState.BindFramebuffer(GL_FRAMEBUFFER, graph.GetLayerFramebuffer(shadowMap, c));
+				g_uniformRing.Bind(PASS_BLOCK_BINDING, cascadeAllocations[c]);
+				shadowBucket.Submit(g_uniformRing);
+				shadowDrawCalls += shadowBucket.DrawCalls;
+				shadowInstancedDrawCalls += shadowBucket.InstancedDrawCalls;
+			}
+			g_renderState.SetCullFace(true);
+		}).Write(shadowMap);
+
+		if (shadowPreviewEnabled)
+		{
+			renderGraph.AddPass("Shadow preview", [&](RenderGraph& graph)
+			{
+				unsigned int cascade = std::min(static_cast<unsigned int>(previewCascade), shadowCascades.CascadeCount - 1);
+				g_renderState.BindFramebuffer(GL_READ_FRAMEBUFFER, graph.GetLayerFramebuffer(shadowMap, cascade));
+				g_renderState.BindFramebuffer(GL_DRAW_FRAMEBUFFER, graph.GetFramebuffer(shadowPreview));
+				glBlitFramebuffer(0, 0, shadowCascades.Resolution, shadowCascades.Resolution, 0, 0, shadowCascades.Resolution, shadowCascades.Resolution,
+					GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+			}).Read(shadowMap).Write(shadowPreview);
+		}
+
+		if (deferred)
+		{
+			// Albedo, octahedral normal and shininess, specular color, position comes from depth
+			RenderTextureDesc gbufferDesc = sceneColorDesc;
+			gbufferDesc.filter = GL_NEAREST;
+			gbufferDesc.internalFormat = GL_RGBA8;
+			RenderResource gbufferAlbedo = renderGraph.CreateTexture("GBuffer albedo", gbufferDesc);
+			RenderResource gbufferSpecular = renderGraph.CreateTexture("GBuffer specular", gbufferDesc);
+			gbufferDesc.internalFormat = GL_RGB10_A2;
+			RenderResource gbufferNormal = renderGraph.CreateTexture("GBuffer normal shininess", gbufferDesc);
+
+			renderGraph.AddPass("GBuffer", [&](RenderGraph&)
+			{
+				glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+				gbufferShader.Use();
+				g_uniformRing.Bind(MATERIAL_BLOCK_BINDING, materialAllocation);
+				g_renderState.BindTexture(4, GL_TEXTURE_2D, brickDepthTextureGammaCorrected);
+				g_materialTextures.Bind();
+				g_materials.Bind(2);
+
+				opaqueBucket.Clear();
+				opaqueBucket.SetView(camera.Position, camera.Front, 0.1f, 100.0f);
+				opaqueBucket.SetFrustum(cameraFrustum);
+				opaqueBucket.CullingEnabled = cullingEnabled;
+				if (queriesEnabled)
+					occlusionQueries.BeginFrame(scene.GetIndexCapacity());
+				RenderScene(opaqueBucket, gbufferShader, bvhEnabled ? &cameraFrustum : nullptr,
+					occlusionEnabled ? &occlusionCuller : nullptr, queriesEnabled ? &occlusionQueries : nullptr, &cameraSceneStats);
+				opaqueBucket.Sort();
+				opaqueBucket.InstancingEnabled = instancingEnabled;
+				opaqueBucket.MultiDrawEnabled = multiDrawEnabled;
+				// The G-buffer holds one surface per pixel, translucent materials are shaded opaque
+				opaqueBucket.BlendTranslucent = false;
+				opaqueBucket.Submit(g_uniformRing);
+				if (queriesEnabled)
+					occlusionQueries.Submit(boundingBoxShader, gbufferShader, g_uniformRing, camera.Position);
+			}).Write(gbufferAlbedo).Write(gbufferNormal).Write(gbufferSpecular).Write(sceneDepth);
+
+			// One full screen pass over every light, the sky fills pixels the G-buffer pass left empty
+			renderGraph.AddPass("Deferred lighting", [&, gbufferAlbedo, gbufferNormal, gbufferSpecular](RenderGraph& graph)
+			{
+				DeferredBlock deferredBlock;
+				deferredBlock.inverseViewProjection = glm::inverse(frameBlock.projection * frameBlock.view);
+				g_uniformRing.Bind(PASS_BLOCK_BINDING, g_uniformRing.Push(deferredBlock));
+				deferredLightingShader.Use();
+				g_renderState.BindTexture(0, GL_TEXTURE_2D, graph.GetTexture(gbufferAlbedo));
+				g_renderState.BindTexture(1, GL_TEXTURE_2D, graph.GetTexture(gbufferNormal));
+				g_renderState.BindTexture(2, GL_TEXTURE_2D, graph.GetTexture(sceneDepth));
+				g_renderState.BindTexture(3, GL_TEXTURE_CUBE_MAP, cubemapTexture);
+				g_renderState.BindTexture(4, GL_TEXTURE_2D_ARRAY, graph.GetTexture(shadowMap));
+				lightManager.Bind(5, 6);
+				g_renderState.BindTexture(7, GL_TEXTURE_2D, graph.GetTexture(gbufferSpecular));
+				g_renderState.SetDepthTest(false);
+				g_renderState.BindVertexArray(quadVAO);
+				glDrawArrays(GL_TRIANGLES, 0, 6);
+				g_renderState.SetDepthTest(true);
+			}).Read(gbufferAlbedo).Read(gbufferNormal).Read(gbufferSpecular).Read(sceneDepth).Read(shadowMap).Write(sceneColor);
+		}
+		else
+		{
+			// Lays down the final depth with a cheap shader so the lighting shader
+			// only runs once per sample, on the surface that ends up visible
+			if (depthPrePassEnabled)
+			{
+				renderGraph.AddPass("Depth prepass", [&](RenderGraph&)
+				{
+					glClear(GL_DEPTH_BUFFER_BIT);
+					depthPrePassShader.Use();
+					g_uniformRing.Bind(MATERIAL_BLOCK_BINDING, materialAllocation);
+					g_renderState.BindTexture(4, GL_TEXTURE_2D, brickDepthTextureGammaCorrected);
+
+					depthBucket.Clear();
+					depthBucket.SetView(camera.Position, camera.Front, 0.1f, 100.0f);
+					depthBucket.SetFrustum(cameraFrustum);
+					depthBucket.CullingEnabled = cullingEnabled;
+					// Items hidden by occlusion queries still go in, their depth is correct either way
+					RenderScene(depthBucket, depthPrePassShader, bvhEnabled ? &cameraFrustum : nullptr,
+						occlusionEnabled ? &occlusionCuller : nullptr);
+					depthBucket.Sort();
+					depthBucket.InstancingEnabled = instancingEnabled;
+					depthBucket.MultiDrawEnabled = multiDrawEnabled;
+					depthBucket.SkipTranslucent = true;
+					g_gpuProfiler.BeginSamples("Prepass samples");
+					depthBucket.Submit(g_uniformRing);
+					g_gpuProfiler.EndSamples();
+				}).Write(sceneDepth);
+			}
+
+			RenderGraph::PassBuilder colorPass = renderGraph.AddPass("Color", [&](RenderGraph& graph)
+			{
+				const Shader& shader = clustered ? (depthPrePassEnabled ? lightingEqualClusteredShader : lightingClusteredShader)
+					: (depthPrePassEnabled ? lightingEqualShader : lightingShader);
+				if (depthPrePassEnabled)
+				{
+					glClear(GL_COLOR_BUFFER_BIT);
+					g_renderState.SetDepthFunc(GL_EQUAL);
+					g_renderState.SetDepthMask(false);
+				}
+				else
+					glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+				shader.Use();
+
+				g_uniformRing.Bind(MATERIAL_BLOCK_BINDING, materialAllocation);
+
+				g_renderState.BindTexture(3, GL_TEXTURE_2D_ARRAY, graph.GetTexture(shadowMap));
+				g_renderState.BindTexture(4, GL_TEXTURE_2D, brickDepthTextureGammaCorrected);
+				lightManager.Bind(5, 6);
+				if (clustered)
+					lightClusters.Bind(7, 8);
+				g_materialTextures.Bind();
+				g_materials.Bind(2);
+
+				opaqueBucket.Clear();
+				opaqueBucket.SetView(camera.Position, camera.Front, 0.1f, 100.0f);
+				opaqueBucket.SetFrustum(cameraFrustum);
+				opaqueBucket.CullingEnabled = cullingEnabled;
+				if (queriesEnabled)
+					occlusionQueries.BeginFrame(scene.GetIndexCapacity());
+				RenderScene(opaqueBucket, shader, bvhEnabled ? &cameraFrustum : nullptr,
+					occlusionEnabled ? &occlusionCuller : nullptr, queriesEnabled ? &occlusionQueries : nullptr, &cameraSceneStats);
+				opaqueBucket.Sort();
+				opaqueBucket.InstancingEnabled = instancingEnabled;
+				opaqueBucket.MultiDrawEnabled = multiDrawEnabled;
+				opaqueBucket.BlendTranslucent = true;
+				// Samples that passed the depth test, i.e. lighting shader invocations
+				// when early depth testing applies. Must end before the occlusion queries.
+				g_gpuProfiler.BeginSamples("Shaded samples");
+				opaqueBucket.Submit(g_uniformRing);
+				g_gpuProfiler.EndSamples();
+				if (depthPrePassEnabled)
+				{
+					// Boxes and conditional draws below are tested against the pre-pass depth
+					g_renderState.SetDepthMask(true);
+					g_renderState.SetDepthFunc(GL_LEQUAL);
+				}
+				if (queriesEnabled)
+					occlusionQueries.Submit(boundingBoxShader, shader, g_uniformRing, camera.Position);
+
+				// Draw skybox
+				g_renderState.SetDepthFunc(GL_LEQUAL);
+				skyboxShader.Use();
+				g_renderState.BindVertexArray(skyboxVAO);
+				g_renderState.BindTexture(0, GL_TEXTURE_CUBE_MAP, cubemapTexture);
+				glDrawArrays(GL_TRIANGLES, 0, 36);
+				g_renderState.SetDepthFunc(GL_LESS);
+
+				// Translucent surfaces blend over the sky as well
+				opaqueBucket.SubmitTranslucent(g_uniformRing);
+			}).Read(shadowMap).Write(sceneColor).Write(sceneDepth);
+			if (depthPrePassEnabled)
+				colorPass.Read(sceneDepth);
+		}
+
+		// Without post processing the resolve goes straight to the window and
+		// no full resolution intermediate is allocated
+		RenderResource resolveTarget = backbuffer;
+		if (postProcessEnabled)
+		{
+			RenderTextureDesc screenColorDesc = sceneColorDesc;
+			screenColorDesc.samples = 0;
+			resolveTarget = renderGraph.CreateTexture("Resolved color", screenColorDesc);
+		}
+
+		renderGraph.AddPass("Resolve", [&](RenderGraph& graph)
+		{
+			g_renderState.BindFramebuffer(GL_READ_FRAMEBUFFER, graph.GetFramebuffer(sceneColor));
+			g_renderState.BindFramebuffer(GL_DRAW_FRAMEBUFFER, graph.GetFramebuffer(resolveTarget));
+			// Multisample blits cannot scale, a window still being resized shows the image unscaled
+			glBlitFramebuffer(0, 0, g_renderWidth, g_renderHeight, 0, 0, g_renderWidth, g_renderHeight, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+		}).Read(sceneColor).Write(resolveTarget);
+
+		if (postProcessEnabled)
+		{
+			renderGraph.AddPass("Post process", [&](RenderGraph& graph)
+			{
+				screenShader.Use();
+				PostProcessBlock postProcessBlock;
+				postProcessBlock.filmgrainEnabled = filmGrainEnabled ? 1.0f : 0.0f;
+				postProcessBlock.grainStrength = filmgrainStrength;
+				postProcessBlock.vignetteEnabled = vignetteEnabled ? 1.0f : 0.0f;
+				postProcessBlock.vignetteInnerRadius = vignetteInnerRadius;
+				postProcessBlock.vignetteOuterRadius = vignetteOuterRadius;
+				postProcessBlock.vignetteOpacity = vignetteOpacity;
+				postProcessBlock.nearPlane = 0.1f;
+				postProcessBlock.farPlane = 100.0f;
+				g_uniformRing.Bind(PASS_BLOCK_BINDING, g_uniformRing.Push(postProcessBlock));
+				g_renderState.BindVertexArray(quadVAO);
+				g_renderState.BindTexture(0, GL_TEXTURE_2D, graph.GetTexture(resolveTarget));
+				glDrawArrays(GL_TRIANGLES, 0, 6);
+			}).Read(resolveTarget).Write(backbuffer);
+		}
+
+		renderGraph.Compile();
+		renderGraph.Execute();
+		renderTargets.EndFrame();
+		g_uniformRing.EndFrame();
+		g_instanceBuffer.EndFrame();
+		g_geometryPool.EndFrame();
+
+		ImGui::Begin("Render Graph");
+		{
+			ImGui::Text("Passes culled: %u, physical textures: %u", renderGraph.CulledPasses, renderGraph.PhysicalTextures);
+			ImGui::Text("Peak transient memory: %.1f MB (%.1f MB without aliasing)",
+				renderGraph.PeakTransientBytes / (1024.0f * 1024.0f), renderGraph.UnaliasedTransientBytes / (1024.0f * 1024.0f));
+			ImGui::Text("Render target pool: %u targets, %.1f MB, %u created, %u freed", renderTargets.TargetCount,
+				renderTargets.TargetBytes / (1024.0f * 1024.0f), renderTargets.Created, renderTargets.Freed);
+			ImGui::Text("Render size: %d x %d, window: %d x %d", g_renderWidth, g_renderHeight, g_windowWidth, g_windowHeight);
+			if (ImGui::Button("Dump DOT"))
+				renderGraph.DumpDot("RenderGraph.dot");
+			for (const GpuProfiler::Scope& scope : g_gpuProfiler.GetScopes())
+			{
+				if (scope.hasTime && g_gpuProfiler.IsCurrent(scope))
+					ImGui::Text("%s: %.3f ms GPU", scope.name.c_str(), scope.gpuMs);
+			}
+		}
+		ImGui::End();
+
+		ImGui::Begin("Depth Pre-pass");
+		{
+			ImGui::Checkbox("Depth pre-pass", &depthPrePassEnabled);
+			ImGui::Text("Frame: %.2f ms CPU", g_deltaTime * 1000.0f);
+			const GpuProfiler::Scope* prePass = g_gpuProfiler.Find("Depth prepass");
+			const GpuProfiler::Scope* color = g_gpuProfiler.Find("Color");
+			double prePassMs = (prePass && g_gpuProfiler.IsCurrent(*prePass)) ? prePass->gpuMs : 0.0;
+			ImGui::Text("GPU: %.3f ms pre-pass + %.3f ms color = %.3f ms", prePassMs, color ? color->gpuMs : 0.0,
+				prePassMs + (color ? color->gpuMs : 0.0));
+			// Shaded samples over covered samples is the lighting overdraw the pre-pass removes
+			const GpuProfiler::Scope* shaded = g_gpuProfiler.Find("Shaded samples");
+			double screenSamples = static_cast<double>(g_renderWidth) * g_renderHeight * std::max(1, g_msaaSamples);
+			if (shaded)
+				ImGui::Text("Shaded samples: %llu (%.2f per screen sample)", static_cast<unsigned long long>(shaded->samples),
+					shaded->samples / screenSamples);
+			if (prePass && g_gpuProfiler.IsCurrent(*prePass))
+			{
+				const GpuProfiler::Scope* prePassSamples = g_gpuProfiler.Find("Prepass samples");
+				if (prePassSamples)
+					ImGui::Text("Pre-pass samples: %llu (%.2f per screen sample)", static_cast<unsigned long long>(prePassSamples->samples),
+						prePassSamples->samples / screenSamples);
+			}
+		}
+		ImGui::End();
+
+		ImGui::Begin("Deferred Shading");
+		{
+			auto currentMs = [](const char* name)
+			{
+				const GpuProfiler::Scope* scope = g_gpuProfiler.Find(name);
+				return (scope && g_gpuProfiler.IsCurrent(*scope)) ? scope->gpuMs : 0.0;
+			};
+			double forwardMs = currentMs("Depth prepass") + currentMs("Color");
+			double deferredMs = currentMs("GBuffer") + currentMs("Deferred lighting");
+			if (shadingBenchmark.IsRunning())
+				shadingBenchmark.EndFrame(deferred ? deferredMs : forwardMs);
+
+			ImGui::Checkbox("Deferred", &deferredEnabled);
+			ImGui::Text("Forward: %.3f ms GPU, deferred: %.3f ms GPU", forwardMs, deferredMs);
+			ImGui::Text("G-buffer: 12 bytes per pixel + depth, no MSAA");
+			if (shadingBenchmark.IsRunning())
+			{
+				const char* pathNames[] = { "forward", "clustered", "deferred" };
+				ImGui::Text("Benchmarking %s with %u lights...", pathNames[shadingBenchmark.GetPath()], shadingBenchmark.GetLightCount());
+			}
+			else if (ImGui::Button("Benchmark forward vs clustered vs deferred"))
+				shadingBenchmark.Start();
+			for (const ShadingBenchmark::Result& result : shadingBenchmark.results)
+				ImGui::Text("%5u lights: forward %.3f ms, clustered %.3f ms, deferred %.3f ms", result.lights,
+					result.forwardMs, result.clusteredMs, result.deferredMs);
+		}
+		ImGui::End();
+
+		ImGui::Begin("Clustered Lighting");
+		{
+			ImGui::Checkbox("Clustered forward", &clusteredEnabled);
+			ImGui::DragFloat("Attenuation cutoff", &clusterCutoff, 0.0001f, 0.0001f, 0.1f, "%.4f");
+			ImGui::Text("Grid: %u x %u tiles, %u slices", LightClusters::TILES_X, LightClusters::TILES_Y, LightClusters::DEPTH_SLICES);
+			if (clustered)
+			{
+				ImGui::Text("Binning: %.3f ms CPU", lightClusters.BinMs);
+				ImGui::Text("Indices: %u (%.1f lights per cluster), max %u in one cluster", lightClusters.IndexCount,
+					lightClusters.IndexCount / double(LightClusters::CLUSTER_COUNT), lightClusters.MaxClusterLights);
+				if (lightClusters.Overflowed > 0)
+					ImGui::Text("Dropped: %u light references over %u per cluster", lightClusters.Overflowed, LightClusters::MAX_LIGHTS_PER_CLUSTER);
+			}
+			if (ImGui::Button("Benchmark binning (10k lights)"))
+			{
+				clusterBenchmark = LightClusters::Benchmark(10000);
+				clustersBenchmarked = true;
+			}
+			if (clustersBenchmarked)
+			{
+				ImGui::Text("Serial: %.2f ms, %.2f ms on %u threads", clusterBenchmark.serialMs, clusterBenchmark.parallelMs, clusterBenchmark.threads);
+				ImGui::Text("%.1f lights per cluster, max %u, %u mismatches against brute force",
+					clusterBenchmark.averageClusterLights, clusterBenchmark.maxClusterLights, clusterBenchmark.mismatches);
+			}
+		}
+		ImGui::End();
+
+		if (shadowPreviewEnabled)
+		{
+			ImGui::Begin("Shadow Cascade Preview", &shadowPreviewEnabled);
+			{
+				ImGui::SliderInt("Cascade", &previewCascade, 0, static_cast<int>(shadowCascades.CascadeCount) - 1);
+				ImGui::GetWindowDrawList()->AddImage(
+													(void *)(uintptr_t)renderGraph.GetTexture(shadowPreview),
+													ImVec2(ImGui::GetCursorScreenPos()),
+													ImVec2(ImGui::GetCursorScreenPos().x + g_windowWidth / 2,
+															ImGui::GetCursorScreenPos().y + g_windowHeight / 2), ImVec2(0, 1), ImVec2(1, 0));
+			}
+			ImGui::End();
+		}
 		
 		IMGUI_RENDER;
 
@@ -499,11 +1274,9 @@ int main()
 	glDeleteVertexArrays(1, &quadVAO);
 	glDeleteVertexArrays(1, &skyboxVAO);
 	glDeleteVertexArrays(1, &planeVAO);
-	glDeleteFramebuffers(sizeof(intermediateFBO), &intermediateFBO);
-	glDeleteFramebuffers(sizeof(frameBuffer), &frameBuffer);
-	glDeleteRenderbuffers(sizeof(rbo), &rbo);
-	glDeleteTextures(sizeof(floorSpecTextureGammaCorrected), &floorSpecTextureGammaCorrected);
-	glDeleteTextures(sizeof(floorDiffTextureGammaCorrected), &floorDiffTextureGammaCorrected);
+	renderTargets.Destroy();
+	g_gpuProfiler.Destroy();
+	lightClusters.Destroy();
 
 	CleanUp();
 
@@ -513,6 +1286,16 @@ int main()
 void CleanUp()
 {
 	fileModel.Destroy();
+	floorMesh.Destroy();
+	scene.Clear();
+	lightManager.Destroy();
+	g_materials.Destroy();
+	g_materialTextures.Destroy();
+	g_uniformRing.Destroy();
+	occlusionQueries.Destroy();
+	g_geometryPool.Destroy();
+	g_instanceBuffer.Destroy();
+	g_jobSystem.Shutdown();
 
 	ImGui_ImplOpenGL3_Shutdown();
 	ImGui_ImplGlfw_Shutdown();
@@ -522,20 +1305,20 @@ void CleanUp()
 }
 
 float planeRot = -90;
-void RenderScene(const Shader& shader)
+void BuildScene()
 {
+	std::vector<Entity> previous = scene.Pool<MeshRendererComponent>().GetEntities();
+	for (Entity entity : previous)
+		scene.Destroy(entity);
+
 	// floor
 	glm::mat4 floorMat = glm::mat4(1.0f);
-	ImGui::Begin("RotX");
-	{
-		ImGui::DragFloat("Rot-x", &planeRot, 0.1f, -180.0f, 180.0f);
-	}
-	ImGui::End();
 	floorMat = glm::translate(floorMat, glm::vec3(0.0f, -2.0f, 0.0f));
 	floorMat = glm::scale(floorMat, glm::vec3(20.0f));
 	//floorMat = glm::rotate(floorMat, glm::radians(planeRot) , glm::vec3(1.0, 0.0, 0.0));
-	shader.SetMat4("model", floorMat);
-	renderFloorQuad();
+	Entity floor = scene.Create();
+	scene.Add(floor, TransformComponent{ floorMat });
+	scene.Add(floor, MeshRendererComponent{ &floorMesh, true });
 
 	// cubes
 	/*glm::mat4 model = glm::mat4(1.0f);
@@ -556,108 +1339,181 @@ void RenderScene(const Shader& shader)
 	shader.SetMat4("model", model);
 	renderCube();*/
 
-	// render the loaded model
+	// the loaded model
 	glm::mat4 modelMat = glm::mat4(1.0f);
 	//modelMat = glm::scale(modelMat, glm::vec3(0.01f));
 	modelMat = glm::scale(modelMat, glm::vec3(0.5f));
 	modelMat = glm::translate(modelMat, glm::vec3(0.0f, -1.75f, -2.0f));
-	shader.SetMat4("model", modelMat);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
-	fileModel.Draw(shader);
 
+	// extra copies in a grid behind the model, the bucket batches them into instanced draws
+	for (int i = 0; i < modelCopies; i++)
+	{
+		glm::vec3 offset(static_cast<float>(i % 32) - 16.0f, 0.0f, -static_cast<float>(i / 32) * 2.0f);
+		glm::mat4 copyMat = i == 0 ? modelMat : glm::translate(modelMat, offset * 2.0f);
+		const std::vector<Mesh>& meshes = fileModel.GetMeshes();
+		for (unsigned int m = 0; m < meshes.size(); m++)
+		{
+			Entity entity = scene.Create();
+			scene.Add(entity, TransformComponent{ copyMat * fileModel.GetMeshTransform(m) });
+			scene.Add(entity, MeshRendererComponent{ &meshes[m], false });
+			scene.Add(entity, ModelNodeComponent{ &fileModel, m, copyMat });
+		}
+	}
+
+	// Only model nodes move, refitting keeps up with them, so the whole scene
+	// is one SAH built tree
+	UpdateSceneBounds(scene);
+	sceneBVH.Clear();
+	scene.Each<BoundsComponent>([&](Entity entity, BoundsComponent& bounds)
+	{
+		scene.Add(entity, BVHItemComponent{ sceneBVH.Add(bounds.world, entity) });
+	});
+	sceneBVH.Build();
+	sceneModelCopies = modelCopies;
+	occlusionQueries.Reset();
 }
 
-unsigned int floorQuadVAO = 0;
-unsigned int floorQuadVBO = 0;
-void renderFloorQuad()
+void RenderScene(DrawBucket& bucket, const Shader& shader, const Frustum* frustum, const OcclusionCuller* occlusion, OcclusionQueries* queries, SceneStats* stats)
 {
-	if (floorQuadVAO == 0)
+	SceneStats passStats;
+	ImGui::Begin("RotX");
 	{
-		// positions
-		glm::vec3 pos1(-1.0f, 1.0f, 0.0f);
-		glm::vec3 pos2(-1.0f, -1.0f, 0.0f);
-		glm::vec3 pos3(1.0f, -1.0f, 0.0f);
-		glm::vec3 pos4(1.0f, 1.0f, 0.0f);
-		// texture coordinates
-		glm::vec2 uv1(0.0f, 1.0f);
-		glm::vec2 uv2(0.0f, 0.0f);
-		glm::vec2 uv3(1.0f, 0.0f);
-		glm::vec2 uv4(1.0f, 1.0f);
-		// normal vector
-		glm::vec3 nm(0.0f, 0.0f, 1.0f);
-
-		// calculate tangent/bitangent vectors of both triangles
-		glm::vec3 tangent1, bitangent1;
-		glm::vec3 tangent2, bitangent2;
-		// triangle 1
-		// ----------
-		glm::vec3 edge1 = pos2 - pos1;
-		glm::vec3 edge2 = pos3 - pos1;
-		glm::vec2 deltaUV1 = uv2 - uv1;
-		glm::vec2 deltaUV2 = uv3 - uv1;
-
-		GLfloat f = 1.0f / (deltaUV1.x * deltaUV2.y - deltaUV2.x * deltaUV1.y);
-
-		tangent1.x = f * (deltaUV2.y * edge1.x - deltaUV1.y * edge2.x);
-		tangent1.y = f * (deltaUV2.y * edge1.y - deltaUV1.y * edge2.y);
-		tangent1.z = f * (deltaUV2.y * edge1.z - deltaUV1.y * edge2.z);
-		tangent1 = glm::normalize(tangent1);
-
-		bitangent1.x = f * (-deltaUV2.x * edge1.x + deltaUV1.x * edge2.x);
-		bitangent1.y = f * (-deltaUV2.x * edge1.y + deltaUV1.x * edge2.y);
-		bitangent1.z = f * (-deltaUV2.x * edge1.z + deltaUV1.x * edge2.z);
-		bitangent1 = glm::normalize(bitangent1);
-
-		// triangle 2
-		// ----------
-		edge1 = pos3 - pos1;
-		edge2 = pos4 - pos1;
-		deltaUV1 = uv3 - uv1;
-		deltaUV2 = uv4 - uv1;
-
-		f = 1.0f / (deltaUV1.x * deltaUV2.y - deltaUV2.x * deltaUV1.y);
-
-		tangent2.x = f * (deltaUV2.y * edge1.x - deltaUV1.y * edge2.x);
-		tangent2.y = f * (deltaUV2.y * edge1.y - deltaUV1.y * edge2.y);
-		tangent2.z = f * (deltaUV2.y * edge1.z - deltaUV1.y * edge2.z);
-		tangent2 = glm::normalize(tangent2);
-
-
-		bitangent2.x = f * (-deltaUV2.x * edge1.x + deltaUV1.x * edge2.x);
-		bitangent2.y = f * (-deltaUV2.x * edge1.y + deltaUV1.x * edge2.y);
-		bitangent2.z = f * (-deltaUV2.x * edge1.z + deltaUV1.x * edge2.z);
-		bitangent2 = glm::normalize(bitangent2);
-
-
-		float quadVertices[] = {
-			// positions            // normal         // texcoords  // tangent                          // bitangent
-			pos1.x, pos1.y, pos1.z, nm.x, nm.y, nm.z, uv1.x, uv1.y, tangent1.x, tangent1.y, tangent1.z, bitangent1.x, bitangent1.y, bitangent1.z,
-			pos2.x, pos2.y, pos2.z, nm.x, nm.y, nm.z, uv2.x, uv2.y, tangent1.x, tangent1.y, tangent1.z, bitangent1.x, bitangent1.y, bitangent1.z,
-			pos3.x, pos3.y, pos3.z, nm.x, nm.y, nm.z, uv3.x, uv3.y, tangent1.x, tangent1.y, tangent1.z, bitangent1.x, bitangent1.y, bitangent1.z,
-
-			pos1.x, pos1.y, pos1.z, nm.x, nm.y, nm.z, uv1.x, uv1.y, tangent2.x, tangent2.y, tangent2.z, bitangent2.x, bitangent2.y, bitangent2.z,
-			pos3.x, pos3.y, pos3.z, nm.x, nm.y, nm.z, uv3.x, uv3.y, tangent2.x, tangent2.y, tangent2.z, bitangent2.x, bitangent2.y, bitangent2.z,
-			pos4.x, pos4.y, pos4.z, nm.x, nm.y, nm.z, uv4.x, uv4.y, tangent2.x, tangent2.y, tangent2.z, bitangent2.x, bitangent2.y, bitangent2.z
-		};
+		ImGui::DragFloat("Rot-x", &planeRot, 0.1f, -180.0f, 180.0f);
+	}
+	ImGui::End();
 
-		// configure plane VAO
-		glGenVertexArrays(1, &floorQuadVAO);
-		glGenBuffers(1, &floorQuadVBO);
-		glBindVertexArray(floorQuadVAO);
-		glBindBuffer(GL_ARRAY_BUFFER, floorQuadVBO);
-		glBufferData(GL_ARRAY_BUFFER, sizeof(quadVertices), &quadVertices, GL_STATIC_DRAW);
-		glEnableVertexAttribArray(0);
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 14 * sizeof(float), (void*)0);
-		glEnableVertexAttribArray(1);
-		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 14 * sizeof(float), (void*)(3 * sizeof(float)));
-		glEnableVertexAttribArray(2);
-		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 14 * sizeof(float), (void*)(6 * sizeof(float)));
-		glEnableVertexAttribArray(3);
-		glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, 14 * sizeof(float), (void*)(8 * sizeof(float)));
+	auto start = std::chrono::high_resolution_clock::now();
+	visibleItems.clear();
+	if (frustum)
+		sceneBVH.QueryFrustum(*frustum, visibleItems);
+	else
+	{
+		const std::vector<Entity>& entities = scene.Pool<MeshRendererComponent>().GetEntities();
+		visibleItems.assign(entities.begin(), entities.end());
 	}
-	glBindVertexArray(floorQuadVAO);
-	glDrawArrays(GL_TRIANGLES, 0, 6);
-	glBindVertexArray(0);
+	passStats.queryUs = std::chrono::duration<double, std::micro>(std::chrono::high_resolution_clock::now() - start).count();
+
+	if (occlusion)
+	{
+		start = std::chrono::high_resolution_clock::now();
+		unsigned int kept = 0;
+		for (Entity entity : visibleItems)
+		{
+			if (scene.Get<MeshRendererComponent>(entity).occluder || occlusion->IsVisible(scene.Get<BoundsComponent>(entity).world))
+				visibleItems[kept++] = entity;
+		}
+		passStats.occlusionTested = static_cast<unsigned int>(visibleItems.size());
+		passStats.occlusionHidden = passStats.occlusionTested - kept;
+		visibleItems.resize(kept);
+		passStats.occlusionTestUs = std::chrono::duration<double, std::micro>(std::chrono::high_resolution_clock::now() - start).count();
+	}
+
+	start = std::chrono::high_resolution_clock::now();
+	ComponentPool<MeshRendererComponent>& renderers = scene.Pool<MeshRendererComponent>();
+	ComponentPool<TransformComponent>& transforms = scene.Pool<TransformComponent>();
+	ComponentPool<BoundsComponent>& bounds = scene.Pool<BoundsComponent>();
+	unsigned int count = static_cast<unsigned int>(visibleItems.size());
+	passStats.visible = count;
+	if (queries)
+	{
+		// The query scheduler is not thread safe, record on this thread
+		for (Entity entity : visibleItems)
+		{
+			const MeshRendererComponent& renderer = renderers.Get(entity);
+			const glm::mat4& transform = transforms.Get(entity).world;
+			// Query state is kept per entity index
+			if (!renderer.occluder && !queries->Schedule(EntityId::Index(entity), *renderer.mesh, transform, bounds.Get(entity).world))
+				continue;
+			bucket.AddMesh(shader, *renderer.mesh, transform);
+		}
+	}
+	else
+	{
+		// Every job records a contiguous slice into its own command list,
+		// the pools are only read so no locking is needed
+		unsigned int lists = std::max(1u, std::min(static_cast<unsigned int>(recordLists), count / RECORD_BATCH));
+		bucket.SetCommandListCount(lists);
+		g_jobSystem.ParallelFor(lists, 1, [&](unsigned int first, unsigned int last)
+		{
+			for (unsigned int l = first; l < last; l++)
+			{
+				CommandList& list = bucket.GetCommandList(l);
+				for (unsigned int i = count * l / lists; i < count * (l + 1) / lists; i++)
+					list.AddMesh(shader, *renderers.Get(visibleItems[i]).mesh, transforms.Get(visibleItems[i]).world);
+			}
+		});
+	}
+	passStats.recordUs = std::chrono::duration<double, std::micro>(std::chrono::high_resolution_clock::now() - start).count();
+	if (stats)
+		*stats = passStats;
+}
+
+Mesh CreateFloorMesh(unsigned int diffuseTexture, unsigned int specularTexture, unsigned int normalTexture)
+{
+	// positions
+	glm::vec3 pos1(-1.0f, 1.0f, 0.0f);
+	glm::vec3 pos2(-1.0f, -1.0f, 0.0f);
+	glm::vec3 pos3(1.0f, -1.0f, 0.0f);
+	glm::vec3 pos4(1.0f, 1.0f, 0.0f);
+	// texture coordinates
+	glm::vec2 uv1(0.0f, 1.0f);
+	glm::vec2 uv2(0.0f, 0.0f);
+	glm::vec2 uv3(1.0f, 0.0f);
+	glm::vec2 uv4(1.0f, 1.0f);
+	// normal vector
+	glm::vec3 nm(0.0f, 0.0f, 1.0f);
+
+	// calculate tangent vectors of both triangles
+	glm::vec3 tangent1, tangent2;
+	// triangle 1
+	// ----------
+	glm::vec3 edge1 = pos2 - pos1;
+	glm::vec3 edge2 = pos3 - pos1;
+	glm::vec2 deltaUV1 = uv2 - uv1;
+	glm::vec2 deltaUV2 = uv3 - uv1;
+
+	GLfloat f = 1.0f / (deltaUV1.x * deltaUV2.y - deltaUV2.x * deltaUV1.y);
+
+	tangent1.x = f * (deltaUV2.y * edge1.x - deltaUV1.y * edge2.x);
+	tangent1.y = f * (deltaUV2.y * edge1.y - deltaUV1.y * edge2.y);
+	tangent1.z = f * (deltaUV2.y * edge1.z - deltaUV1.y * edge2.z);
+	tangent1 = glm::normalize(tangent1);
+
+	// triangle 2
+	// ----------
+	edge1 = pos3 - pos1;
+	edge2 = pos4 - pos1;
+	deltaUV1 = uv3 - uv1;
+	deltaUV2 = uv4 - uv1;
+
+	f = 1.0f / (deltaUV1.x * deltaUV2.y - deltaUV2.x * deltaUV1.y);
+
+	tangent2.x = f * (deltaUV2.y * edge1.x - deltaUV1.y * edge2.x);
+	tangent2.y = f * (deltaUV2.y * edge1.y - deltaUV1.y * edge2.y);
+	tangent2.z = f * (deltaUV2.y * edge1.z - deltaUV1.y * edge2.z);
+	tangent2 = glm::normalize(tangent2);
+
+	std::vector<Vertex> vertices = {
+		// position, normal, texcoords, tangent
+		{ pos1, nm, uv1, tangent1 },
+		{ pos2, nm, uv2, tangent1 },
+		{ pos3, nm, uv3, tangent1 },
+
+		{ pos1, nm, uv1, tangent2 },
+		{ pos3, nm, uv3, tangent2 },
+		{ pos4, nm, uv4, tangent2 }
+	};
+	std::vector<unsigned int> indices = { 0, 1, 2, 3, 4, 5 };
+
+	std::vector<Texture> textures(3);
+	textures[0].id = diffuseTexture;
+	textures[0].type = "texture_diffuse";
+	textures[1].id = specularTexture;
+	textures[1].type = "texture_specular";
+	textures[2].id = normalTexture;
+	textures[2].type = "texture_normal";
+
+	return Mesh(vertices, indices, textures);
 }
 
 unsigned int cubeVAO = 0;
@@ -717,7 +1573,7 @@ void renderCube()
 		glBindBuffer(GL_ARRAY_BUFFER, cubeVBO);
 		glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
 		// link vertex attributes
-		glBindVertexArray(cubeVAO);
+		g_renderState.BindVertexArray(cubeVAO);
 		glEnableVertexAttribArray(0);
 		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
 		glEnableVertexAttribArray(1);
@@ -725,12 +1581,10 @@ void renderCube()
 		glEnableVertexAttribArray(2);
 		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
 		glBindBuffer(GL_ARRAY_BUFFER, 0);
-		glBindVertexArray(0);
 	}
 	// render Cube
-	glBindVertexArray(cubeVAO);
+	g_renderState.BindVertexArray(cubeVAO);
 	glDrawArrays(GL_TRIANGLES, 0, 36);
-	glBindVertexArray(0);
 }
 
 unsigned int loadTexture(char const * path, bool gammaCorrection)
@@ -815,6 +1669,7 @@ void ProcessInput(GLFWwindow* pWindow)
 	if (glfwGetKey(pWindow, GLFW_KEY_ESCAPE) == GLFW_PRESS)
 		glfwSetWindowShouldClose(pWindow, true);
 
+	Camera& camera = GetActiveCamera(scene);
 	float camSpeedScale = 1.0f;
 	if (glfwGetKey(pWindow, GLFW_KEY_LEFT_SHIFT) == GLFW_PRESS)
 		camSpeedScale = 7.0f;
@@ -832,13 +1687,21 @@ void ProcessInput(GLFWwindow* pWindow)
 	if (glfwGetKey(pWindow, GLFW_KEY_Q) == GLFW_PRESS)
 		camera.ProcessKeyboard(DOWN, g_deltaTime * camSpeedScale);
 	if (glfwGetKey(pWindow, GLFW_KEY_C) == GLFW_PRESS)
-		pointLight.position = camera.Position;
+	{
+		PointLightComponent& pointLight = scene.Get<PointLightComponent>(pointLightEntity);
+		pointLight.light.position = camera.Position;
+		pointLight.dirty = true;
+	}
 
 }
 
 void frame_buffer_size_callback(GLFWwindow* window, int width, int height)
 {
-	glViewport(0, 0, width, height);
+	// Minimized windows report 0 x 0, keep rendering at the last size
+	if (width <= 0 || height <= 0)
+		return;
+	g_windowWidth = width;
+	g_windowHeight = height;
 }
 
 void mouse_callback(GLFWwindow * pWindow, double xpos, double ypos)
@@ -859,10 +1722,10 @@ void mouse_callback(GLFWwindow * pWindow, double xpos, double ypos)
 	lastX = static_cast<float>(xpos);
 	lastY = static_cast<float>(ypos);
 
-	camera.ProcessMouseMovement(xoffset, yoffset);
+	GetActiveCamera(scene).ProcessMouseMovement(xoffset, yoffset);
 }
 
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
 {
-	camera.ProcessMouseScroll(static_cast<float>(yoffset));
+	GetActiveCamera(scene).ProcessMouseScroll(static_cast<float>(yoffset));
 }
\ No newline at end of file